@@ -0,0 +1,950 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/*
+ * terminal-bench replays terminal output through Vt102Emulation, Screen and
+ * the history without creating a TerminalDisplay, and reports throughput
+ * (MB/s, ns/byte), heap allocations per MB and peak RSS as JSON.
+ *
+ * Every scenario runs in a forked child process so that its peak RSS and
+ * allocation count are not mixed up with those of the other scenarios.
+ *
+ *   terminal-bench                          # all built-in scenarios
+ *   terminal-bench -s sgr -s cjk -m 64      # selected scenarios, 64 MB each
+ *   terminal-bench -r session.log -o result.json
+ *   terminal-bench --history-formats        # history memory and getCells()
+ *   terminal-bench --url-filter -s log      # UrlFilter against its QRegExp
+ *
+ * A recorded stream for --replay can be captured with "script -q -O file".
+ */
+
+// Konsole
+#include "Filter.h"
+#include "TerminalCharacterDecoder.h"
+#include "Vt102Emulation.h"
+#include "history/HistoryTypeCompressedFile.h"
+#include "history/HistoryTypeFile.h"
+#include "history/HistoryTypeNone.h"
+#include "history/compact/CompactHistoryScroll.h"
+#include "history/compact/CompactHistoryType.h"
+
+// Qt
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextStream>
+
+// System
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+
+using namespace Konsole;
+
+#ifdef __GLIBC__
+// Every heap allocation of the process, Qt containers included, goes through
+// these, so counting here covers the library as well as operator new.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static std::atomic<quint64> allocationCount(0);
+
+extern "C" void *malloc(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+#define HAVE_ALLOCATION_COUNT
+#include <malloc.h>
+#endif
+
+namespace
+{
+
+struct Options {
+    qint64 bytes = 32 * 1024 * 1024;
+    int chunkSize = 4096;
+    int columns = 120;
+    int lines = 40;
+    QString history = QStringLiteral("compact");
+    int historyLines = 5000;
+    bool historyFormats = false;
+    bool urlFilter = false;
+};
+
+struct Scenario {
+    QString name;
+    QString description;
+    // replayed over and over until Options::bytes have been processed
+    QByteArray data;
+};
+
+// Small deterministic generator so every run replays the same bytes
+class Random
+{
+public:
+    explicit Random(quint32 seed) : _state(seed) {}
+
+    int bounded(int limit)
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return static_cast<int>((_state >> 8) % static_cast<quint32>(limit));
+    }
+
+private:
+    quint32 _state;
+};
+
+const int BlockSize = 256 * 1024;
+
+void appendCodePoint(QByteArray &out, uint codePoint)
+{
+    out += QString::fromUcs4(&codePoint, 1).toUtf8();
+}
+
+void appendWord(QByteArray &out, Random &random)
+{
+    const int length = 1 + random.bounded(10);
+    for (int i = 0; i < length; i++) {
+        out += static_cast<char>('a' + random.bounded(26));
+    }
+}
+
+// plain text, e.g. cat of a log file or compiler output
+QByteArray denseAscii()
+{
+    Random random(1);
+    QByteArray out;
+    while (out.size() < BlockSize) {
+        const int length = 20 + random.bounded(100);
+        for (int i = 0; i < length; i++) {
+            out += static_cast<char>(' ' + random.bounded(95));
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// every word in its own colour, e.g. ls --color, git log, syntax highlighting
+QByteArray heavySgr()
+{
+    Random random(2);
+    QByteArray out;
+    while (out.size() < BlockSize) {
+        const int words = 4 + random.bounded(12);
+        for (int i = 0; i < words; i++) {
+            switch (random.bounded(4)) {
+            case 0:
+                out += "\033[" + QByteArray::number(30 + random.bounded(8)) + "m";
+                break;
+            case 1:
+                out += "\033[1;38;5;" + QByteArray::number(random.bounded(256)) + "m";
+                break;
+            case 2:
+                out += "\033[38;2;" + QByteArray::number(random.bounded(256)) + ";"
+                       + QByteArray::number(random.bounded(256)) + ";"
+                       + QByteArray::number(random.bounded(256)) + "m";
+                break;
+            default:
+                out += "\033[4;48;5;" + QByteArray::number(random.bounded(256)) + "m";
+                break;
+            }
+            appendWord(out, random);
+            out += "\033[0m ";
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// wide CJK characters, Hangul, emoji and combining marks
+QByteArray cjkAndEmoji()
+{
+    Random random(3);
+    QByteArray out;
+    while (out.size() < BlockSize) {
+        const int length = 10 + random.bounded(50);
+        for (int i = 0; i < length; i++) {
+            const int kind = random.bounded(10);
+            if (kind < 5) {
+                appendCodePoint(out, 0x4E00 + random.bounded(0x5200));
+            } else if (kind < 7) {
+                appendCodePoint(out, 0xAC00 + random.bounded(0x2BA4));
+            } else if (kind < 9) {
+                appendCodePoint(out, 0x1F600 + random.bounded(0x50));
+            } else {
+                out += static_cast<char>('a' + random.bounded(26));
+                appendCodePoint(out, 0x0300 + random.bounded(0x70));
+            }
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// full screen applications: scroll regions, inserted and deleted lines,
+// cursor addressing and a status line, as vim and tmux produce
+QByteArray scrollRegionChurn(int lines, int columns)
+{
+    Random random(4);
+    QByteArray out;
+    while (out.size() < BlockSize) {
+        out += "\033[1;" + QByteArray::number(lines - 1) + "r";
+        const int operations = 20 + random.bounded(40);
+        for (int i = 0; i < operations; i++) {
+            const int row = 1 + random.bounded(lines - 1);
+            out += "\033[" + QByteArray::number(row) + ";1H";
+            switch (random.bounded(6)) {
+            case 0:
+                out += "\033[" + QByteArray::number(1 + random.bounded(3)) + "L";
+                break;
+            case 1:
+                out += "\033[" + QByteArray::number(1 + random.bounded(3)) + "M";
+                break;
+            case 2:
+                out += "\033[S";
+                break;
+            case 3:
+                out += "\033M";
+                break;
+            default:
+                out += "\033[K";
+                break;
+            }
+            const int words = random.bounded(columns / 8);
+            for (int w = 0; w < words; w++) {
+                out += "\033[3" + QByteArray::number(random.bounded(8)) + "m";
+                appendWord(out, random);
+                out += ' ';
+            }
+            out += "\033[m";
+        }
+        // status line outside of the scroll region
+        out += "\0337\033[r\033[" + QByteArray::number(lines) + ";1H\033[7m";
+        appendWord(out, random);
+        out += " " + QByteArray::number(random.bounded(10000)) + "\033[K\033[m\0338";
+    }
+    return out;
+}
+
+// lines many times wider than the screen, e.g. minified files or JSON
+QByteArray longLines()
+{
+    Random random(5);
+    QByteArray out;
+    while (out.size() < BlockSize) {
+        const int length = 4000 + random.bounded(12000);
+        for (int i = 0; i < length; i++) {
+            out += static_cast<char>(' ' + random.bounded(95));
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+// log output with a URL, a host name, an email address or a port on some
+// lines, e.g. a web server or a build which downloads its dependencies
+QByteArray logLines()
+{
+    Random random(6);
+    static const char *const levels[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+    QByteArray out;
+    int seconds = 0;
+    while (out.size() < BlockSize) {
+        seconds += random.bounded(3);
+        out += "2022-06-01 " + QByteArray::number(10 + seconds / 3600 % 14) + ":"
+               + QByteArray::number(seconds / 60 % 60).rightJustified(2, '0') + ":"
+               + QByteArray::number(seconds % 60).rightJustified(2, '0') + " [" + levels[random.bounded(4)] + "] ";
+        const int words = 4 + random.bounded(12);
+        for (int i = 0; i < words; i++) {
+            appendWord(out, random);
+            out += ' ';
+        }
+        switch (random.bounded(10)) {
+        case 0:
+            out += "https://";
+            appendWord(out, random);
+            out += ".example.com/";
+            appendWord(out, random);
+            out += "?id=" + QByteArray::number(random.bounded(100000));
+            break;
+        case 1:
+            out += "www.";
+            appendWord(out, random);
+            out += ".org";
+            break;
+        case 2:
+            appendWord(out, random);
+            out += '@';
+            appendWord(out, random);
+            out += ".com";
+            break;
+        case 3:
+            out += "10.0." + QByteArray::number(random.bounded(256)) + "." + QByteArray::number(random.bounded(256))
+                   + ":" + QByteArray::number(1024 + random.bounded(60000));
+            break;
+        default:
+            break;
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+QList<Scenario> builtinScenarios(const Options &options)
+{
+    QList<Scenario> scenarios;
+    scenarios << Scenario{QStringLiteral("ascii"), QStringLiteral("dense printable ASCII"), denseAscii()}
+              << Scenario{QStringLiteral("sgr"), QStringLiteral("heavy SGR colour and attributes"), heavySgr()}
+              << Scenario{QStringLiteral("cjk"), QStringLiteral("CJK, Hangul, emoji and combining marks"), cjkAndEmoji()}
+              << Scenario{QStringLiteral("scroll-region"), QStringLiteral("scroll region churn (vim/tmux)"),
+                          scrollRegionChurn(options.lines, options.columns)}
+              << Scenario{QStringLiteral("long-lines"), QStringLiteral("long unwrapped lines"), longLines()}
+              << Scenario{QStringLiteral("log"), QStringLiteral("log lines with URLs and email addresses"), logLines()};
+    return scenarios;
+}
+
+HistoryType *createHistoryType(const Options &options)
+{
+    if (options.history == QLatin1String("none")) {
+        return new HistoryTypeNone();
+    }
+    if (options.history == QLatin1String("file")) {
+        return new HistoryTypeFile();
+    }
+    if (options.history == QLatin1String("compressed")) {
+        return new HistoryTypeCompressedFile();
+    }
+    return new CompactHistoryType(static_cast<unsigned int>(options.historyLines));
+}
+
+quint64 allocations()
+{
+#ifdef HAVE_ALLOCATION_COUNT
+    return allocationCount.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+long peakRssKiB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux
+    return usage.ru_maxrss;
+}
+
+// Bytes of heap in use, including blocks allocated with mmap
+qint64 heapInUse()
+{
+#ifdef HAVE_ALLOCATION_COUNT
+#if __GLIBC_PREREQ(2, 33)
+    const struct mallinfo2 info = mallinfo2();
+#else
+    const struct mallinfo info = mallinfo();
+#endif
+    return static_cast<qint64>(info.uordblks) + static_cast<qint64>(info.hblkhd);
+#else
+    return 0;
+#endif
+}
+
+// Feeds Options::bytes of the scenario to the emulation and returns the
+// number of bytes processed
+qint64 replay(Emulation &emulation, const Scenario &scenario, const Options &options)
+{
+    const char *data = scenario.data.constData();
+    const int size = scenario.data.size();
+
+    qint64 processed = 0;
+    int offset = 0;
+    while (processed < options.bytes) {
+        const int length = qMin(options.chunkSize, size - offset);
+        emulation.receiveData(data + offset, length, false);
+        processed += length;
+        offset += length;
+        if (offset == size) {
+            offset = 0;
+        }
+    }
+    return processed;
+}
+
+QJsonObject runScenario(const Scenario &scenario, const Options &options)
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(options.lines, options.columns);
+    QScopedPointer<HistoryType> history(createHistoryType(options));
+    emulation.setHistory(*history);
+
+    const long startRss = peakRssKiB();
+    const quint64 startAllocations = allocations();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 processed = replay(emulation, scenario, options);
+
+    const qint64 elapsed = timer.nsecsElapsed();
+    const quint64 allocationTotal = allocations() - startAllocations;
+    const double megabytes = processed / (1024.0 * 1024.0);
+
+    QJsonObject result;
+    result[QStringLiteral("scenario")] = scenario.name;
+    result[QStringLiteral("description")] = scenario.description;
+    result[QStringLiteral("bytes")] = processed;
+    result[QStringLiteral("seconds")] = elapsed / 1e9;
+    result[QStringLiteral("mbPerSecond")] = megabytes / (elapsed / 1e9);
+    result[QStringLiteral("nsPerByte")] = static_cast<double>(elapsed) / processed;
+#ifdef HAVE_ALLOCATION_COUNT
+    result[QStringLiteral("allocationsPerMB")] = allocationTotal / megabytes;
+#else
+    Q_UNUSED(allocationTotal)
+    result[QStringLiteral("allocationsPerMB")] = QJsonValue();
+#endif
+    result[QStringLiteral("startRssKiB")] = static_cast<qint64>(startRss);
+    result[QStringLiteral("peakRssKiB")] = static_cast<qint64>(peakRssKiB());
+    return result;
+}
+
+// History which keeps the last lines added to it as they are, to collect
+// the lines a scenario produces for compareHistoryFormats()
+class RecordingHistoryScroll : public HistoryScroll
+{
+public:
+    struct Line {
+        QVector<Character> cells;
+        LineProperty flags;
+    };
+
+    RecordingHistoryScroll(HistoryType *type, int maxLines)
+        : HistoryScroll(type)
+        , _maxLines(maxLines)
+    {
+    }
+
+    const std::deque<Line> &lines() const { return _lines; }
+
+    int getLines() override { return static_cast<int>(_lines.size()); }
+    int getMaxLines() override { return _maxLines; }
+    int getLineLen(int lineNumber) override { return _lines[static_cast<size_t>(lineNumber)].cells.size(); }
+    void getCells(int lineNumber, int startColumn, int count, Character buffer[]) override
+    {
+        const Character *cells = _lines[static_cast<size_t>(lineNumber)].cells.constData() + startColumn;
+        std::copy(cells, cells + count, buffer);
+    }
+    bool isWrappedLine(int lineNumber) override { return getLineProperty(lineNumber) & LINE_WRAPPED; }
+    LineProperty getLineProperty(int lineNumber) override { return _lines[static_cast<size_t>(lineNumber)].flags; }
+
+    void addCells(const Character a[], int count) override
+    {
+        Line line;
+        line.cells.resize(count);
+        std::copy(a, a + count, line.cells.begin());
+        line.flags = LINE_DEFAULT;
+        _lines.push_back(line);
+        if (getLines() > _maxLines) {
+            _lines.pop_front();
+        }
+    }
+    void addLine(LineProperty lineProperty) override { _lines.back().flags = lineProperty; }
+    void removeCells() override
+    {
+        if (!_lines.empty()) {
+            _lines.pop_back();
+        }
+    }
+
+private:
+    std::deque<Line> _lines;
+    int _maxLines;
+};
+
+class RecordingHistoryType : public HistoryType
+{
+public:
+    explicit RecordingHistoryType(int maxLines) : _maxLines(maxLines), _scroll(nullptr) {}
+
+    bool isEnabled() const override { return true; }
+    int maximumLineCount() const override { return _maxLines; }
+    HistoryScroll *scroll(HistoryScroll *old) const override
+    {
+        delete old;
+        _scroll = new RecordingHistoryScroll(new RecordingHistoryType(_maxLines), _maxLines);
+        return _scroll;
+    }
+
+    // owned by the screen
+    RecordingHistoryScroll *recordedScroll() const { return _scroll; }
+
+private:
+    int _maxLines;
+    mutable RecordingHistoryScroll *_scroll;
+};
+
+// The history format before the compact encoding: every cell is a
+// Character, stored in blocks of 4096 cells, with the end offset of each line
+class CharacterHistory
+{
+public:
+    void addLine(const Character *cells, int count)
+    {
+        while (count > 0) {
+            if (_cellCount % BlockCells == 0) {
+                _blocks.push_back(std::unique_ptr<Character[]>(new Character[BlockCells]));
+            }
+            const int position = static_cast<int>(_cellCount % BlockCells);
+            const int length = qMin(count, BlockCells - position);
+            std::copy(cells, cells + length, _blocks.back().get() + position);
+            cells += length;
+            count -= length;
+            _cellCount += length;
+        }
+        _index.push_back(_cellCount);
+    }
+
+    int getLineLen(int lineNumber) const
+    {
+        return static_cast<int>(_index[static_cast<size_t>(lineNumber)] - startOfLine(lineNumber));
+    }
+
+    void getCells(int lineNumber, int startColumn, int count, Character buffer[]) const
+    {
+        qint64 offset = startOfLine(lineNumber) + startColumn;
+        while (count > 0) {
+            const Character *block = _blocks[static_cast<size_t>(offset / BlockCells)].get();
+            const int position = static_cast<int>(offset % BlockCells);
+            const int length = qMin(count, BlockCells - position);
+            std::copy(block + position, block + position + length, buffer);
+            buffer += length;
+            count -= length;
+            offset += length;
+        }
+    }
+
+private:
+    qint64 startOfLine(int lineNumber) const
+    {
+        return lineNumber == 0 ? 0 : _index[static_cast<size_t>(lineNumber - 1)];
+    }
+
+    static const int BlockCells = 4096;
+    std::deque<std::unique_ptr<Character[]>> _blocks;
+    std::deque<qint64> _index;
+    qint64 _cellCount = 0;
+};
+
+// Average nanoseconds to read a whole line with getCells()
+template<typename History>
+double getCellsNsPerLine(History &history, int lineCount)
+{
+    if (lineCount == 0) {
+        return 0;
+    }
+
+    QVector<Character> buffer;
+    QElapsedTimer timer;
+    timer.start();
+    qint64 reads = 0;
+    // at least ten passes and a tenth of a second, like scrolling through
+    // the history over and over
+    for (int pass = 0; pass < 10 || timer.nsecsElapsed() < 100000000; pass++) {
+        for (int line = 0; line < lineCount; line++) {
+            const int length = history.getLineLen(line);
+            if (buffer.size() < length) {
+                buffer.resize(length);
+            }
+            history.getCells(line, 0, length, buffer.data());
+        }
+        reads += lineCount;
+    }
+    return reads > 0 ? static_cast<double>(timer.nsecsElapsed()) / reads : 0;
+}
+
+// Replays the scenario into a history which records the lines as they are,
+// then stores the same lines as Character cells and in CompactHistoryScroll,
+// and compares their heap use and getCells() latency
+QJsonObject compareHistoryFormats(const Scenario &scenario, const Options &options)
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(options.lines, options.columns);
+    RecordingHistoryType recordingType(options.historyLines);
+    emulation.setHistory(recordingType);
+    replay(emulation, scenario, options);
+
+    const std::deque<RecordingHistoryScroll::Line> &lines = recordingType.recordedScroll()->lines();
+    const int lineCount = static_cast<int>(lines.size());
+    qint64 cellCount = 0;
+    for (const RecordingHistoryScroll::Line &line : lines) {
+        cellCount += line.cells.size();
+    }
+
+    qint64 heap = heapInUse();
+    QScopedPointer<CharacterHistory> characterHistory(new CharacterHistory);
+    for (const RecordingHistoryScroll::Line &line : lines) {
+        characterHistory->addLine(line.cells.constData(), line.cells.size());
+    }
+    const qint64 characterBytes = heapInUse() - heap;
+
+    heap = heapInUse();
+    QScopedPointer<CompactHistoryScroll> compactHistory(new CompactHistoryScroll(static_cast<unsigned int>(options.historyLines)));
+    for (const RecordingHistoryScroll::Line &line : lines) {
+        compactHistory->addCells(line.cells.constData(), line.cells.size());
+        compactHistory->addLine(line.flags);
+    }
+    const qint64 compactBytes = heapInUse() - heap;
+
+    QJsonObject result;
+    result[QStringLiteral("scenario")] = scenario.name;
+    result[QStringLiteral("description")] = scenario.description;
+    result[QStringLiteral("historyLines")] = lineCount;
+    result[QStringLiteral("cells")] = cellCount;
+#ifdef HAVE_ALLOCATION_COUNT
+    result[QStringLiteral("characterBytes")] = characterBytes;
+    result[QStringLiteral("compactBytes")] = compactBytes;
+    result[QStringLiteral("memoryRatio")] = compactBytes > 0 ? static_cast<double>(characterBytes) / compactBytes : 0;
+#else
+    Q_UNUSED(characterBytes)
+    Q_UNUSED(compactBytes)
+    result[QStringLiteral("characterBytes")] = QJsonValue();
+    result[QStringLiteral("compactBytes")] = QJsonValue();
+    result[QStringLiteral("memoryRatio")] = QJsonValue();
+#endif
+    result[QStringLiteral("characterGetCellsNsPerLine")] = getCellsNsPerLine(*characterHistory, lineCount);
+    result[QStringLiteral("compactGetCellsNsPerLine")] = getCellsNsPerLine(*compactHistory, lineCount);
+    return result;
+}
+
+// The text of a screen as TerminalImageFilterChain passes it to the filters
+struct FilterScreen {
+    QString text;
+    QList<int> linePositions;
+};
+
+// Average nanoseconds for the filter to find the hotspots of a screen, and
+// the number of hotspots found in all screens
+double filterNsPerScreen(Filter &filter, const QList<FilterScreen> &screens, int &hotSpotCount)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qint64 screenCount = 0;
+    // at least ten passes and a tenth of a second, like the frames of a
+    // terminal which keeps printing
+    for (int pass = 0; pass < 10 || timer.nsecsElapsed() < 100000000; pass++) {
+        hotSpotCount = 0;
+        for (const FilterScreen &screen : screens) {
+            filter.reset();
+            filter.setBuffer(&screen.text, &screen.linePositions);
+            filter.process();
+            hotSpotCount += filter.hotSpots().size();
+        }
+        screenCount += screens.size();
+    }
+    filter.reset();
+    return screenCount > 0 ? static_cast<double>(timer.nsecsElapsed()) / screenCount : 0;
+}
+
+// Replays the scenario and takes the text of the screen after every chunk,
+// then finds the URLs in these screens with UrlFilter, and with its QRegExp
+// over the whole text like RegExpFilter does
+QJsonObject compareUrlFilters(const Scenario &scenario, const Options &options)
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(options.lines, options.columns);
+
+    const int maxScreens = 256;
+    QList<FilterScreen> screens;
+    const char *data = scenario.data.constData();
+    const int size = scenario.data.size();
+    qint64 processed = 0;
+    int offset = 0;
+    while (processed < options.bytes && screens.size() < maxScreens) {
+        const int length = qMin(options.chunkSize, size - offset);
+        emulation.receiveData(data + offset, length, false);
+        processed += length;
+        offset += length;
+        if (offset == size) {
+            offset = 0;
+        }
+
+        FilterScreen screen;
+        QTextStream stream(&screen.text);
+        PlainTextDecoder decoder;
+        decoder.setRecordLinePositions(true);
+        decoder.begin(&stream);
+        emulation.writeToStream(&decoder, 0, emulation.lineCount() - 1);
+        decoder.end();
+        stream.flush();
+        screen.linePositions = decoder.linePositions();
+        screens << screen;
+    }
+
+    UrlFilter urlFilter;
+    RegExpFilter regExpFilter;
+    regExpFilter.setRegExp(urlFilter.regExp());
+
+    int regExpHotSpots = 0;
+    int urlFilterHotSpots = 0;
+    const double regExpNs = filterNsPerScreen(regExpFilter, screens, regExpHotSpots);
+    const double urlFilterNs = filterNsPerScreen(urlFilter, screens, urlFilterHotSpots);
+
+    QJsonObject result;
+    result[QStringLiteral("scenario")] = scenario.name;
+    result[QStringLiteral("description")] = scenario.description;
+    result[QStringLiteral("screens")] = screens.size();
+    result[QStringLiteral("regExpNsPerScreen")] = regExpNs;
+    result[QStringLiteral("urlFilterNsPerScreen")] = urlFilterNs;
+    result[QStringLiteral("speedup")] = urlFilterNs > 0 ? regExpNs / urlFilterNs : 0;
+    // the same number unless the engines disagree on a match
+    result[QStringLiteral("regExpHotSpots")] = regExpHotSpots;
+    result[QStringLiteral("urlFilterHotSpots")] = urlFilterHotSpots;
+    return result;
+}
+
+typedef QJsonObject (*ScenarioFunction)(const Scenario &scenario, const Options &options);
+
+// Runs the scenario in a child process and returns its result
+QJsonObject runScenarioIsolated(ScenarioFunction function, const Scenario &scenario, const Options &options)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("terminal-bench: pipe");
+        return QJsonObject();
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("terminal-bench: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return QJsonObject();
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        const QByteArray json = QJsonDocument(function(scenario, options)).toJson(QJsonDocument::Compact);
+        qint64 written = 0;
+        while (written < json.size()) {
+            const ssize_t count = write(fds[1], json.constData() + written, static_cast<size_t>(json.size() - written));
+            if (count <= 0) {
+                _exit(1);
+            }
+            written += count;
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    QByteArray json;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        json.append(buffer, static_cast<int>(count));
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "terminal-bench: scenario %s failed\n", qPrintable(scenario.name));
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(json).object();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("terminal-bench"));
+
+    Options options;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays terminal output through the emulation without a display "
+                                                    "and reports throughput, allocations and peak RSS as JSON."));
+    parser.addHelpOption();
+    QCommandLineOption scenarioOption(QStringList() << "s" << "scenario",
+                                      QStringLiteral("Built-in scenario to run: ascii, sgr, cjk, scroll-region, "
+                                                     "long-lines or log. May be repeated, default all."),
+                                      QStringLiteral("name"));
+    QCommandLineOption replayOption(QStringList() << "r" << "replay",
+                                    QStringLiteral("Replay a recorded byte stream. May be repeated."),
+                                    QStringLiteral("file"));
+    QCommandLineOption megabytesOption(QStringList() << "m" << "megabytes",
+                                       QStringLiteral("Megabytes processed per scenario, default 32."),
+                                       QStringLiteral("count"), QStringLiteral("32"));
+    QCommandLineOption chunkOption(QStringLiteral("chunk-size"),
+                                   QStringLiteral("Bytes passed to receiveData() at once, default 4096."),
+                                   QStringLiteral("bytes"), QString::number(options.chunkSize));
+    QCommandLineOption columnsOption(QStringLiteral("columns"), QStringLiteral("Screen columns, default 120."),
+                                     QStringLiteral("count"), QString::number(options.columns));
+    QCommandLineOption linesOption(QStringLiteral("lines"), QStringLiteral("Screen lines, default 40."),
+                                   QStringLiteral("count"), QString::number(options.lines));
+    QCommandLineOption historyOption(QStringLiteral("history"),
+                                     QStringLiteral("History type: none, compact, file or compressed, default compact."),
+                                     QStringLiteral("type"), options.history);
+    QCommandLineOption historyLinesOption(QStringLiteral("history-lines"),
+                                          QStringLiteral("Lines of compact history, default 5000."),
+                                          QStringLiteral("count"), QString::number(options.historyLines));
+    QCommandLineOption historyFormatsOption(QStringLiteral("history-formats"),
+                                            QStringLiteral("Instead of throughput, compare the heap use and getCells() "
+                                                           "latency of the compact history line format with Character "
+                                                           "cells, for the history lines of each scenario."));
+    QCommandLineOption urlFilterOption(QStringLiteral("url-filter"),
+                                       QStringLiteral("Instead of throughput, compare the time UrlFilter takes to find "
+                                                      "the URLs of a screen with its QRegExp over the whole text, for "
+                                                      "up to 256 screens of each scenario."));
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    QStringLiteral("Write the JSON report to a file instead of stdout."),
+                                    QStringLiteral("file"));
+    parser.addOptions(QList<QCommandLineOption>() << scenarioOption << replayOption << megabytesOption
+                      << chunkOption << columnsOption << linesOption << historyOption
+                      << historyLinesOption << historyFormatsOption << urlFilterOption << outputOption);
+    parser.process(app);
+
+    options.bytes = parser.value(megabytesOption).toLongLong() * 1024 * 1024;
+    options.chunkSize = parser.value(chunkOption).toInt();
+    options.columns = parser.value(columnsOption).toInt();
+    options.lines = parser.value(linesOption).toInt();
+    options.history = parser.value(historyOption);
+    options.historyLines = parser.value(historyLinesOption).toInt();
+    options.historyFormats = parser.isSet(historyFormatsOption);
+    options.urlFilter = parser.isSet(urlFilterOption);
+    if (options.bytes <= 0 || options.chunkSize <= 0 || options.columns <= 0 || options.lines <= 1
+        || options.historyLines <= 0) {
+        fprintf(stderr, "terminal-bench: invalid size option\n");
+        return 1;
+    }
+
+    QList<Scenario> scenarios;
+    const QStringList selected = parser.values(scenarioOption);
+    for (const Scenario &scenario : builtinScenarios(options)) {
+        if ((selected.isEmpty() && !parser.isSet(replayOption)) || selected.contains(scenario.name)) {
+            scenarios << scenario;
+        }
+    }
+    for (const QString &path : parser.values(replayOption)) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+            fprintf(stderr, "terminal-bench: cannot read %s\n", qPrintable(path));
+            return 1;
+        }
+        scenarios << Scenario{QFileInfo(path).fileName(), QStringLiteral("replay of ") + path, file.readAll()};
+    }
+    if (scenarios.isEmpty()) {
+        fprintf(stderr, "terminal-bench: no such scenario\n");
+        return 1;
+    }
+
+    ScenarioFunction function = runScenario;
+    QString mode = QStringLiteral("throughput");
+    if (options.historyFormats) {
+        function = compareHistoryFormats;
+        mode = QStringLiteral("history-formats");
+    } else if (options.urlFilter) {
+        function = compareUrlFilters;
+        mode = QStringLiteral("url-filter");
+    }
+
+    QJsonArray results;
+    if (options.historyFormats) {
+        fprintf(stderr, "%-16s %10s %14s %14s %8s %12s %12s\n", "scenario", "lines", "Character B",
+                "compact B", "ratio", "Char ns/ln", "compact ns/ln");
+    } else if (options.urlFilter) {
+        fprintf(stderr, "%-16s %8s %14s %14s %8s %10s\n", "scenario", "screens", "QRegExp ns", "UrlFilter ns",
+                "speedup", "hotspots");
+    } else {
+        fprintf(stderr, "%-16s %10s %10s %14s %12s\n", "scenario", "MB/s", "ns/byte", "allocs/MB", "peak RSS KiB");
+    }
+    for (const Scenario &scenario : scenarios) {
+        const QJsonObject result = runScenarioIsolated(function, scenario, options);
+        if (result.isEmpty()) {
+            return 1;
+        }
+        if (options.historyFormats) {
+            fprintf(stderr, "%-16s %10d %14lld %14lld %8.2f %12.1f %12.1f\n", qPrintable(scenario.name),
+                    result.value(QStringLiteral("historyLines")).toInt(),
+                    static_cast<long long>(result.value(QStringLiteral("characterBytes")).toDouble()),
+                    static_cast<long long>(result.value(QStringLiteral("compactBytes")).toDouble()),
+                    result.value(QStringLiteral("memoryRatio")).toDouble(),
+                    result.value(QStringLiteral("characterGetCellsNsPerLine")).toDouble(),
+                    result.value(QStringLiteral("compactGetCellsNsPerLine")).toDouble());
+        } else if (options.urlFilter) {
+            fprintf(stderr, "%-16s %8d %14.1f %14.1f %8.2f %10d\n", qPrintable(scenario.name),
+                    result.value(QStringLiteral("screens")).toInt(),
+                    result.value(QStringLiteral("regExpNsPerScreen")).toDouble(),
+                    result.value(QStringLiteral("urlFilterNsPerScreen")).toDouble(),
+                    result.value(QStringLiteral("speedup")).toDouble(),
+                    result.value(QStringLiteral("urlFilterHotSpots")).toInt());
+        } else {
+            fprintf(stderr, "%-16s %10.2f %10.2f %14.1f %12lld\n", qPrintable(scenario.name),
+                    result.value(QStringLiteral("mbPerSecond")).toDouble(),
+                    result.value(QStringLiteral("nsPerByte")).toDouble(),
+                    result.value(QStringLiteral("allocationsPerMB")).toDouble(),
+                    static_cast<long long>(result.value(QStringLiteral("peakRssKiB")).toDouble()));
+        }
+        results.append(result);
+    }
+
+    QJsonObject report;
+    report[QStringLiteral("benchmark")] = QStringLiteral("terminal-bench");
+    report[QStringLiteral("version")] = QStringLiteral(TERMINALWIDGET_VERSION);
+    report[QStringLiteral("qtVersion")] = QString::fromLatin1(qVersion());
+    report[QStringLiteral("columns")] = options.columns;
+    report[QStringLiteral("lines")] = options.lines;
+    report[QStringLiteral("history")] = options.history;
+    report[QStringLiteral("historyLines")] = options.historyLines;
+    report[QStringLiteral("chunkSize")] = options.chunkSize;
+    report[QStringLiteral("mode")] = mode;
+    report[QStringLiteral("results")] = results;
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            fprintf(stderr, "terminal-bench: cannot write %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    }
+    return 0;
+}
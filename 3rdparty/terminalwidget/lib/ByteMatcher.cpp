@@ -0,0 +1,133 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "ByteMatcher.h"
+
+// System
+#include <algorithm>
+
+// Qt
+#include <QQueue>
+
+using namespace Konsole;
+
+static inline uchar foldCase(uchar c)
+{
+    return (c >= 'A' && c <= 'Z') ? uchar(c - 'A' + 'a') : c;
+}
+
+ByteMatcher::ByteMatcher(Qt::CaseSensitivity caseSensitivity)
+    : _caseSensitivity(caseSensitivity)
+    , _compiled(false)
+{
+}
+
+int ByteMatcher::addPattern(const QByteArray &pattern)
+{
+    Q_ASSERT(!_compiled);
+    Q_ASSERT(!pattern.isEmpty());
+
+    _patterns.append(pattern);
+    return _patterns.count() - 1;
+}
+
+int ByteMatcher::patternCount() const
+{
+    return _patterns.count();
+}
+
+int ByteMatcher::patternLength(int pattern) const
+{
+    return _patterns.at(pattern).size();
+}
+
+bool ByteMatcher::isCompiled() const
+{
+    return _compiled;
+}
+
+void ByteMatcher::compile()
+{
+    Q_ASSERT(!_compiled);
+
+    // build the trie of all patterns, -1 marks a missing edge
+    QVector<int> next(256, -1);
+    QVector<QVector<int>> matches(1);
+    int stateCount = 1;
+
+    for (int id = 0; id < _patterns.count(); id++) {
+        const QByteArray &pattern = _patterns.at(id);
+        int state = 0;
+        for (int i = 0; i < pattern.size(); i++) {
+            uchar c = static_cast<uchar>(pattern.at(i));
+            if (_caseSensitivity == Qt::CaseInsensitive) {
+                c = foldCase(c);
+            }
+
+            const int edge = (state << 8) | c;
+            if (next[edge] == -1) {
+                next[edge] = stateCount++;
+                next.resize(stateCount << 8);
+                std::fill(next.begin() + ((stateCount - 1) << 8), next.end(), -1);
+                matches.resize(stateCount);
+            }
+            state = next[edge];
+        }
+        matches[state].append(id);
+    }
+
+    // turn the trie into a complete transition table, breadth first so that
+    // the failure state of every state is finished before its children
+    QVector<int> failure(stateCount, 0);
+    QQueue<int> queue;
+
+    for (int c = 0; c < 256; c++) {
+        const int child = next[c];
+        if (child == -1) {
+            next[c] = 0;
+        } else {
+            failure[child] = 0;
+            queue.enqueue(child);
+        }
+    }
+
+    while (!queue.isEmpty()) {
+        const int state = queue.dequeue();
+        for (int c = 0; c < 256; c++) {
+            const int edge = (state << 8) | c;
+            const int child = next[edge];
+            const int fallback = next[(failure[state] << 8) | c];
+            if (child == -1) {
+                next[edge] = fallback;
+            } else {
+                failure[child] = fallback;
+                matches[child] += matches[fallback];
+                queue.enqueue(child);
+            }
+        }
+    }
+
+    if (_caseSensitivity == Qt::CaseInsensitive) {
+        for (int state = 0; state < stateCount; state++) {
+            for (int c = 'A'; c <= 'Z'; c++) {
+                next[(state << 8) | c] = next[(state << 8) | foldCase(uchar(c))];
+            }
+        }
+    }
+
+    _transitions = next;
+
+    _outputStart.resize(stateCount + 1);
+    _outputs.clear();
+    for (int state = 0; state < stateCount; state++) {
+        _outputStart[state] = _outputs.count();
+        _outputs += matches[state];
+    }
+    _outputStart[stateCount] = _outputs.count();
+
+    _compiled = true;
+}
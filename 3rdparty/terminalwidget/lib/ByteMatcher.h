@@ -0,0 +1,114 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef BYTEMATCHER_H
+#define BYTEMATCHER_H
+
+// Qt
+#include <QByteArray>
+#include <QVector>
+
+namespace Konsole
+{
+
+/**
+ * Finds any number of fixed byte patterns in a stream of raw terminal
+ * output in a single pass (Aho-Corasick automaton).
+ *
+ * Patterns are added with addPattern() and the automaton is built once by
+ * compile().  The compiled matcher is immutable and can be shared; the
+ * position within the stream is kept in an int state owned by the caller,
+ * so matches spanning two blocks of output are still found.
+ *
+ * Example:
+ * @code
+ * ByteMatcher matcher;
+ * const int password = matcher.addPattern("password:");
+ * matcher.compile();
+ *
+ * int state = 0;
+ * matcher.scan(state, data, length, [&](int pattern, int end) {
+ *     // end is the offset just past the match within 'data'
+ * });
+ * @endcode
+ */
+class ByteMatcher
+{
+public:
+    /**
+     * Constructs an empty matcher.  With Qt::CaseInsensitive ASCII letters in
+     * the patterns match either case.
+     */
+    explicit ByteMatcher(Qt::CaseSensitivity caseSensitivity = Qt::CaseSensitive);
+
+    /**
+     * Adds @p pattern and returns its id, which is passed to the callback
+     * of scan().  Ids are assigned in order starting from 0.
+     * Must not be called after compile().
+     */
+    int addPattern(const QByteArray &pattern);
+
+    /** Returns the number of patterns added with addPattern(). */
+    int patternCount() const;
+
+    /** Returns the length in bytes of the pattern with id @p pattern */
+    int patternLength(int pattern) const;
+
+    /** Builds the automaton.  Must be called once before scan(). */
+    void compile();
+
+    /** Returns true if compile() has been called. */
+    bool isCompiled() const;
+
+    /**
+     * Scans @p length bytes from @p data and calls @p onMatch(pattern, end)
+     * for every occurrence of a pattern, where @p end is the offset just
+     * past the last byte of the match within @p data.  A match which started
+     * in a previous block has end - patternLength(pattern) < 0.
+     *
+     * @param state The automaton state, 0 at the start of a stream.  It is
+     * updated so that the next block can continue where this one stopped.
+     */
+    template <typename Callback>
+    void scan(int &state, const char *data, int length, Callback onMatch) const;
+
+private:
+    Qt::CaseSensitivity _caseSensitivity;
+    QVector<QByteArray> _patterns;
+    bool _compiled;
+
+    // _transitions[(state << 8) | byte] is the next state
+    QVector<int> _transitions;
+    // the patterns ending in state s are _outputs[_outputStart[s]] up to
+    // (but excluding) _outputs[_outputStart[s + 1]]
+    QVector<int> _outputStart;
+    QVector<int> _outputs;
+};
+
+template <typename Callback>
+inline void ByteMatcher::scan(int &state, const char *data, int length, Callback onMatch) const
+{
+    Q_ASSERT(_compiled);
+
+    const int *transitions = _transitions.constData();
+    const int *outputStart = _outputStart.constData();
+    int current = state;
+
+    for (int i = 0; i < length; i++) {
+        current = transitions[(current << 8) | static_cast<uchar>(data[i])];
+        if (Q_UNLIKELY(outputStart[current] != outputStart[current + 1])) {
+            for (int k = outputStart[current]; k < outputStart[current + 1]; k++) {
+                onMatch(_outputs[k], i + 1);
+            }
+        }
+    }
+
+    state = current;
+}
+
+}
+
+#endif // BYTEMATCHER_H
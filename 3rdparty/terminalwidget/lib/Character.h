@@ -94,19 +94,12 @@ public:
             quint8  _r = DEFAULT_RENDITION)
        : character(_c), rendition(_r), foregroundColor(_f), backgroundColor(_b) {}
 
-    union
-    {
-        /** The unicode character value for this character. */
-        uint character;
-        /**
-         * Experimental addition which allows a single Character instance to contain more than
-         * one unicode character.
-         *
-         * charSequence is a hash code which can be used to look up the unicode
-         * character sequence in the ExtendedCharTable used to create the sequence.
-         */
-        quint16 charSequence;
-    };
+    /**
+     * The unicode character value for this character.  A character with the
+     * RE_EXTENDED_CHAR rendition is a sequence of unicode characters, this is
+     * the id of the sequence in the ExtendedCharTable of its Screen.
+     */
+    uint character;
 
     /** A combination of RENDITION flags which specify options for drawing the character. */
     quint8  rendition;
@@ -226,54 +219,98 @@ extern unsigned short vt100_graphics[32];
 
 
 /**
- * A table which stores sequences of unicode characters, referenced
- * by hash keys.  The hash key itself is the same size as a unicode
- * character ( ushort ) so that it can occupy the same space in
- * a structure.
+ * A table which stores sequences of unicode characters, such as a character
+ * and its combining marks, which are shown in one cell.  A cell with such a
+ * sequence has the RE_EXTENDED_CHAR rendition and the id of the sequence as
+ * its character.
+ *
+ * Every Screen has its own table.  The id of a sequence is its index in the
+ * table, so it is looked up without searching.  The lines in the history
+ * hold a reference to each of their sequences, the sequences without one
+ * are freed by collect() unless the screen shows them, and their ids are
+ * used again.
  */
 class ExtendedCharTable
 {
 public:
     /** Constructs a new character table. */
     ExtendedCharTable();
-    ~ExtendedCharTable();
 
     /**
-     * Adds a sequences of unicode characters to the table and returns
-     * a hash code which can be used later to look up the sequence
-     * using lookupExtendedChar()
+     * Adds a sequence of unicode characters to the table and returns its id,
+     * which can be used later to look up the sequence using
+     * lookupExtendedChar().
      *
-     * If the same sequence already exists in the table, the hash
-     * of the existing sequence will be returned.
+     * If the same sequence already exists in the table, the id of the
+     * existing sequence will be returned.
      *
      * @param unicodePoints An array of unicode character points
      * @param length Length of @p unicodePoints
      */
-    uint createExtendedChar(uint* unicodePoints , ushort length);
+    uint createExtendedChar(const uint* unicodePoints , ushort length);
     /**
      * Looks up and returns a pointer to a sequence of unicode characters
      * which was added to the table using createExtendedChar().
      *
-     * @param hash The hash key returned by createExtendedChar()
+     * @param id The id returned by createExtendedChar()
      * @param length This variable is set to the length of the
      * character sequence.
      *
-     * @return A unicode character sequence of size @p length.
+     * @return A unicode character sequence of size @p length, or nullptr
+     * if the sequence was freed.
+     */
+    inline const uint* lookupExtendedChar(uint id , ushort& length) const
+    {
+        if (id == 0 || id > static_cast<uint>(_entries.size()) || _entries[id - 1].offset < 0) {
+            length = 0;
+            return nullptr;
+        }
+        const Entry &entry = _entries[id - 1];
+        length = entry.length;
+        return _characters.constData() + entry.offset;
+    }
+
+    /** Adds a reference of a line of the history to the sequence @p id. */
+    void ref(uint id);
+    /** Removes a reference added by ref(). */
+    void deref(uint id);
+
+    /**
+     * Returns true if as many sequences were added since the last collect()
+     * as there were left, so collect() is worth the time.
+     */
+    bool needsCollect() const;
+    /**
+     * Frees the sequences which have no references, unless @p used is true
+     * at their id, and leaves their ids to new sequences.
      */
-    uint* lookupExtendedChar(uint hash , ushort& length) const;
+    void collect(const QVector<bool> &used);
+
+    /** Returns the largest id of a sequence. */
+    uint maxId() const;
 
-    /** The global ExtendedCharTable instance. */
-    static ExtendedCharTable instance;
 private:
+    struct Entry {
+        int offset;         // of the sequence in _characters, -1 if free
+        ushort length;
+        uint references;
+    };
+
     // calculates the hash key of a sequence of unicode points of size 'length'
-    uint extendedCharHash(uint* unicodePoints , ushort length) const;
-    // tests whether the entry in the table specified by 'hash' matches the
-    // character sequence 'unicodePoints' of size 'length'
-    bool extendedCharMatch(uint hash , uint* unicodePoints , ushort length) const;
-    // internal, maps hash keys to character sequence buffers.  The first ushort
-    // in each value is the length of the buffer, followed by the ushorts in the buffer
-    // themselves.
-    QHash<uint,uint*> extendedCharTable;
+    uint extendedCharHash(const uint* unicodePoints , ushort length) const;
+    // tests whether the sequence 'id' matches the character sequence
+    // 'unicodePoints' of size 'length'
+    bool extendedCharMatch(uint id , const uint* unicodePoints , ushort length) const;
+
+    // the sequences by id - 1, and their characters one after another
+    QVector<Entry> _entries;
+    QVector<uint> _characters;
+    // ids of the sequences by their hash key
+    QMultiHash<uint, uint> _ids;
+    QVector<uint> _freeIds;
+    // sequences added since the last collect() and those left by it
+    int _added;
+    int _collected;
 };
 
 }
@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <string>
+#include <algorithm>
 
 // Qt
 #include <QApplication>
@@ -44,6 +45,7 @@
 //#include <kdebug.h>
 
 // Konsole
+#include "HistoryBudget.h"
 #include "KeyboardTranslator.h"
 #include "Screen.h"
 #include "TerminalCharacterDecoder.h"
@@ -51,6 +53,8 @@
 #include "Session.h"
 #include "SessionManager.h"
 #include "TerminalDisplay.h"
+#include "history/HistoryTypeCompressedFile.h"
+#include "history/compact/CompactHistoryType.h"
 
 using namespace Konsole;
 
@@ -61,7 +65,8 @@ Emulation::Emulation() :
     _keyTranslator(nullptr),
     _usesMouse(false),
     _alternateScrolling(true),
-    _bracketedPasteMode(false)
+    _bracketedPasteMode(false),
+    _spilledHistoryLines(0)
 {
     // create screens with a default size
     _screen[0] = new Screen(40, 80);
@@ -71,6 +76,13 @@ Emulation::Emulation() :
     QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()));
     QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()));
 
+    // the history is reflowed in steps between other events after a resize
+    _reflowTimer.setSingleShot(true);
+    _reflowTimer.setInterval(0);
+    QObject::connect(&_reflowTimer, SIGNAL(timeout()), this, SLOT(continueReflow()));
+
+    HistoryBudget::instance()->addEmulation(this);
+
     // listen for mouse status changes
     connect(this, SIGNAL(programUsesMouseChanged(bool)),
             SLOT(usesMouseChanged(bool)));
@@ -120,6 +132,8 @@ ScreenWindow *Emulation::createWindow()
 
     connect(window, SIGNAL(selectionChanged()),
             this, SLOT(bufferedUpdate()));
+    connect(window, SIGNAL(scrolled(int)),
+            this, SLOT(touchHistory()));
 
     connect(this, SIGNAL(outputChanged()),
             window, SLOT(notifyOutputChanged()));
@@ -133,6 +147,11 @@ void Emulation::checkScreenInUse()
 
 Emulation::~Emulation()
 {
+    // the budget may be destroyed first at exit
+    if (HistoryBudget *budget = HistoryBudget::instance()) {
+        budget->removeEmulation(this);
+    }
+
     QListIterator<ScreenWindow *> windowIter(_windows);
 
     while (windowIter.hasNext()) {
@@ -167,9 +186,11 @@ void Emulation::clearHistory()
 }
 void Emulation::setHistory(const HistoryType &t)
 {
+    _spilledHistoryLines = 0;
     _screen[0]->setScroll(t);
 
     showBulk();
+    _reflowTimer.start();
 }
 
 const HistoryType &Emulation::history() const
@@ -177,6 +198,35 @@ const HistoryType &Emulation::history() const
     return _screen[0]->getScroll();
 }
 
+qint64 Emulation::historyMemoryUsage() const
+{
+    return _screen[0]->historyMemoryUsage();
+}
+
+bool Emulation::spillHistory()
+{
+    // only histories of a limited number of lines are kept in memory
+    const int lines = history().maximumLineCount();
+    if (_spilledHistoryLines > 0 || lines <= 0) {
+        return false;
+    }
+
+    // the lines written until it is moved back are limited on disk as well
+    setHistory(HistoryTypeCompressedFile(lines));
+    _spilledHistoryLines = lines;
+    return true;
+}
+
+void Emulation::touchHistory()
+{
+    HistoryBudget::instance()->touch(this);
+
+    // lines written while the history was on disk are limited again here
+    if (_spilledHistoryLines > 0) {
+        setHistory(CompactHistoryType(_spilledHistoryLines));
+    }
+}
+
 void Emulation::setCodec(const QTextCodec *qtc)
 {
     if (qtc)
@@ -186,6 +236,8 @@ void Emulation::setCodec(const QTextCodec *qtc)
 
     delete _decoder;
     _decoder = _codec->makeDecoder();
+    _utf8Decoder.reset();
+    _gbTranscoder.setCodec(_codec);
 
     emit useUtf8Request(utf8());
 }
@@ -275,6 +327,12 @@ void Emulation::receiveChar(wchar_t c)
     };
 }
 
+void Emulation::receiveChars(const uint *chars, int count)
+{
+    for (int i = 0; i < count; i++)
+        receiveChar(chars[i]);
+}
+
 void Emulation::sendKeyEvent(QKeyEvent *ev)
 {
     emit stateSet(NOTIFYNORMAL);
@@ -297,6 +355,43 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
     // default implementation does nothing
 }
 
+// Returns true if the block starts with "\033]0;" and ends with five
+// backspaces, see receiveData()
+static bool startsWithTitleAndEndsWithBackspaces(const uint *chars, int count)
+{
+    static const uint titlePrefix[] = { 0x1B, ']', '0', ';' };
+    const int prefixLength = sizeof(titlePrefix) / sizeof(titlePrefix[0]);
+    const int backspaceCount = 5;
+
+    if (count < prefixLength + backspaceCount)
+        return false;
+    if (!std::equal(titlePrefix, titlePrefix + prefixLength, chars))
+        return false;
+    for (int i = count - backspaceCount; i < count; i++) {
+        if (chars[i] != '\b')
+            return false;
+    }
+    return true;
+}
+
+// Removes every run of five backspaces from 'chars' in place, the same way
+// QString::replace("\b\b\b\b\b", "") does, and returns the new length
+static int removeBackspaceRuns(uint *chars, int count)
+{
+    const int backspaceCount = 5;
+    int out = 0;
+    int i = 0;
+    while (i < count) {
+        if (i + backspaceCount <= count
+                && std::all_of(chars + i, chars + i + backspaceCount, [](uint c) { return c == '\b'; })) {
+            i += backspaceCount;
+            continue;
+        }
+        chars[out++] = chars[i++];
+    }
+    return out;
+}
+
 /*
    We are doing code conversion from locale to unicode first.
 TODO: Character composition from the old code.  See #96536
@@ -308,59 +403,42 @@ void Emulation::receiveData(const char *text, int length, bool isCommandExec)
 
     bufferedUpdate();
 
-    /* XXX: the following code involves encoding & decoding of "UTF-16
-     * surrogate pairs", which does not work with characters higher than
-     * U+10FFFF
-     * https://unicodebook.readthedocs.io/unicode_encodings.html#surrogates
-     */
-    QString utf16Text = "";
-
-    if (QString(_codec->name()).toUpper().startsWith("GB") && !isCommandExec) {
-        if (_decoder != nullptr) {
-            delete _decoder;
-        }
-        QTextCodec *textCodec = QTextCodec::codecForName("UTF-8");
-        _decoder = textCodec->makeDecoder();
-        utf16Text = _decoder->toUnicode(text, length);
-
-        QTextCodec* gbk = QTextCodec::codecForName(_codec->name());
-        QByteArray gbkarr = gbk->fromUnicode(utf16Text);
+    uint *unicodeText = nullptr;
+    int unicodeLength = 0;
+    QVector<uint> codecText;
 
-        if (_decoder != nullptr) {
-            delete _decoder;
-        }
-        textCodec = QTextCodec::codecForName(_codec->name());
-        _decoder = textCodec->makeDecoder();
-        utf16Text = _decoder->toUnicode(gbkarr);
+    if (_gbTranscoder.isEnabled() && !isCommandExec) {
+        // output of the local shell is UTF-8, show it as the GB codec would
+        if (_decodeBuffer.size() < length + 1)
+            _decodeBuffer.resize(length + 1);
+        unicodeText = _decodeBuffer.data();
+        unicodeLength = _gbTranscoder.decodeOutput(text, length, unicodeText);
+    }
+    else if (utf8()) {
+        // the decoder may emit one replacement character for a sequence
+        // left incomplete by the previous block
+        if (_decodeBuffer.size() < length + 1)
+            _decodeBuffer.resize(length + 1);
+        unicodeText = _decodeBuffer.data();
+        unicodeLength = _utf8Decoder.decode(text, length, unicodeText);
     }
     else {
-        utf16Text = _decoder->toUnicode(text, length);
+        codecText = _decoder->toUnicode(text, length).toUcs4();
+        unicodeText = codecText.data();
+        unicodeLength = codecText.size();
     }
 
     //fix bug 67102 打开超长名称的文件夹，终端界面光标位置不在最后一位
     //bash 提示符很长的情况下，会有较大概率以五个\b字符结尾，导致光标错位
-    if (utf16Text.startsWith("\u001B]0;") && utf16Text.endsWith("\b\b\b\b\b")) {
+    if (startsWithTitleAndEndsWithBackspaces(unicodeText, unicodeLength)) {
         Session *currSession = SessionManager::instance()->idToSession(_sessionId);
         if (currSession && (QStringLiteral("bash") == currSession->foregroundProcessName())) {
-            utf16Text.replace("\b\b\b\b\b", "");
+            unicodeLength = removeBackspaceRuns(unicodeText, unicodeLength);
         }
     }
 
-    std::wstring unicodeText = utf16Text.toStdWString();
-
     //send characters to terminal emulator
-    for (size_t i = 0; i < unicodeText.length(); i++)
-        receiveChar(unicodeText[i]);
-
-    //look for z-modem indicator
-    //-- someone who understands more about z-modems that I do may be able to move
-    //this check into the above for loop?
-    for (int i = 0; i < length; i++) {
-        if (text[i] == '\030') {
-            if ((length - i - 1 > 3) && (strncmp(text + i + 1, "B00", 3) == 0))
-                emit zmodemDetected();
-        }
-    }
+    receiveChars(unicodeText, unicodeLength);
 }
 
 //OLDER VERSION
@@ -419,6 +497,31 @@ void Emulation::writeToStream(TerminalCharacterDecoder *_decoder,
     _currentScreen->writeLinesToStream(_decoder, startLine, endLine);
 }
 
+QVector<QPair<int, int>> Emulation::searchCandidates(const QString &text)
+{
+    return _currentScreen->searchCandidates(text);
+}
+
+qint64 Emulation::totalDroppedLines() const
+{
+    return _currentScreen->totalDroppedLines();
+}
+
+bool Emulation::hasShellIntegration() const
+{
+    return _screen[0]->hasShellIntegration();
+}
+
+QString Emulation::shellPrompt() const
+{
+    return _screen[0]->shellPrompt();
+}
+
+QString Emulation::shellCommand() const
+{
+    return _screen[0]->shellCommand();
+}
+
 int Emulation::lineCount() const
 {
     // sum number of lines currently on _screen plus number of lines in history
@@ -480,6 +583,18 @@ void Emulation::setImageSize(int lines, int columns)
     emit imageSizeChanged(lines, columns);
 
     bufferedUpdate();
+    _reflowTimer.start();
+}
+
+void Emulation::continueReflow()
+{
+    const bool reflowing0 = _screen[0]->continueReflow();
+    const bool reflowing1 = _screen[1]->continueReflow();
+    bufferedUpdate();
+
+    if (reflowing0 || reflowing1) {
+        _reflowTimer.start();
+    }
 }
 
 QSize Emulation::imageSize() const
@@ -487,7 +602,7 @@ QSize Emulation::imageSize() const
     return {_currentScreen->getColumns(), _currentScreen->getLines()};
 }
 
-uint ExtendedCharTable::extendedCharHash(uint *unicodePoints, ushort length) const
+uint ExtendedCharTable::extendedCharHash(const uint *unicodePoints, ushort length) const
 {
     uint hash = 0;
     for (ushort i = 0 ; i < length ; i++) {
@@ -495,114 +610,122 @@ uint ExtendedCharTable::extendedCharHash(uint *unicodePoints, ushort length) con
     }
     return hash;
 }
-bool ExtendedCharTable::extendedCharMatch(uint hash, uint *unicodePoints, ushort length) const
+bool ExtendedCharTable::extendedCharMatch(uint id, const uint *unicodePoints, ushort length) const
 {
-    uint *entry = extendedCharTable[hash];
+    ushort entryLength = 0;
+    const uint *entry = lookupExtendedChar(id, entryLength);
 
-    // compare given length with stored sequence length ( given as the first ushort in the
-    // stored buffer )
-    if (entry == nullptr || entry[0] != length)
+    // compare given length with stored sequence length
+    if (entry == nullptr || entryLength != length)
         return false;
-    // if the lengths match, each character must be checked.  the stored buffer starts at
-    // entry[1]
+    // if the lengths match, each character must be checked.
     for (int i = 0 ; i < length ; i++) {
-        if (entry[i + 1] != unicodePoints[i])
+        if (entry[i] != unicodePoints[i])
             return false;
     }
     return true;
 }
 
-uint ExtendedCharTable::createExtendedChar(uint *unicodePoints, ushort length)
+uint ExtendedCharTable::createExtendedChar(const uint *unicodePoints, ushort length)
 {
-
     // look for this sequence of points in the table
-    uint hash = extendedCharHash(unicodePoints, length);
-    const uint initialHash = hash;
-    bool triedCleaningSolution = false;
-
-    // check existing entry for match
-    while (extendedCharTable.contains(hash) && hash != 0) { // 0 has a special meaning for chars so we don't use it
-        if (extendedCharMatch(hash, unicodePoints, length)) {
+    const uint hash = extendedCharHash(unicodePoints, length);
+    for (auto it = _ids.constFind(hash); it != _ids.constEnd() && it.key() == hash; ++it) {
+        if (extendedCharMatch(it.value(), unicodePoints, length)) {
             // this sequence already has an entry in the table,
-            // return its hash
-            return hash;
-        }
-        // if hash is already used by another, different sequence of unicode character
-        // points then try next hash
-        hash++;
-
-        if (hash == initialHash) {
-            if (!triedCleaningSolution) {
-                triedCleaningSolution = true;
-                // All the hashes are full, go to all Screens and try to free any
-                // This is slow but should happen very rarely
-                QSet<uint> usedExtendedChars;
-                const QList<Session *> sessionsList = SessionManager::instance()->sessions();
-                for (const Session *s : sessionsList) {
-                    const QList<TerminalDisplay *> displayList = s->views();
-                    for (const TerminalDisplay *display : displayList) {
-                        usedExtendedChars += display->screenWindow()->screen()->usedExtendedChars();
-                    }
-                }
-
-                QHash<uint, uint *>::iterator it = extendedCharTable.begin();
-                QHash<uint, uint *>::iterator itEnd = extendedCharTable.end();
-                while (it != itEnd) {
-                    if (usedExtendedChars.contains(it.key())) {
-                        ++it;
-                    } else {
-                        it = extendedCharTable.erase(it);
-                    }
-                }
-            } else {
-                qDebug() << "Using all the extended char hashes, going to miss this extended character";
-                return 0;
-            }
+            // return its id
+            return it.value();
         }
     }
 
-    // add the new sequence to the table and
-    // return that index
-    auto buffer = new uint[length + 1];
-    buffer[0] = length;
+    // add the new sequence to the table and return its id, 0 has a
+    // special meaning for chars so it is not used
+    uint id;
+    if (_freeIds.isEmpty()) {
+        _entries.append(Entry());
+        id = static_cast<uint>(_entries.size());
+    } else {
+        id = _freeIds.takeLast();
+    }
+    Entry &entry = _entries[id - 1];
+    entry.offset = _characters.size();
+    entry.length = length;
+    entry.references = 0;
     for (int i = 0; i < length; i++) {
-        buffer[i + 1] = unicodePoints[i];
+        _characters.append(unicodePoints[i]);
     }
+    _ids.insert(hash, id);
+    _added++;
 
-    extendedCharTable.insert(hash, buffer);
-
-    return hash;
+    return id;
 }
 
-uint *ExtendedCharTable::lookupExtendedChar(uint hash, ushort &length) const
+void ExtendedCharTable::ref(uint id)
 {
-    // lookup index in table and if found, set the length
-    // argument and return a pointer to the character sequence
+    if (id > 0 && id <= static_cast<uint>(_entries.size())) {
+        _entries[id - 1].references++;
+    }
+}
 
-    uint *buffer = extendedCharTable[hash];
-    if (buffer != nullptr) {
-        length = ushort(buffer[0]);
-        return buffer + 1;
+void ExtendedCharTable::deref(uint id)
+{
+    if (id > 0 && id <= static_cast<uint>(_entries.size()) && _entries[id - 1].references > 0) {
+        _entries[id - 1].references--;
     }
-    length = 0;
-    return nullptr;
 }
 
-ExtendedCharTable::ExtendedCharTable()
+bool ExtendedCharTable::needsCollect() const
 {
+    // the screen is read for every collect(), so there is one at most every
+    // few hundred sequences
+    return _added >= qMax(256, _collected);
 }
-ExtendedCharTable::~ExtendedCharTable()
+
+void ExtendedCharTable::collect(const QVector<bool> &used)
 {
-    // free all allocated character buffers
-    QHashIterator<uint, uint *> iter(extendedCharTable);
-    while (iter.hasNext()) {
-        iter.next();
-        delete[] iter.value();
+    // the sequences which are left are moved to the start of the characters
+    QVector<uint> characters;
+    _collected = 0;
+    for (int i = 0; i < _entries.size(); i++) {
+        Entry &entry = _entries[i];
+        if (entry.offset < 0) {
+            continue;
+        }
+
+        const uint id = static_cast<uint>(i + 1);
+        const uint *sequence = _characters.constData() + entry.offset;
+        if (entry.references == 0 && (static_cast<int>(id) >= used.size() || !used.at(static_cast<int>(id)))) {
+            _ids.remove(extendedCharHash(sequence, entry.length), id);
+            entry.offset = -1;
+            _freeIds.append(id);
+            continue;
+        }
+
+        const int offset = characters.size();
+        for (int c = 0; c < entry.length; c++) {
+            characters.append(sequence[c]);
+        }
+        entry.offset = offset;
+        _collected++;
     }
+    _characters = characters;
+    _added = 0;
 }
 
-// global instance
-ExtendedCharTable ExtendedCharTable::instance;
+uint ExtendedCharTable::maxId() const
+{
+    return static_cast<uint>(_entries.size());
+}
+
+ExtendedCharTable::ExtendedCharTable() :
+    _entries(),
+    _characters(),
+    _ids(),
+    _freeIds(),
+    _added(0),
+    _collected(0)
+{
+}
 
 
 //#include "Emulation.moc"
@@ -28,12 +28,16 @@
 
 // Qt
 #include <QKeyEvent>
+#include <QPair>
 //#include <QPointer>
 #include <QTextCodec>
 #include <QTextStream>
 #include <QTimer>
+#include <QVector>
 
 #include "qtermwidget_export.h"
+#include "GbTranscoder.h"
+#include "Utf8Decoder.h"
 
 namespace Konsole {
 
@@ -179,6 +183,15 @@ public:
     /** Clears the history scroll. */
     void clearHistory();
 
+    /** Returns the bytes of memory used by the history. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Moves a history which is kept in memory to a compressed file on disk,
+     * until the history is viewed next.  Returns false if the history is not
+     * in memory.  See HistoryBudget.
+     */
+    bool spillHistory();
+
     /**
      * Copies the output history from @p startLine to @p endLine
      * into @p stream, using @p decoder to convert the terminal
@@ -192,6 +205,28 @@ public:
      */
     virtual void writeToStream(TerminalCharacterDecoder *decoder, int startLine, int endLine);
 
+    /**
+     * Returns the ranges of lines, first line and line after the last one,
+     * which may contain @p text.  See Screen::searchCandidates()
+     */
+    QVector<QPair<int, int>> searchCandidates(const QString &text);
+
+    /**
+     * Returns the number of lines dropped from the start of the output of the
+     * current screen.  See Screen::totalDroppedLines()
+     */
+    qint64 totalDroppedLines() const;
+
+    /**
+     * Returns true if the shell marks its prompts on the primary screen.
+     * See Screen::hasShellIntegration()
+     */
+    bool hasShellIntegration() const;
+    /** Returns the last prompt marked by the shell.  See Screen::shellPrompt() */
+    QString shellPrompt() const;
+    /** Returns the command line after it.  See Screen::shellCommand() */
+    QString shellCommand() const;
+
     /** Returns the codec used to decode incoming characters.  See setCodec() */
     const QTextCodec *codec() const
     {
@@ -263,6 +298,12 @@ public slots:
     /** Change the size of the emulation's image */
     virtual void setImageSize(int lines, int columns);
 
+    /**
+     * Tells the HistoryBudget that the history is viewed, and moves it back
+     * to memory if spillHistory() moved it to disk.
+     */
+    void touchHistory();
+
     /**
      * Interprets a sequence of characters and sends the result to the terminal.
      * This is equivalent to calling sendKeyEvent() for each character in @p text in succession.
@@ -292,8 +333,8 @@ public slots:
 
     /**
      * Processes an incoming stream of characters.  receiveData() decodes the incoming
-     * character buffer using the current codec(), and then calls receiveChar() for
-     * each unicode character in the resulting buffer.
+     * character buffer using the current codec(), and then passes the resulting
+     * unicode characters to receiveChars().
      *
      * receiveData() also starts a timer which causes the outputChanged() signal
      * to be emitted when it expires.  The timer allows multiple updates in quick
@@ -342,7 +383,11 @@ signals:
      */
     void stateSet(int state);
 
-    /** TODO Document me */
+    /**
+     * Emitted when the start of a zmodem transfer is seen in the output of
+     * the terminal program.  The output is scanned for it by Pty before it
+     * reaches the emulation.
+     */
     void zmodemDetected();
 
 
@@ -480,6 +525,18 @@ protected:
      */
     virtual void receiveChar(wchar_t ch);
 
+    /**
+     * Processes a block of incoming characters.  See receiveData()
+     *
+     * The default implementation calls receiveChar() for each character,
+     * emulations may override it to handle runs of printable characters
+     * in bulk.
+     *
+     * @p chars An array of unicode character codes.
+     * @p count The number of characters in @p chars
+     */
+    virtual void receiveChars(const uint *chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -511,6 +568,12 @@ protected:
     //the current text codec.  (this allows for rendering of non-ASCII characters in text files etc.)
     const QTextCodec *_codec;
     QTextDecoder *_decoder;
+    // used instead of _decoder when the codec is UTF-8, decodes straight
+    // into _decodeBuffer which is reused for every block of output
+    Utf8Decoder _utf8Decoder;
+    QVector<uint> _decodeBuffer;
+    // used when the codec is a GB codec, see receiveData()
+    GbTranscoder _gbTranscoder;
     /******** Modify by ut000610 daizhengwen 2020-06-02: 让这个值能被修改****************/
     /*const */KeyboardTranslator *_keyTranslator; // the keyboard layout
     /********************* Modify by ut000610 daizhengwen End ************************/
@@ -532,6 +595,9 @@ private slots:
     // view
     void showBulk();
 
+    // reflows the next part of the history of both screens after a resize
+    void continueReflow();
+
     void usesMouseChanged(bool usesMouse);
 
     void setAlternateScrolling(bool enable);
@@ -544,6 +610,11 @@ private:
     bool _bracketedPasteMode;
     QTimer _bulkTimer1;
     QTimer _bulkTimer2;
+    QTimer _reflowTimer;
+
+    // maximum number of lines of the history moved to disk by spillHistory(),
+    // 0 if the history is not on disk
+    int _spilledHistoryLines;
 
     int _sessionId;
 
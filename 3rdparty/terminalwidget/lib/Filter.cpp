@@ -35,6 +35,7 @@
 #include <QFile>
 #include <QDesktopServices>
 #include <QUrl>
+#include <QRegularExpressionMatchIterator>
 
 // KDE
 //#include <KLocale>
@@ -75,11 +76,17 @@ void FilterChain::reset()
     while (iter.hasNext())
         iter.next()->reset();
 }
-void FilterChain::setBuffer(const QString *buffer, const QList<int> *linePositions)
+void FilterChain::setBuffer(const QString *buffer, const QList<int> *linePositions, int firstLine)
 {
     QListIterator<Filter *> iter(*this);
     while (iter.hasNext())
-        iter.next()->setBuffer(buffer, linePositions);
+        iter.next()->setBuffer(buffer, linePositions, firstLine);
+}
+void FilterChain::moveHotSpots(const QVector<int> &newLines)
+{
+    QListIterator<Filter *> iter(*this);
+    while (iter.hasNext())
+        iter.next()->moveHotSpots(newLines);
 }
 void FilterChain::process()
 {
@@ -125,6 +132,11 @@ void FilterChain::setSessionId(int sessionId)
 TerminalImageFilterChain::TerminalImageFilterChain()
     : _buffer(nullptr)
     , _linePositions(nullptr)
+    , _columns(0)
+    , _filters()
+    , _lineGenerations()
+    , _groupStarts()
+    , _lineTexts()
 {
 }
 
@@ -152,16 +164,69 @@ bool isContainOtherPromptEnd(QString promptLine, QString currPromptEnd)
     return false;
 }
 
-void TerminalImageFilterChain::setImage(const Character *const image, int lines, int columns, const QVector<LineProperty> &lineProperties)
+void TerminalImageFilterChain::setImage(const Character *const image, int lines, int columns, const QVector<LineProperty> &lineProperties,
+                                        const QVector<quint64> &lineGenerations, const ExtendedCharTable *extendedChars)
 {
     if (empty())
         return;
 
-    // reset all filters and hotspots
-    reset();
+    // the text of a line depends on the width of the image, the hotspots
+    // on the filters which found them
+    if (columns != _columns || _filters != static_cast<const QList<Filter *> &>(*this)) {
+        reset();
+        _columns = columns;
+        _filters = *this;
+        _lineGenerations.clear();
+        _groupStarts.clear();
+        _lineTexts.clear();
+    }
+
+    // the groups of lines joined by LINE_WRAPPED, and the line after the last
+    QVector<int> groupStarts;
+    for (int i = 0 ; i < lines ; i++) {
+        if (i == 0 || !(lineProperties.value(i - 1, LINE_DEFAULT) & LINE_WRAPPED))
+            groupStarts.append(i);
+    }
+    groupStarts.append(lines);
+
+    // A group whose lines all have the generations of a group of the last
+    // image keeps its hotspots, the others are processed again.
+    QHash<quint64, int> oldGroups;
+    for (int group = 0 ; group + 1 < _groupStarts.size() ; group++) {
+        const quint64 generation = _lineGenerations.at(_groupStarts.at(group));
+        if (generation != 0)
+            oldGroups.insert(generation, group);
+    }
+
+    QVector<int> newLines(_lineGenerations.size(), -1);
+    QVector<int> changedGroups;
+    bool moved = false;
+    for (int group = 0 ; group + 1 < groupStarts.size() ; group++) {
+        const int start = groupStarts.at(group);
+        const int count = groupStarts.at(group + 1) - start;
+        const int oldGroup = oldGroups.value(lineGenerations.value(start), -1);
+        const int oldStart = oldGroup != -1 ? _groupStarts.at(oldGroup) : -1;
+        bool kept = oldGroup != -1 && _groupStarts.at(oldGroup + 1) - oldStart == count;
+        for (int i = 0 ; kept && i < count ; i++)
+            kept = lineGenerations.value(start + i) == _lineGenerations.at(oldStart + i);
+
+        if (!kept) {
+            changedGroups.append(group);
+            continue;
+        }
+        for (int i = 0 ; i < count ; i++)
+            newLines[oldStart + i] = start + i;
+        moved = moved || oldStart != start;
+    }
+
+    if (changedGroups.isEmpty() && !moved && lines == _lineGenerations.size())
+        return;
+
+    moveHotSpots(newLines);
 
     PlainTextDecoder decoder;
     decoder.setTrailingWhitespace(false);
+    decoder.setExtendedCharTable(extendedChars);
 
     // setup new shared buffers for the filters to process on
     QString *newBuffer = new QString();
@@ -175,13 +240,23 @@ void TerminalImageFilterChain::setImage(const Character *const image, int lines,
     _buffer = newBuffer;
     _linePositions = newLinePositions;
 
-    QTextStream lineStream(_buffer);
-    decoder.begin(&lineStream);
-
+    QHash<quint64, QString> lineTexts;
     QString lastLine = "";
     for (int i = 0 ; i < lines ; i++) {
+        // only the lines which changed are decoded again
+        const quint64 generation = lineGenerations.value(i);
+        QString text = generation != 0 ? _lineTexts.value(generation) : QString();
+        if (generation == 0 || !_lineTexts.contains(generation)) {
+            QTextStream lineStream(&text);
+            decoder.begin(&lineStream);
+            decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
+            decoder.end();
+        }
+        if (generation != 0)
+            lineTexts.insert(generation, text);
+
         _linePositions->append(_buffer->length());
-        decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
+        _buffer->append(text);
 
         // pretend that each line ends with a newline character.
         // this prevents a link that occurs at the end of one line
@@ -194,14 +269,47 @@ void TerminalImageFilterChain::setImage(const Character *const image, int lines,
         // terminal image to avoid adding this imaginary character for wrapped
         // lines
         if (!(lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED))
-            lineStream << QLatin1Char('\n');
+            _buffer->append(QLatin1Char('\n'));
 
-         QString tempLine = lineStream.readAll().trimmed();
+         QString tempLine = text.trimmed();
          if (tempLine.length() > 0) {
              lastLine = tempLine;
          }
     }
-    decoder.end();
+
+    // process the runs of changed groups, the lines of their hotspots count
+    // from the first line of the run
+    for (int index = 0 ; index < changedGroups.size() ; ) {
+        int last = index;
+        while (last + 1 < changedGroups.size() && changedGroups.at(last + 1) == changedGroups.at(last) + 1)
+            last++;
+
+        const int first = groupStarts.at(changedGroups.at(index));
+        const int end = groupStarts.at(changedGroups.at(last) + 1);
+        const int position = _linePositions->at(first);
+        const int endPosition = end < lines ? _linePositions->at(end) : _buffer->length();
+        const QString runBuffer = _buffer->mid(position, endPosition - position);
+        QList<int> runLinePositions;
+        for (int i = first ; i < end ; i++)
+            runLinePositions.append(_linePositions->at(i) - position);
+
+        setBuffer(&runBuffer, &runLinePositions, first);
+        process();
+        index = last + 1;
+    }
+    setBuffer(_buffer, _linePositions);
+
+    _lineGenerations = lineGenerations;
+    _lineGenerations.resize(lines);
+    _groupStarts = groupStarts;
+    _lineTexts = lineTexts;
+
+    // A shell with integration marks its prompt and command line, which
+    // SessionManager reads from the screen, the text only has to be
+    // scraped for the other shells.
+    if (SessionManager::instance()->hasShellIntegration(_sessionId)) {
+        return;
+    }
 
     /* fix bug 33638 使用sudo apt-get install csh ksh zsh tcsh安装其它shell后，执行卸载终端未弹出卸载弹框 */
 
@@ -243,7 +351,8 @@ void TerminalImageFilterChain::setImage(const Character *const image, int lines,
 
 Filter::Filter() :
     _linePositions(nullptr),
-    _buffer(nullptr)
+    _buffer(nullptr),
+    _firstLine(0)
 {
 }
 
@@ -259,10 +368,32 @@ void Filter::reset()
     _hotspotList.clear();
 }
 
-void Filter::setBuffer(const QString *buffer, const QList<int> *linePositions)
+void Filter::setBuffer(const QString *buffer, const QList<int> *linePositions, int firstLine)
 {
     _buffer = buffer;
     _linePositions = linePositions;
+    _firstLine = firstLine;
+}
+
+void Filter::moveHotSpots(const QVector<int> &newLines)
+{
+    _hotspots.clear();
+
+    QMutableListIterator<HotSpot *> iter(_hotspotList);
+    while (iter.hasNext()) {
+        HotSpot *spot = iter.next();
+        const int line = newLines.value(spot->_startLine, -1);
+        if (line == -1) {
+            iter.remove();
+            delete spot;
+            continue;
+        }
+
+        spot->_endLine += line - spot->_startLine;
+        spot->_startLine = line;
+        for (int i = spot->_startLine ; i <= spot->_endLine ; i++)
+            _hotspots.insert(i, spot);
+    }
 }
 
 void Filter::getLineColumn(int position, int &startLine, int &startColumn)
@@ -280,7 +411,7 @@ void Filter::getLineColumn(int position, int &startLine, int &startColumn)
             nextLine = _linePositions->value(i + 1);
 
         if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
+            startLine = _firstLine + i;
             startColumn = Character::stringWidth(buffer()->mid(_linePositions->value(i), position - _linePositions->value(i)));
             return;
         }
@@ -473,9 +604,14 @@ UrlFilter::HotSpot::UrlType UrlFilter::HotSpot::urlType() const
 {
     QString url = capturedTexts().constFirst();
 
-    if (FullUrlRegExp.exactMatch(url))
+    static const QRegularExpression fullUrl(QLatin1String("\\A(?:") + FullUrlRegExp.pattern() + QLatin1String(")\\z"),
+                                            FullUrlRegExp.patternOptions());
+    static const QRegularExpression emailAddress(QLatin1String("\\A(?:") + EmailAddressRegExp.pattern() + QLatin1String(")\\z"),
+                                                 EmailAddressRegExp.patternOptions());
+
+    if (fullUrl.match(url).hasMatch())
         return StandardUrl;
-    else if (EmailAddressRegExp.exactMatch(url))
+    else if (emailAddress.match(url).hasMatch())
         return Email;
     else
         return Unknown;
@@ -518,22 +654,103 @@ void UrlFilter::HotSpot::activate(const QString &actionName)
 /** modify begin by ut001121 zhangmeng 20201215 for 1040-4 Ctrl键+鼠标点击超链接打开网页 */
 /** del
 const QRegExp UrlFilter::FullUrlRegExp(QLatin1String("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[^\\s<>'\"]+[^!,\\.\\s<>'\"\\]]"));*/
-const QRegExp UrlFilter::FullUrlRegExp(QLatin1String("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[\\w-.@]+"
+// \w matches the letters and digits of all scripts like in QRegExp, and the
+// hyphen is last in [\w.@-], PCRE does not take it after \w
+const QRegularExpression UrlFilter::FullUrlRegExp(QLatin1String("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[\\w.@-]+"
                                                      "([:]((6553[0-5])|[655[0-2][0-9]|65[0-4][0-9]{2}|6[0-4][0-9]{3}|[1-5][0-9]{4}|[1-9][0-9]{3}|[1-9][0-9]{2}|[1-9][0-9]|[0-9])[^0-9])?"
-                                                     "([/][\\w\\-\\@?^=%&/~\\+#.]+)?"));
+                                                     "([/][\\w\\-\\@?^=%&/~\\+#.]+)?"),
+                                                  QRegularExpression::UseUnicodePropertiesOption);
 /** modify end by ut001121 */
 
 // email address:
 // [word chars, dots or dashes]@[word chars, dots or dashes].[word chars]
-const QRegExp UrlFilter::EmailAddressRegExp(QLatin1String("\\b(\\w|\\.|-)+@(\\w|\\.|-)+\\.\\w+\\b"));
+const QRegularExpression UrlFilter::EmailAddressRegExp(QLatin1String("\\b(\\w|\\.|-)+@(\\w|\\.|-)+\\.\\w+\\b"),
+                                                       QRegularExpression::UseUnicodePropertiesOption);
 
 // matches full url or email address
-const QRegExp UrlFilter::CompleteUrlRegExp(QLatin1Char('(') + FullUrlRegExp.pattern() + QLatin1Char('|') +
-                                           EmailAddressRegExp.pattern() + QLatin1Char(')'));
+const QRegularExpression UrlFilter::CompleteUrlRegExp(QLatin1Char('(') + FullUrlRegExp.pattern() + QLatin1Char('|') +
+                                                      EmailAddressRegExp.pattern() + QLatin1Char(')'),
+                                                      QRegularExpression::UseUnicodePropertiesOption);
 
 UrlFilter::UrlFilter()
 {
-    setRegExp(CompleteUrlRegExp);
+    setRegExp(QRegExp(CompleteUrlRegExp.pattern()));
+    // compile it with the JIT now instead of on one of the first frames
+    CompleteUrlRegExp.optimize();
+}
+
+int UrlFilter::nextUrlMark(const QString &text, int from)
+{
+    const QChar *data = text.constData();
+    const int length = text.length();
+    for (int i = from; i < length; i++) {
+        const ushort c = data[i].unicode();
+        if (c == '@') {
+            return i;
+        }
+        if (c == ':' && i + 2 < length && data[i + 1] == QLatin1Char('/') && data[i + 2] == QLatin1Char('/')) {
+            return i;
+        }
+        if (c == 'w' && i + 3 < length && data[i + 1] == QLatin1Char('w') && data[i + 2] == QLatin1Char('w')
+                && data[i + 3] == QLatin1Char('.')) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void UrlFilter::process()
+{
+    const QString *text = buffer();
+
+    Q_ASSERT(text);
+
+    // Every match contains one of the marks and no space before it.  After
+    // it, a space can only follow the digits of a port, see FullUrlRegExp,
+    // so the words from the one of the mark to the next space after a
+    // character other than a digit, and the space, contain all matches
+    // around the mark.
+    const QChar *data = text->constData();
+    const int length = text->length();
+    int pos = 0;
+    while (pos < length) {
+        const int mark = nextUrlMark(*text, pos);
+        if (mark < 0) {
+            break;
+        }
+
+        int start = mark;
+        while (start > pos && !data[start - 1].isSpace()) {
+            start--;
+        }
+        int end = mark;
+        while (end < length && (!data[end].isSpace() || data[end - 1].isDigit())) {
+            end++;
+        }
+        end = qMin(end + 1, length);
+
+        QRegularExpressionMatchIterator iterator = CompleteUrlRegExp.globalMatch(text->midRef(start, end - start));
+        while (iterator.hasNext()) {
+            const QRegularExpressionMatch match = iterator.next();
+            const int matchStart = start + match.capturedStart();
+            const int matchEnd = start + match.capturedEnd();
+
+            int startLine = 0;
+            int endLine = 0;
+            int startColumn = 0;
+            int endColumn = 0;
+
+            getLineColumn(matchStart, startLine, startColumn);
+            getLineColumn(matchEnd, endLine, endColumn);
+
+            RegExpFilter::HotSpot *spot = newHotSpot(startLine, startColumn,
+                                                     endLine, endColumn);
+            spot->setCapturedTexts(match.capturedTexts());
+
+            addHotSpot(spot);
+        }
+        pos = end;
+    }
 }
 
 UrlFilter::HotSpot::~HotSpot()
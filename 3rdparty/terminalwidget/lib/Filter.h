@@ -27,6 +27,8 @@
 #include <QStringList>
 #include <QHash>
 #include <QRegExp>
+#include <QRegularExpression>
+#include <QVector>
 
 // Local
 #include "qtermwidget_export.h"
@@ -35,6 +37,7 @@ namespace Konsole {
 
 typedef unsigned char LineProperty;
 class Character;
+class ExtendedCharTable;
 
 /**
  * A filter processes blocks of text looking for certain patterns (such as URLs or keywords from a list)
@@ -121,6 +124,9 @@ public:
         void setType(Type type);
 
     private:
+        // moves the hotspot, see Filter::moveHotSpots()
+        friend class Filter;
+
         int    _startLine;
         int    _startColumn;
         int    _endLine;
@@ -155,9 +161,17 @@ public:
     QList<HotSpot *> hotSpotsAtLine(int line) const;
 
     /**
-     * TODO: Document me
+     * Sets the text which process() looks at.  @p linePositions are the
+     * positions in @p buffer where its lines start, the first of which is
+     * line @p firstLine of the hotspots found.
+     */
+    void setBuffer(const QString *buffer, const QList<int> *linePositions, int firstLine = 0);
+
+    /**
+     * Moves the hotspots which start on a line to line @p newLines at its
+     * index, and deletes them if that is -1 or the index is past its end.
      */
-    void setBuffer(const QString *buffer, const QList<int> *linePositions);
+    void moveHotSpots(const QVector<int> &newLines);
 
 protected:
     /** Adds a new hotspot to the list */
@@ -173,6 +187,7 @@ private:
 
     const QList<int> *_linePositions;
     const QString *_buffer;
+    int _firstLine;
 };
 
 /**
@@ -238,7 +253,14 @@ private:
 
 class FilterObject;
 
-/** A filter which matches URLs in blocks of text */
+/**
+ * A filter which matches URLs in blocks of text
+ *
+ * Only the words around "://", "www." and "@" are matched, with a
+ * QRegularExpression, so the text is read once and most lines of output,
+ * which have none of them, are not matched at all.  regExp() is the same
+ * expression as a QRegExp, for RegExpFilter::process().
+ */
 class TERMINALWIDGET_EXPORT UrlFilter : public RegExpFilter
 {
     Q_OBJECT
@@ -276,16 +298,22 @@ public:
 
     UrlFilter();
 
+    /** Reimplemented to search the words which may contain a URL, see UrlFilter */
+    void process() override;
+
 protected:
     RegExpFilter::HotSpot *newHotSpot(int, int, int, int) override;
 
 private:
+    // returns the position of the next "://", "www." or "@" from 'from' on,
+    // or -1 if there is none
+    static int nextUrlMark(const QString &text, int from);
 
-    static const QRegExp FullUrlRegExp;
-    static const QRegExp EmailAddressRegExp;
+    static const QRegularExpression FullUrlRegExp;
+    static const QRegularExpression EmailAddressRegExp;
 
     // combined OR of FullUrlRegExp and EmailAddressRegExp
-    static const QRegExp CompleteUrlRegExp;
+    static const QRegularExpression CompleteUrlRegExp;
 signals:
     void activated(const QUrl &url, bool fromContextMenu);
 };
@@ -344,7 +372,9 @@ public:
     void process();
 
     /** Sets the buffer for each filter in the chain to process. */
-    void setBuffer(const QString *buffer, const QList<int> *linePositions);
+    void setBuffer(const QString *buffer, const QList<int> *linePositions, int firstLine = 0);
+    /** Moves the hotspots of each filter in the chain, see Filter::moveHotSpots() */
+    void moveHotSpots(const QVector<int> &newLines);
 
     /** Returns the first hotspot which occurs at @p line, @p column or 0 if no hotspot was found */
     Filter::HotSpot *hotSpotAt(int line, int column) const;
@@ -359,7 +389,14 @@ protected:
     int _sessionId;
 };
 
-/** A filter chain which processes character images from terminal displays */
+/**
+ * A filter chain which processes character images from terminal displays.
+ *
+ * The text and the hotspots of the lines are kept from one image to the
+ * next.  Lines joined by LINE_WRAPPED are processed together, only those
+ * with a line whose generation changed are decoded and processed again,
+ * the hotspots of the others move with them when the image scrolls.
+ */
 class TERMINALWIDGET_EXPORT TerminalImageFilterChain : public FilterChain
 {
 public:
@@ -367,19 +404,33 @@ public:
     ~TerminalImageFilterChain() override;
 
     /**
-     * Set the current terminal image to @p image.
+     * Set the current terminal image to @p image and process the lines
+     * which changed since the last one.
      *
      * @param image The terminal image
      * @param lines The number of lines in the terminal image
      * @param columns The number of columns in the terminal image
      * @param lineProperties The line properties to set for image
+     * @param lineGenerations The generations of the lines, see
+     * Screen::getLineGenerations(), a line with the generation 0 is always
+     * processed again
+     * @param extendedChars The table of the extended characters of the image
      */
     void setImage(const Character *const image, int lines, int columns,
-                  const QVector<LineProperty> &lineProperties);
+                  const QVector<LineProperty> &lineProperties,
+                  const QVector<quint64> &lineGenerations,
+                  const ExtendedCharTable *extendedChars);
 
 private:
     QString *_buffer;
     QList<int> *_linePositions;
+
+    // the image processed last
+    int _columns;
+    QList<Filter *> _filters;
+    QVector<quint64> _lineGenerations;
+    QVector<int> _groupStarts;   // first line of each group of joined lines
+    QHash<quint64, QString> _lineTexts;
 };
 
 }
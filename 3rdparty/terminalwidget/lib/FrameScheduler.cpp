@@ -0,0 +1,187 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "FrameScheduler.h"
+
+// Qt
+#include <QEvent>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWidget>
+#include <QWindow>
+
+// Konsole
+#include "TerminalDisplay.h"
+
+using namespace Konsole;
+
+// frames per second of a window which is not active
+static const int UNFOCUSED_FRAME_RATE = 20;
+// frames per second when the refresh rate of the screen is unknown
+static const int DEFAULT_FRAME_RATE = 60;
+
+FrameScheduler::FrameScheduler(QWidget *window) :
+    QObject(window),
+    _window(window),
+    _lastFrame(-1),
+    _frames(0),
+    _displayUpdates(0),
+    _updateTime(0),
+    _maximumUpdateTime(0),
+    _paintTime(0),
+    _frameIntervals(0),
+    _frameIntervalCount(0)
+{
+    _frameTimer.setSingleShot(true);
+    _frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&_frameTimer, &QTimer::timeout, this, &FrameScheduler::frame);
+    _clock.start();
+    _window->installEventFilter(this);
+}
+
+FrameScheduler *FrameScheduler::forWindow(QWidget *widget)
+{
+    QWidget *window = widget->window();
+    FrameScheduler *scheduler = window->findChild<FrameScheduler *>(QString(), Qt::FindDirectChildrenOnly);
+    if (!scheduler) {
+        scheduler = new FrameScheduler(window);
+    }
+    return scheduler;
+}
+
+int FrameScheduler::frameInterval() const
+{
+    if (!_window->isActiveWindow()) {
+        return 1000 / UNFOCUSED_FRAME_RATE;
+    }
+
+    QScreen *screen = _window->windowHandle() ? _window->windowHandle()->screen() : QGuiApplication::primaryScreen();
+    const qreal refreshRate = screen ? screen->refreshRate() : 0;
+    return qMax(1, qRound(1000 / (refreshRate >= 1 ? refreshRate : DEFAULT_FRAME_RATE)));
+}
+
+bool FrameScheduler::isWindowSuspended() const
+{
+    return !_window->isVisible() || _window->isMinimized();
+}
+
+void FrameScheduler::suspend(TerminalDisplay *display)
+{
+    // a display which was shown and hidden again may still be there
+    if (!_suspendedDisplays.contains(display)) {
+        _suspendedDisplays << display;
+    }
+}
+
+void FrameScheduler::requestFrame(TerminalDisplay *display)
+{
+    if (isWindowSuspended()) {
+        suspend(display);
+        return;
+    }
+
+    _displays << display;
+    scheduleFrame();
+}
+
+void FrameScheduler::cancel(TerminalDisplay *display)
+{
+    if (_suspendedDisplays.isEmpty()) {
+        return;
+    }
+    _suspendedDisplays.removeAll(display);
+    // and the displays which were closed meanwhile
+    _suspendedDisplays.removeAll(QPointer<TerminalDisplay>());
+}
+
+void FrameScheduler::scheduleFrame()
+{
+    if (_frameTimer.isActive()) {
+        return;
+    }
+
+    // the first frame after a pause is not delayed
+    const qint64 elapsed = _lastFrame < 0 ? -1 : (_clock.nsecsElapsed() - _lastFrame) / 1000000;
+    const int interval = frameInterval();
+    _frameTimer.start(elapsed < 0 || elapsed >= interval ? 0 : static_cast<int>(interval - elapsed));
+}
+
+void FrameScheduler::reportPaintTime(qint64 nsecs)
+{
+    _paintTime += nsecs;
+}
+
+void FrameScheduler::frame()
+{
+    const qint64 start = _clock.nsecsElapsed();
+    if (_lastFrame >= 0 && start - _lastFrame < 2 * frameInterval() * qint64(1000000)) {
+        _frameIntervals += start - _lastFrame;
+        _frameIntervalCount++;
+    }
+    _lastFrame = start;
+
+    // displays which ask again while they are updated are updated on the next frame
+    const QList<QPointer<TerminalDisplay>> displays = _displays;
+    _displays.clear();
+    for (const QPointer<TerminalDisplay> &display : displays) {
+        if (!display) {
+            continue;
+        }
+        if (display->isRenderSuspended()) {
+            // a display in a hidden tab is updated when it is shown, see
+            // TerminalDisplay::showEvent(), the others with their window
+            suspend(display);
+            continue;
+        }
+        display->updateFrame();
+        _displayUpdates++;
+    }
+
+    const qint64 updateTime = _clock.nsecsElapsed() - start;
+    _updateTime += updateTime;
+    _maximumUpdateTime = qMax(_maximumUpdateTime, updateTime);
+    _frames++;
+}
+
+bool FrameScheduler::eventFilter(QObject *watched, QEvent *event)
+{
+    // the frame which was due while the window was minimised or hidden
+    if (watched == _window && (event->type() == QEvent::Show || event->type() == QEvent::WindowStateChange)
+            && !_suspendedDisplays.isEmpty() && !isWindowSuspended()) {
+        _displays << _suspendedDisplays;
+        _suspendedDisplays.clear();
+        scheduleFrame();
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+FrameScheduler::Statistics FrameScheduler::statistics() const
+{
+    Statistics statistics;
+    statistics.frames = _frames;
+    statistics.displayUpdates = _displayUpdates;
+    if (_frames > 0) {
+        statistics.averageUpdateTime = _updateTime / _frames / 1000;
+        statistics.averagePaintTime = _paintTime / _frames / 1000;
+    }
+    statistics.maximumUpdateTime = _maximumUpdateTime / 1000;
+    if (_frameIntervalCount > 0) {
+        statistics.averageFrameInterval = _frameIntervals / _frameIntervalCount / 1000;
+    }
+    return statistics;
+}
+
+void FrameScheduler::resetStatistics()
+{
+    _frames = 0;
+    _displayUpdates = 0;
+    _updateTime = 0;
+    _maximumUpdateTime = 0;
+    _paintTime = 0;
+    _frameIntervals = 0;
+    _frameIntervalCount = 0;
+}
@@ -0,0 +1,117 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+// Qt
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+class QWidget;
+
+namespace Konsole {
+
+class TerminalDisplay;
+
+/**
+ * Updates the terminal displays of a top level window together, once per
+ * frame.
+ *
+ * When the output of its screen window changes, a TerminalDisplay asks the
+ * scheduler of its window for a frame instead of updating its image at once.
+ * On the next frame the scheduler updates all displays which asked, so the
+ * splits of a window which all print are painted together.  Frames follow
+ * each other at most at the refresh rate of the screen of the window, or at
+ * UNFOCUSED_FRAME_RATE while the window is not active.  Qt widgets are not
+ * told about vertical blanks, so frames are paced by the refresh interval
+ * rather than synchronized with them.
+ *
+ * No frames are made while the window is minimised or hidden.  The displays
+ * which asked for one are updated on the first frame after it is shown.
+ */
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Frame times since the last resetStatistics(), in microseconds. */
+    struct Statistics {
+        int frames = 0;
+        /** Displays updated in these frames. */
+        int displayUpdates = 0;
+        /** Time to update the images of the displays of a frame. */
+        qint64 averageUpdateTime = 0;
+        qint64 maximumUpdateTime = 0;
+        /** Time to paint the displays after a frame, see reportPaintTime(). */
+        qint64 averagePaintTime = 0;
+        /** Time from one frame to the next, if it followed within two frame intervals. */
+        qint64 averageFrameInterval = 0;
+    };
+
+    /**
+     * Returns the scheduler of the top level window of @p widget, which is
+     * created with it.
+     */
+    static FrameScheduler *forWindow(QWidget *widget);
+
+    /** Calls TerminalDisplay::updateFrame() of @p display on the next frame. */
+    void requestFrame(TerminalDisplay *display);
+    /**
+     * Forgets @p display if it waits for the window to be shown, because it
+     * was updated otherwise, see TerminalDisplay::showEvent().
+     */
+    void cancel(TerminalDisplay *display);
+
+    /** Adds @p nsecs spent painting a display to the current frame. */
+    void reportPaintTime(qint64 nsecs);
+
+    Statistics statistics() const;
+    void resetStatistics();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void frame();
+
+private:
+    explicit FrameScheduler(QWidget *window);
+
+    // milliseconds from one frame to the next
+    int frameInterval() const;
+    // returns true if the window cannot be seen
+    bool isWindowSuspended() const;
+    // starts the timer of the next frame
+    void scheduleFrame();
+    // updates 'display' when the window or the display is shown
+    void suspend(TerminalDisplay *display);
+
+    QWidget *_window;
+    QList<QPointer<TerminalDisplay>> _displays;
+    // displays which could not be seen when their frame was due
+    QList<QPointer<TerminalDisplay>> _suspendedDisplays;
+    QTimer _frameTimer;
+    QElapsedTimer _clock;
+    // the time of the last frame on _clock, -1 before the first one
+    qint64 _lastFrame;
+
+    // sums of the statistics, in nanoseconds
+    int _frames;
+    int _displayUpdates;
+    qint64 _updateTime;
+    qint64 _maximumUpdateTime;
+    qint64 _paintTime;
+    qint64 _frameIntervals;
+    int _frameIntervalCount;
+};
+
+}
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,130 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "GbTranscoder.h"
+
+// Qt
+#include <QTextCodec>
+#include <QTextDecoder>
+
+using namespace Konsole;
+
+GbTranscoder::GbTranscoder()
+    : _codec(nullptr)
+    , _enabled(false)
+    , _lossless(false)
+    , _inputDecoder(nullptr)
+{
+}
+
+GbTranscoder::~GbTranscoder()
+{
+    delete _inputDecoder;
+}
+
+bool GbTranscoder::isGbCodec(const QTextCodec *codec)
+{
+    return codec && codec->name().toUpper().startsWith("GB");
+}
+
+void GbTranscoder::setCodec(const QTextCodec *codec)
+{
+    _codec = codec;
+    _enabled = isGbCodec(codec);
+
+    _outputDecoder.reset();
+    delete _inputDecoder;
+    _inputDecoder = nullptr;
+    _checked.clear();
+    _encodable.clear();
+
+    if (!_enabled) {
+        return;
+    }
+
+    _lossless = codec->name().toUpper().startsWith("GB18030");
+    _inputDecoder = codec->makeDecoder();
+    if (!_lossless) {
+        _checked.resize(0x10000);
+        _encodable.resize(0x10000);
+    }
+}
+
+bool GbTranscoder::canEncode(uint codePoint)
+{
+    if (codePoint < 0x80 || _lossless) {
+        return true;
+    }
+    // neither GBK nor GB2312 has anything outside the BMP
+    if (codePoint > 0xFFFF) {
+        return false;
+    }
+
+    const int index = static_cast<int>(codePoint);
+    if (!_checked.testBit(index)) {
+        _checked.setBit(index);
+        _encodable.setBit(index, _codec->canEncode(QChar(static_cast<ushort>(codePoint))));
+    }
+    return _encodable.testBit(index);
+}
+
+int GbTranscoder::decodeOutput(const char *data, int length, uint *output)
+{
+    Q_ASSERT(_enabled);
+
+    const int count = _outputDecoder.decode(data, length, output);
+    if (_lossless) {
+        return count;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (output[i] >= 0x80 && !canEncode(output[i])) {
+            output[i] = '?';
+        }
+    }
+    return count;
+}
+
+const QByteArray &GbTranscoder::encodeInput(const char *data, int length)
+{
+    Q_ASSERT(_enabled);
+
+    const QString text = _inputDecoder->toUnicode(data, length);
+    const QChar *chars = text.constData();
+    const int size = text.size();
+
+    // at most three bytes of UTF-8 per UTF-16 code unit
+    _inputBuffer.resize(size * 3);
+    char *out = _inputBuffer.data();
+
+    for (int i = 0; i < size; i++) {
+        uint c = chars[i].unicode();
+        if (c < 0x80) {
+            *out++ = static_cast<char>(c);
+        } else if (c < 0x800) {
+            *out++ = static_cast<char>(0xC0 | (c >> 6));
+            *out++ = static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            if (chars[i].isHighSurrogate() && i + 1 < size && chars[i + 1].isLowSurrogate()) {
+                c = QChar::surrogateToUcs4(chars[i], chars[i + 1]);
+                i++;
+                *out++ = static_cast<char>(0xF0 | (c >> 18));
+                *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            } else {
+                if (chars[i].isSurrogate()) {
+                    c = QChar::ReplacementCharacter;
+                }
+                *out++ = static_cast<char>(0xE0 | (c >> 12));
+            }
+            *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+
+    _inputBuffer.resize(static_cast<int>(out - _inputBuffer.constData()));
+    return _inputBuffer;
+}
@@ -0,0 +1,89 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef GBTRANSCODER_H
+#define GBTRANSCODER_H
+
+// Qt
+#include <QBitArray>
+#include <QByteArray>
+
+// Konsole
+#include "Utf8Decoder.h"
+
+class QTextCodec;
+class QTextDecoder;
+
+namespace Konsole
+{
+
+/**
+ * Converts between the UTF-8 spoken by the local shell and a session using
+ * one of the GB codecs (GB18030, GBK, GB2312).
+ *
+ * The local pty echoes input and prints prompts in UTF-8, which is shown as
+ * the text the GB codec would produce for it: characters the codec cannot
+ * encode become '?'.  Input typed in the GB codec is converted to UTF-8
+ * before it is written to the pty.
+ *
+ * One transcoder lives as long as its session.  The decoders and buffers are
+ * kept between calls, so multi-byte sequences split across two reads or
+ * writes are completed on the next call and converting a block does not
+ * allocate once the buffers have grown.
+ */
+class GbTranscoder
+{
+public:
+    GbTranscoder();
+    ~GbTranscoder();
+
+    /** Returns true if @p codec is one of the GB codecs. */
+    static bool isGbCodec(const QTextCodec *codec);
+
+    /**
+     * Sets the session codec and drops any partial sequence.  The transcoder
+     * is only enabled while the codec is a GB codec.
+     */
+    void setCodec(const QTextCodec *codec);
+    const QTextCodec *codec() const { return _codec; }
+    bool isEnabled() const { return _enabled; }
+
+    /**
+     * Decodes @p length bytes of UTF-8 output from the local shell into
+     * @p output, replacing characters which the codec cannot encode with '?',
+     * and returns the number of code points written.
+     *
+     * @p output must have room for at least @p length + 1 code points.
+     */
+    int decodeOutput(const char *data, int length, uint *output);
+
+    /**
+     * Converts @p length bytes of input in the codec to UTF-8.  The returned
+     * buffer is reused by the next call.
+     */
+    const QByteArray &encodeInput(const char *data, int length);
+
+private:
+    bool canEncode(uint codePoint);
+
+    const QTextCodec *_codec;
+    bool _enabled;
+    // GB18030 covers all of Unicode, GBK and GB2312 do not
+    bool _lossless;
+
+    Utf8Decoder _outputDecoder;
+    // which BMP code points have been checked, and which of those the
+    // codec can encode
+    QBitArray _checked;
+    QBitArray _encodable;
+
+    QTextDecoder *_inputDecoder;
+    QByteArray _inputBuffer;
+};
+
+}
+
+#endif // GBTRANSCODER_H
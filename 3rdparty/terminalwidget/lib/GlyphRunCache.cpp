@@ -0,0 +1,95 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "GlyphRunCache.h"
+
+// Qt
+#include <QFontMetricsF>
+#include <QPaintDevice>
+#include <QTextLayout>
+
+using namespace Konsole;
+
+// Forces the whole fragment to be laid out left to right, like the
+// LTR_OVERRIDE_CHAR prepended by TerminalDisplay::drawCharacters()
+static const QChar LeftToRightOverride(0x202D);
+
+enum FontAttribute {
+    Bold = 1 << 0,
+    Italic = 1 << 1,
+    Underline = 1 << 2,
+    StrikeOut = 1 << 3,
+    Overline = 1 << 4
+};
+
+GlyphRunCache::GlyphRunCache(int capacity)
+    : _cache(capacity)
+    , _logicalDpiX(0)
+    , _logicalDpiY(0)
+    , _devicePixelRatio(0)
+    , _hits(0)
+    , _misses(0)
+{
+}
+
+const GlyphRunCache::Entry *GlyphRunCache::lookup(const QString &text, const QFont &font, QPaintDevice *device)
+{
+    // TerminalDisplay only changes these between fragments, family and size
+    // are the same for all entries until clear()
+    Key key;
+    key.text = text;
+    key.attributes = (font.bold() ? Bold : 0)
+                     | (font.italic() ? Italic : 0)
+                     | (font.underline() ? Underline : 0)
+                     | (font.strikeOut() ? StrikeOut : 0)
+                     | (font.overline() ? Overline : 0);
+
+    if (Entry *entry = _cache.object(key)) {
+        _hits++;
+        return entry;
+    }
+    _misses++;
+
+    QTextLayout layout(LeftToRightOverride + text, font, device);
+    QTextOption option;
+    option.setTextDirection(Qt::LeftToRight);
+    option.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(option);
+
+    // the same line position and height as QPainter::drawText() with a rect
+    const qreal leading = QFontMetricsF(font, device).leading();
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    line.setLineWidth(0x01000000);
+    line.setPosition(QPointF(0, -leading));
+    layout.endLayout();
+
+    Entry *entry = new Entry;
+    entry->glyphRuns = layout.glyphRuns();
+    entry->width = line.naturalTextWidth();
+    entry->height = line.height();
+    _cache.insert(key, entry);
+    return entry;
+}
+
+void GlyphRunCache::clear()
+{
+    _cache.clear();
+}
+
+void GlyphRunCache::setDevice(QPaintDevice *device)
+{
+    const int logicalDpiX = device->logicalDpiX();
+    const int logicalDpiY = device->logicalDpiY();
+    const qreal devicePixelRatio = device->devicePixelRatioF();
+    if (logicalDpiX != _logicalDpiX || logicalDpiY != _logicalDpiY || devicePixelRatio != _devicePixelRatio) {
+        _cache.clear();
+        _logicalDpiX = logicalDpiX;
+        _logicalDpiY = logicalDpiY;
+        _devicePixelRatio = devicePixelRatio;
+    }
+}
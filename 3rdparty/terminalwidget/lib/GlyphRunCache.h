@@ -0,0 +1,102 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef GLYPHRUNCACHE_H
+#define GLYPHRUNCACHE_H
+
+// Qt
+#include <QCache>
+#include <QFont>
+#include <QGlyphRun>
+#include <QList>
+#include <QString>
+
+class QPaintDevice;
+
+namespace Konsole
+{
+
+/**
+ * Least recently used cache of shaped text for TerminalDisplay.
+ *
+ * Shaping a fragment with QPainter::drawText() on every paint is the most
+ * expensive part of drawing the terminal, while most fragments (prompts,
+ * borders, status lines, unchanged lines of a full screen application) are
+ * painted again and again with the same text and style.  The cache keeps
+ * the QGlyphRun list of each fragment so it can be drawn with
+ * QPainter::drawGlyphRun().
+ *
+ * Entries depend on the font family and size, so the cache must be
+ * cleared when the display's font changes (including zooming).  They also
+ * depend on the resolution of the device, see setDevice().
+ */
+class GlyphRunCache
+{
+public:
+    struct Entry {
+        // positioned for a line whose top is at y = 0, as QPainter::drawText()
+        // would lay out the text
+        QList<QGlyphRun> glyphRuns;
+        // size of the laid out text, used to align and clip it
+        qreal width;
+        qreal height;
+    };
+
+    /** Constructs a cache holding up to @p capacity fragments. */
+    explicit GlyphRunCache(int capacity = 4096);
+
+    /**
+     * Returns the shaped glyphs of @p text drawn left to right with @p font
+     * on @p device, shaping the text on a miss.  The entry is valid until the
+     * next call to lookup() or clear().
+     */
+    const Entry *lookup(const QString &text, const QFont &font, QPaintDevice *device);
+
+    /** Drops all entries, e.g. after a font change.  Keeps the counters. */
+    void clear();
+
+    /**
+     * Drops all entries if the logical DPI or the device pixel ratio of
+     * @p device differ from those the entries were shaped for, e.g. after the
+     * window moved to another screen.  Called before the fragments of a paint
+     * are looked up.
+     */
+    void setDevice(QPaintDevice *device);
+
+    /** Number of lookups answered from the cache. */
+    quint64 hits() const { return _hits; }
+    /** Number of lookups which had to shape the text. */
+    quint64 misses() const { return _misses; }
+
+    struct Key {
+        QString text;
+        // the style of the font which varies between fragments, see lookup()
+        int attributes;
+
+        bool operator==(const Key &other) const
+        {
+            return attributes == other.attributes && text == other.text;
+        }
+    };
+
+private:
+    QCache<Key, Entry> _cache;
+    // the resolution of the device the entries were laid out for
+    int _logicalDpiX;
+    int _logicalDpiY;
+    qreal _devicePixelRatio;
+    quint64 _hits;
+    quint64 _misses;
+};
+
+inline uint qHash(const GlyphRunCache::Key &key, uint seed = 0)
+{
+    return qHash(key.text, seed) ^ static_cast<uint>(key.attributes);
+}
+
+}
+
+#endif // GLYPHRUNCACHE_H
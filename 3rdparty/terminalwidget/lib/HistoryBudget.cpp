@@ -0,0 +1,99 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "HistoryBudget.h"
+
+// Konsole
+#include "Emulation.h"
+
+using namespace Konsole;
+
+Q_GLOBAL_STATIC(HistoryBudget, theHistoryBudget)
+
+// bytes the histories of all sessions may use before histories are moved to disk
+static const qint64 DEFAULT_BUDGET = 256 * 1024 * 1024;
+// milliseconds between two checks of the memory used
+static const int CHECK_INTERVAL = 2000;
+
+HistoryBudget::HistoryBudget() :
+    _budget(DEFAULT_BUDGET)
+{
+    _checkTimer.setInterval(CHECK_INTERVAL);
+    connect(&_checkTimer, &QTimer::timeout, this, &HistoryBudget::checkBudget);
+}
+
+HistoryBudget::~HistoryBudget()
+{
+}
+
+HistoryBudget *HistoryBudget::instance()
+{
+    return theHistoryBudget;
+}
+
+void HistoryBudget::setBudget(qint64 bytes)
+{
+    _budget = bytes;
+    checkBudget();
+}
+
+qint64 HistoryBudget::budget() const
+{
+    return _budget;
+}
+
+qint64 HistoryBudget::memoryUsage() const
+{
+    qint64 usage = 0;
+    for (Emulation *emulation : _emulations) {
+        usage += emulation->historyMemoryUsage();
+    }
+    return usage;
+}
+
+void HistoryBudget::addEmulation(Emulation *emulation)
+{
+    _emulations.append(emulation);
+    if (!_checkTimer.isActive()) {
+        _checkTimer.start();
+    }
+}
+
+void HistoryBudget::removeEmulation(Emulation *emulation)
+{
+    _emulations.removeOne(emulation);
+    if (_emulations.isEmpty()) {
+        _checkTimer.stop();
+    }
+}
+
+void HistoryBudget::touch(Emulation *emulation)
+{
+    const int index = _emulations.indexOf(emulation);
+    if (index >= 0) {
+        _emulations.move(index, _emulations.size() - 1);
+    }
+}
+
+void HistoryBudget::checkBudget()
+{
+    qint64 usage = memoryUsage();
+    if (usage <= _budget) {
+        return;
+    }
+
+    // The session viewed last is never moved, it is most likely the one
+    // on screen.
+    const qint64 target = _budget - _budget / 4;
+    for (int i = 0; i < _emulations.size() - 1 && usage > target; i++) {
+        Emulation *emulation = _emulations.at(i);
+        const qint64 emulationUsage = emulation->historyMemoryUsage();
+        if (emulation->spillHistory()) {
+            usage += emulation->historyMemoryUsage() - emulationUsage;
+        }
+    }
+}
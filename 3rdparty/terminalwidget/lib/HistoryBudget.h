@@ -0,0 +1,67 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef HISTORYBUDGET_H
+#define HISTORYBUDGET_H
+
+// Qt
+#include <QObject>
+#include <QList>
+#include <QTimer>
+
+namespace Konsole {
+
+class Emulation;
+
+/**
+ * Keeps the memory used by the history of all sessions of the process
+ * within a budget.
+ *
+ * Every Emulation registers here and reports when its history is viewed.
+ * When the histories use more memory than the budget, the histories of the
+ * sessions which were viewed least recently are moved to compressed files on
+ * disk, until a quarter of the budget is free.  A moved history is read back
+ * into memory when the user scrolls or searches in it.
+ */
+class HistoryBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    HistoryBudget();
+    ~HistoryBudget() Q_DECL_OVERRIDE;
+
+    /**
+     * Returns the history budget instance.
+     */
+    static HistoryBudget *instance();
+
+    /** Sets the memory budget of all histories in bytes. */
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+
+    /** Returns the memory used by all histories in bytes. */
+    qint64 memoryUsage() const;
+
+    void addEmulation(Emulation *emulation);
+    void removeEmulation(Emulation *emulation);
+    /** Marks the history of @p emulation as viewed now. */
+    void touch(Emulation *emulation);
+
+private slots:
+    // moves histories to disk if the budget is exceeded
+    void checkBudget();
+
+private:
+    // least recently viewed first
+    QList<Emulation *> _emulations;
+    qint64 _budget;
+    QTimer _checkTimer;
+};
+
+}
+
+#endif // HISTORYBUDGET_H
@@ -16,18 +16,120 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
     02110-1301  USA.
 */
+#include <algorithm>
+
 #include <QApplication>
+#include <QRunnable>
 #include <QTextStream>
-#include <QDebug>
+#include <QThreadPool>
 
 #include "TerminalCharacterDecoder.h"
 #include "Emulation.h"
 #include "HistorySearch.h"
 
+// lines copied from the output at a time, while the event loop waits
+#define SEARCH_STEP_LINES 10000
+
+namespace
+{
+
+// Keeps the lines written to it, to decode them later in another thread.
+// The extended characters are copied to a table of their own, the one of
+// the screen can change meanwhile.
+class LineRecorder : public TerminalCharacterDecoder
+{
+public:
+    LineRecorder(QVector<Character> *cells, QVector<QPair<int, LineProperty>> *lines,
+                 ExtendedCharTable *extendedChars)
+        : _cells(cells)
+        , _lines(lines)
+        , _copiedChars(extendedChars)
+    {
+    }
+
+    void begin(QTextStream *) override
+    {
+    }
+
+    void end() override
+    {
+    }
+
+    void decodeLine(const Character *const characters, int count, LineProperty properties) override
+    {
+        const int size = _cells->size();
+        _cells->resize(size + count);
+        Character *cells = _cells->data() + size;
+        std::copy(characters, characters + count, cells);
+        for (int i = 0; i < count; i++) {
+            if (cells[i].rendition & RE_EXTENDED_CHAR) {
+                ushort length = 0;
+                const uint *sequence = cellCharacters(cells[i], length);
+                cells[i].character = _copiedChars->createExtendedChar(sequence, length);
+            }
+        }
+        _lines->append(qMakePair(count, properties));
+    }
+
+private:
+    QVector<Character> *_cells;
+    QVector<QPair<int, LineProperty>> *_lines;
+    ExtendedCharTable *_copiedChars;
+};
+
+}
+
+// Decodes the blocks to text and finds the matches in it.  Nothing of the
+// emulation or its screens is used here, only the copies in the blocks.
+class HistorySearch::BlockSearcher : public QRunnable
+{
+public:
+    explicit BlockSearcher(HistorySearch *search)
+        : _search(search)
+    {
+    }
+
+    void run() override
+    {
+        const QString &searchText = _search->m_searchText;
+        for (Block &block : _search->m_blocks) {
+            if (_search->m_cancelled.loadAcquire()) {
+                break;
+            }
+
+            QTextStream stream(&block.text);
+            PlainTextDecoder decoder;
+            decoder.setExtendedCharTable(&block.extendedChars);
+            decoder.begin(&stream);
+            decoder.setRecordLinePositions(true);
+            const Character *cells = block.cells.constData();
+            for (const QPair<int, LineProperty> &line : qAsConst(block.lines)) {
+                decoder.decodeLine(cells, line.first, line.second);
+                cells += line.first;
+            }
+            decoder.end();
+            block.linePositions = decoder.linePositions();
+            block.cells = QVector<Character>();
+
+            for (int matchStart = block.text.indexOf(searchText, 0, Qt::CaseSensitive); matchStart > -1;
+                    matchStart = block.text.indexOf(searchText, matchStart + searchText.length(), Qt::CaseSensitive)) {
+                block.matches.append(matchStart);
+            }
+        }
+
+        // the search waits for the semaphore before it is deleted
+        QMetaObject::invokeMethod(_search, "blocksSearched", Qt::QueuedConnection);
+        _search->m_searched.release();
+    }
+
+private:
+    HistorySearch *_search;
+};
+
 HistorySearch::HistorySearch(EmulationPtr emulation,
                              QString searchText,
                              bool forwards,
-                             bool isLastForwards,
+                             bool countMatches,
                              int startColumn,
                              int startLine,
                              QObject *parent) :
@@ -35,314 +137,290 @@ HistorySearch::HistorySearch(EmulationPtr emulation,
     m_emulation(emulation),
     m_searchText(searchText),
     m_forwards(forwards),
-    m_isLastForwards(isLastForwards),
+    m_countMatches(countMatches),
     m_startColumn(startColumn),
     m_startLine(startLine),
-    m_foundStartColumn(0),
-    m_foundStartLine(0),
-    m_foundEndColumn(0),
-    m_foundEndLine(0),
-    m_loseChinese(0),
-    m_matchChinese(0),
-    m_lastBackwardsPosition(-1)
+    m_droppedLines(0),
+    m_wrapRange(0),
+    m_nextRange(0),
+    m_searching(false),
+    m_cancelled(0),
+    m_screenChanged(false),
+    m_found(false),
+    m_hasWrapMatch(false),
+    m_wrapMatch(),
+    m_count(0)
 {
+    // the lines of the other screen are not those searched
+    connect(m_emulation, &Emulation::primaryScreenInUse, this, [this] {
+        m_screenChanged = true;
+        if (!m_searching) {
+            finish();
+        }
+    });
 }
 
 HistorySearch::~HistorySearch()
 {
+    m_cancelled.storeRelease(1);
+    if (m_searching) {
+        m_searched.acquire();
+    }
 }
 
-void HistorySearch::search(int currBackwardsPosition, int lastFoundStartColumn, int lastFoundStartLine)
+void HistorySearch::search()
 {
-    bool found = false;
-
-    m_currBackwardsPosition = currBackwardsPosition;
-    m_lastFoundStartColumn = lastFoundStartColumn;
-    m_lastFoundStartLine = lastFoundStartLine;
+    if (m_searchText.isEmpty()) {
+        deleteLater();
+        return;
+    }
 
-    if (!m_searchText.isEmpty()) {
-        if (m_forwards) {
-            found = search(m_startColumn, m_startLine, -1, m_emulation->lineCount()) || search(0, 0, m_startColumn, m_startLine);
-        } else {
-            found = search(0, 0, m_startColumn, m_startLine) || search(m_startColumn, m_startLine, -1, m_emulation->lineCount());
+    // only the lines which may contain the text are read
+    const QVector<QPair<int, int>> ranges = m_emulation->searchCandidates(m_searchText);
+    m_droppedLines = m_emulation->totalDroppedLines();
+
+    // Searching forwards from the start position, or backwards from the end
+    // position, then from the other end of the output.  Every range is
+    // searched once, a range with the position may have the match after
+    // wrapping around.
+    const int endLine = m_startColumn < 0 ? m_startLine + 1 : m_startLine;
+    const int endColumn = qMax(0, m_startColumn);
+    QVector<QPair<int, int>> wrapped;
+    if (m_forwards) {
+        for (const QPair<int, int> &range : ranges) {
+            if (range.second > m_startLine) {
+                m_ranges.append(range);
+            } else {
+                wrapped.append(range);
+            }
         }
-
-        if (found) {
-            emit matchFound(m_foundStartColumn, m_foundStartLine, m_foundEndColumn, m_foundEndLine, m_lastBackwardsPosition, m_loseChinese, m_matchChinese);
-        } else {
-            emit noMatchFound();
+    } else {
+        for (int i = ranges.size() - 1; i >= 0; i--) {
+            const QPair<int, int> &range = ranges.at(i);
+            if (range.first < endLine || (range.first == endLine && endColumn > 0)) {
+                m_ranges.append(range);
+            } else {
+                wrapped.append(range);
+            }
         }
     }
+    m_wrapRange = m_ranges.size();
+    m_ranges += wrapped;
+
+    searchRanges();
+}
 
+void HistorySearch::cancel()
+{
+    m_cancelled.storeRelease(1);
     deleteLater();
 }
 
-bool HistorySearch::search(int startColumn, int startLine, int endColumn, int endLine)
+void HistorySearch::searchRanges()
 {
-    qDebug() << "search from" << startColumn << "," << startLine
-             <<  "to" << endColumn << "," << endLine;
-
-    int linesRead = 0;
-    int linesToRead = endLine - startLine + 1;
-
-    qDebug() << "linesToRead:" << linesToRead;
-
-    QString stringBackwardsAfterForwards;
-    QTextStream backwardsAfterForwardsStream(&stringBackwardsAfterForwards);
-
-    QString string;
-    QTextStream searchStream(&string);
-    // We read process history from (and including) startLine to (and including) endLine in
-    // blocks of at most 10K lines so that we do not use unhealthy amounts of memory
-    int blockSize;
-    while ((blockSize = qMin(10000, linesToRead - linesRead)) > 0) {
-
-        PlainTextDecoder decoder;
-        decoder.begin(&searchStream);
-        decoder.setRecordLinePositions(true);
-
-        // Calculate lines to read and read them
-        int blockStartLine = m_forwards ? startLine + linesRead : endLine - linesRead - blockSize + 1;
-        int blockEndLine = blockStartLine + blockSize - 1;
-        m_emulation->writeToStream(&decoder, blockStartLine, blockEndLine);
-
-        decoder.end();
-
-        // We search between startColumn in the first line of the string and endColumn in the last
-        // line of the string. First we calculate the position (in the string) of endColumn in the
-        // last line of the string
-        int endPosition;
-
-        // The String that Emulator.writeToStream produces has a newline at the end, and so ends with an
-        // empty line - we ignore that.
-        int numberOfLinesInString = decoder.linePositions().size() - 1;
-        if (numberOfLinesInString > 0 && endColumn > -1) {
-            endPosition = decoder.linePositions().at(numberOfLinesInString - 1) + endColumn;
-            qDebug() << "endPosition 0:" << endPosition;
-            if (!m_forwards) {
-                qDebug() << "numberOfLinesInString string.size():" << string.size();
-                if ((endPosition - string.size()) > 0) {
-                    endPosition = string.size();
-                    qDebug() << "endPosition 1:" << endPosition;
-                }
-                else {
-                    qDebug() << "m_currBackwardsPosition:" << m_currBackwardsPosition;
-                    //上次进行正向搜索，当前采用反向搜索
-                    if (m_isLastForwards) {
-                        PlainTextDecoder decoder;
-                        decoder.begin(&backwardsAfterForwardsStream);
-                        decoder.setRecordLinePositions(false);
-                        int blockStartLine = 0;
-                        int blockEndLine = m_lastFoundStartLine-1;
-                        if (-1 == blockEndLine) {
-                            blockEndLine = m_emulation->lineCount();
-                        }
-                        m_emulation->writeToStream(&decoder, blockStartLine, blockEndLine);
-
-                        decoder.end();
-
-                        endPosition = stringBackwardsAfterForwards.length() + endColumn;
-                        qDebug() << "endPosition 2:" << endPosition;
-                    }
-                    else {
-                        qDebug() << "endPosition now is:" << endPosition;
-                        //endPosition值比上次搜索结果的位置还大，则重新计算endPosition
-                        if (m_currBackwardsPosition > -1) {
-                            if ((endPosition - m_currBackwardsPosition > m_searchText.length())) {
-                                endPosition = m_currBackwardsPosition - m_searchText.length();
-                                qDebug() << "endPosition > m_currBackwardsPosition 111:" << endPosition;
-                            }
-                            else {
-                                endPosition = m_currBackwardsPosition;
-                                qDebug() << "endPosition < m_currBackwardsPosition 222:" << endPosition;
-                            }
-                        }
-                        qDebug() << "endPosition 3:" << endPosition;
-                    }
-                }
-
-                //保存上次反向搜索的结束位置
-                if (endPosition != -1) {
-                    m_lastBackwardsPosition = endPosition;
-                    qDebug() << "backwards save m_lastBackwardsPosition 1:" << m_lastBackwardsPosition;
-                }
-            }
-        } else {
-            if (m_forwards) {
-                endPosition = string.size();
-                qDebug() << "endPosition 4:" << endPosition;
-            }
-            else {
-                endPosition = endColumn;
-                //保存上次反向搜索的结束位置
-                if (endPosition != -1) {
-                    m_lastBackwardsPosition = endPosition;
-                    qDebug() << "backwards save m_lastBackwardsPosition2:" << m_lastBackwardsPosition;
-                }
-                qDebug() << "endPosition 5!!!!!!!!!!!! == endColumn:" << endPosition;
-            }
+    if (!m_emulation || m_screenChanged) {
+        finish();
+        return;
+    }
+
+    const int shift = static_cast<int>(m_emulation->totalDroppedLines() - m_droppedLines);
+    const int lineCount = m_emulation->lineCount();
+    int lines = 0;
+    while (m_nextRange < m_ranges.size() && lines < SEARCH_STEP_LINES) {
+        const QPair<int, int> &range = m_ranges.at(m_nextRange++);
+        const int first = qMax(0, range.first - shift);
+        const int end = qMin(lineCount, range.second - shift);
+        if (first >= end) {
+            continue;
         }
 
-        qDebug() << "At last, endPosition is:" << endPosition;
+        Block block;
+        block.firstLine = first + shift;
+        LineRecorder recorder(&block.cells, &block.lines, &block.extendedChars);
+        m_emulation->writeToStream(&recorder, first, end - 1);
+        m_blocks.append(block);
+        m_blockRanges.append(m_nextRange - 1);
+        lines += end - first;
+    }
 
-        // So now we can log for m_regExp in the string between startColumn and endPosition
-        int matchStart = -1;
-        if (m_forwards) {
-            matchStart = string.indexOf(m_searchText, startColumn, Qt::CaseSensitive);
-            qDebug() << "forwards matchStart:" << matchStart << ", startColumn:" << startColumn;
-            if (matchStart >= endPosition) {
-                matchStart = -1;
-                qDebug() << "forwards matchStart == -1:" << matchStart;
-            }
-        } else {
-            qDebug() << "string:" << string;
-            qDebug() << "m_lastBackwardsPosition:" << m_lastBackwardsPosition;
-            qDebug() << "string length:" << string.length() << ", endPosition:" << endPosition;
-            //考虑了查找结果在第一行的情况
-            if (0 == startLine && startLine == endLine && endPosition > endColumn) {
-                endPosition = endColumn;
-            }
+    if (m_blocks.isEmpty()) {
+        finish();
+        return;
+    }
+    m_searching = true;
+    QThreadPool::globalInstance()->start(new BlockSearcher(this));
+}
 
-            matchStart = string.lastIndexOf(m_searchText, endPosition - 1, Qt::CaseSensitive);
-            if (matchStart != -1) {
-                m_lastBackwardsPosition = matchStart;
-                qDebug() << "backwards save m_lastBackwardsPosition3:" << m_lastBackwardsPosition;
-            }
-            qDebug() << "backwards matchStart:" << matchStart << ", startColumn:" << startColumn;
-//            if (matchStart < startColumn) {
-//                matchStart = -1;
-//                qDebug() << "backwards matchStart == -1:" << matchStart;
-//            }
-        }
+void HistorySearch::blocksSearched()
+{
+    m_searched.acquire();
+    m_searching = false;
+    if (m_cancelled.loadAcquire()) {
+        return;
+    }
+    if (m_screenChanged) {
+        finish();
+        return;
+    }
 
-        if (matchStart > -1) {
-            int matchEnd = matchStart + m_searchText.length() - 1;
-            qDebug() << "Found in string from" << matchStart << "to" << matchEnd;
-
-            // Translate startPos and endPos to startColum, startLine, endColumn and endLine in history.
-            int startLineNumberInString = findLineNumberInString(decoder.linePositions(), matchStart);
-            m_foundStartColumn = matchStart - decoder.linePositions().at(startLineNumberInString);
-            m_foundStartLine = startLineNumberInString + startLine + linesRead;
-
-            int endLineNumberInString = findLineNumberInString(decoder.linePositions(), matchEnd);
-            m_foundEndColumn = matchEnd - decoder.linePositions().at(endLineNumberInString);
-            m_foundEndLine = endLineNumberInString + startLine + linesRead;
-
-            //特殊情况, 反向查找需要重新计算下endPosition并保存到m_lastBackwardsPosition
-            if (!m_forwards) {
-                //考虑了查找结果在第一行的情况
-                if (0 == m_foundStartLine && m_foundStartLine == m_foundEndLine) {
-                    m_lastBackwardsPosition = m_foundStartColumn;
-                    qDebug() << "!!! ready to change m_foundStartColumn: " << m_foundStartColumn;
-                    qDebug() << "!!! ready to change m_foundEndColumn: " << m_foundEndColumn;
-                    qDebug() << "!!! ready to change m_foundStartLine: " << m_foundStartLine;
-                    qDebug() << "!!! ready to change m_foundEndLine: " << m_foundEndLine;
-                }
-                else if (-1 == endPosition || -1 == endColumn) {
-                    QString stringAfterSearch;
-                    QTextStream afterSearchStream(&stringAfterSearch);
-                    PlainTextDecoder decoder;
-                    decoder.begin(&afterSearchStream);
-                    decoder.setRecordLinePositions(false);
-                    int blockStartLine = 0;
-                    int blockEndLine = m_foundStartLine-1;
-                    if (-1 == blockEndLine) {
-                        blockEndLine = m_emulation->lineCount();
-                    }
-                    m_emulation->writeToStream(&decoder, blockStartLine, blockEndLine);
-
-                    decoder.end();
-
-                    m_lastBackwardsPosition = stringAfterSearch.length() + m_foundStartColumn;
-                    qDebug() << "!!! ready to change m_lastBackwardsPosition: " << m_lastBackwardsPosition;
-                }
-            }
+    for (int i = 0; i < m_blocks.size(); i++) {
+        const Block &block = m_blocks.at(i);
+        m_count += block.matches.size();
+        if (!m_found) {
+            findMatch(block, m_blockRanges.at(i) >= m_wrapRange);
+        }
+    }
+    m_blocks.clear();
+    m_blockRanges.clear();
+
+    if (m_countMatches) {
+        emit matchCount(m_count, false);
+    } else if (m_found) {
+        finish();
+        return;
+    }
+    searchRanges();
+}
 
-            //看看能不能从m_foundEndColumn m_foundEndLine和m_foundStartColumn m_foundStartLine推算出目前查找的字符串index
-            //在正向查找的时候，保存当前indexOf(search, totalString) 到 m_lastBackwardsPosition
-            // 总共读了多少行，记录下字符串总长度，加上当前偏移量
-
-            qDebug() << "m_foundStartColumn" << m_foundStartColumn
-                     << "m_foundStartLine" << m_foundStartLine
-                     << "m_foundEndColumn" << m_foundEndColumn
-                     << "m_foundEndLine" << m_foundEndLine;
-
-            /***add begin by ut001121 zhangmeng 20200515 修复BUG22626***/
-            /**
-              string:   aaa-------------bbbbbbbbbbbbb-------ccc
-                        |              ||           |
-              match pos:|              |matchStart  matchEnd
-              lose pos: loseStart      loseEnd      |
-              line pos: lineStart                   lineEnd
-
-              存在特殊情况:一个完整的物理行显示在终端被分成多个逻辑行
-            */
-            //中文字符正则表达式
-            QRegExp regEx("[\u4E00-\u9FA5，《。》、？；：【】～！￥（）]+");
-
-            //未匹配的串-物理行开始和结束位置
-            int loseEnd = matchStart;
-            int loseStart = string.lastIndexOf('\n', loseEnd) + 1;
-            //qDebug() << "loseStart" << loseStart << "loseEnd" << loseEnd ;
-
-//            if (loseStart < 0 || loseStart > loseEnd) {
-//                qDebug() << "========loseStart and loseEnd is not expected" << loseStart << loseEnd;
-//                exit(-1);
-//            }
-
-            //未匹配的串-物理行字符串
-            QString loseStr = string.mid(loseStart, loseEnd - loseStart);
-            //qDebug() << "loseStr" << loseStr << m_lineChinese;
-
-            //未匹配的串-逻辑行字符串
-            int loseEndLineNumberInString = findLineNumberInString(decoder.linePositions(), loseEnd);
-            int loseEndColumn = matchStart - decoder.linePositions().at(loseEndLineNumberInString);
-            QString logicLoseStr = loseStr.right(loseEndColumn);
-            m_loseChinese = logicLoseStr.count(regEx);
-            //qDebug() << "logicLoseStr" << logicLoseStr << m_lineChinese << loseEndColumn;
-
-            //匹配内容是否跨多个逻辑行
-            if (m_foundStartLine == m_foundEndLine) {
-                /*
-                 * 单逻辑行匹配情况
-                 * 匹配字符的当前逻辑行:(匹配字符-当前逻辑行-开始位置)--->(匹配字符-当前逻辑行-结束位置
-                */
-                //匹配字符包含中文字符数量
-                QString txt = m_searchText;//m_regExp.pattern();
-                m_matchChinese = txt.count(regEx);
-                m_matchChinese += m_loseChinese;
-            } else {
-                /*
-                 * 多逻辑行匹配情况
-                 * 匹配字符的尾行逻辑行:(匹配字符-尾行逻辑行-开始位置)--->(匹配字符-尾行逻辑行-结束位置)
-                */
-                QString macthStr = string.mid(loseStart, matchEnd - loseStart + 1);
-                QString tailMacthStr = macthStr.right(m_foundEndColumn + 1);
-                //qDebug() << "tailMacthStr" << tailMacthStr;
-                m_matchChinese = tailMacthStr.count(regEx) ;
-                /*
-                 * 跨行匹配不计算m_loseChinese
-                 * m_matchChinese += m_loseChinese;
-                 */
+void HistorySearch::findMatch(const Block &block, bool wrapped)
+{
+    // A match which starts before the end position when searching
+    // backwards, or at the start position or after it when searching
+    // forwards.  After wrapping around, the first match in the direction of
+    // the search.
+    const int endLine = m_startColumn < 0 ? m_startLine + 1 : m_startLine;
+    const int column = qMax(0, m_startColumn);
+    const int count = block.matches.size();
+    for (int i = 0; i < count; i++) {
+        const int matchStart = block.matches.at(m_forwards ? i : count - 1 - i);
+        const int lineNumber = findLineNumberInString(block.linePositions, matchStart);
+        const int line = block.firstLine + lineNumber;
+        const int matchColumn = matchStart - block.linePositions.at(lineNumber);
+        const bool inDirection = m_forwards
+                                 ? line > m_startLine || (line == m_startLine && matchColumn >= column)
+                                 : line < endLine || (line == endLine && matchColumn < column);
+        if (wrapped || inDirection) {
+            if (emitMatch(match(block, matchStart))) {
+                m_found = true;
+                return;
             }
-            /***add end by ut001121***/
-            return true;
+        } else if (!m_hasWrapMatch) {
+            // the first match after wrapping around, unless one is in the
+            // ranges searched after wrapping
+            m_wrapMatch = match(block, matchStart);
+            m_hasWrapMatch = true;
         }
+    }
+}
+
+void HistorySearch::finish()
+{
+    if (m_cancelled.loadAcquire()) {
+        return;
+    }
+    if (!m_found && m_hasWrapMatch && !m_screenChanged && m_emulation) {
+        m_found = emitMatch(m_wrapMatch);
+    }
+    if (!m_found) {
+        emit noMatchFound();
+    }
+    if (m_countMatches && !m_screenChanged) {
+        emit matchCount(m_count, true);
+    }
+
+    // no more signals once the search is done
+    m_cancelled.storeRelease(1);
+    deleteLater();
+}
+
+bool HistorySearch::emitMatch(const Match &match)
+{
+    const int shift = static_cast<int>(m_emulation->totalDroppedLines() - m_droppedLines);
+    if (match.startLine < shift) {
+        // the line was dropped from the history since it was copied
+        return false;
+    }
 
+    emit matchFound(match.startColumn, match.startLine - shift, match.endColumn, match.endLine - shift,
+                    match.loseChinese, match.matchChinese);
+    return true;
+}
 
-        linesRead += blockSize;
+HistorySearch::Match HistorySearch::match(const Block &block, int matchStart) const
+{
+    Match found;
+    const QString &string = block.text;
+    int matchEnd = matchStart + m_searchText.length() - 1;
+
+    // Translate startPos and endPos to startColum, startLine, endColumn and endLine in history.
+    int startLineNumberInString = findLineNumberInString(block.linePositions, matchStart);
+    found.startColumn = matchStart - block.linePositions.at(startLineNumberInString);
+    found.startLine = startLineNumberInString + block.firstLine;
+
+    int endLineNumberInString = findLineNumberInString(block.linePositions, matchEnd);
+    found.endColumn = matchEnd - block.linePositions.at(endLineNumberInString);
+    found.endLine = endLineNumberInString + block.firstLine;
+
+    /***add begin by ut001121 zhangmeng 20200515 修复BUG22626***/
+    /**
+      string:   aaa-------------bbbbbbbbbbbbb-------ccc
+                |              ||           |
+      match pos:|              |matchStart  matchEnd
+      lose pos: loseStart      loseEnd      |
+      line pos: lineStart                   lineEnd
+
+      存在特殊情况:一个完整的物理行显示在终端被分成多个逻辑行
+    */
+    //中文字符正则表达式
+    QRegExp regEx("[\u4E00-\u9FA5，《。》、？；：【】～！￥（）]+");
+
+    //未匹配的串-物理行开始和结束位置
+    int loseEnd = matchStart;
+    int loseStart = string.lastIndexOf('\n', loseEnd) + 1;
+
+    //未匹配的串-物理行字符串
+    QString loseStr = string.mid(loseStart, loseEnd - loseStart);
+
+    //未匹配的串-逻辑行字符串
+    int loseEndLineNumberInString = findLineNumberInString(block.linePositions, loseEnd);
+    int loseEndColumn = matchStart - block.linePositions.at(loseEndLineNumberInString);
+    QString logicLoseStr = loseStr.right(loseEndColumn);
+    found.loseChinese = logicLoseStr.count(regEx);
+
+    //匹配内容是否跨多个逻辑行
+    if (found.startLine == found.endLine) {
+        /*
+         * 单逻辑行匹配情况
+         * 匹配字符的当前逻辑行:(匹配字符-当前逻辑行-开始位置)--->(匹配字符-当前逻辑行-结束位置
+        */
+        //匹配字符包含中文字符数量
+        QString txt = m_searchText;
+        found.matchChinese = txt.count(regEx);
+        found.matchChinese += found.loseChinese;
+    } else {
+        /*
+         * 多逻辑行匹配情况
+         * 匹配字符的尾行逻辑行:(匹配字符-尾行逻辑行-开始位置)--->(匹配字符-尾行逻辑行-结束位置)
+        */
+        QString macthStr = string.mid(loseStart, matchEnd - loseStart + 1);
+        QString tailMacthStr = macthStr.right(found.endColumn + 1);
+        found.matchChinese = tailMacthStr.count(regEx) ;
+        /*
+         * 跨行匹配不计算m_loseChinese
+         * m_matchChinese += m_loseChinese;
+         */
     }
+    /***add end by ut001121***/
 
-    qDebug() << "Not found";
-    return false;
+    return found;
 }
 
 
-int HistorySearch::findLineNumberInString(QList<int> linePositions, int position)
+int HistorySearch::findLineNumberInString(QList<int> linePositions, int position) const
 {
     int lineNum = 0;
     while (lineNum + 1 < linePositions.size() && linePositions[lineNum + 1] <= position)
         lineNum++;
 
     return lineNum;
-}
+}
\ No newline at end of file
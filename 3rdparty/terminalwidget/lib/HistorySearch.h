@@ -22,6 +22,7 @@
 #include <QObject>
 #include <QPointer>
 #include <QMap>
+#include <QSemaphore>
 
 #include <Session.h>
 #include <ScreenWindow.h>
@@ -41,43 +42,107 @@ public:
     explicit HistorySearch(EmulationPtr emulation,
                            QString searchText,
                            bool forwards,
-                           bool isLastForwards,
+                           bool countMatches,
                            int startColumn,
                            int startLine,
                            QObject* parent);
 
     ~HistorySearch() override;
 
-    void search(int currBackwardsPosition, int lastFoundStartColumn, int lastFoundStartLine);
+    /**
+     * Starts to look for the first match after the start position in the
+     * direction of the search, or the first one from the other end of the
+     * output if there is none.  Emits matchFound() or noMatchFound() and
+     * deletes the search once it is done.
+     *
+     * The lines which may contain the text are copied a block at a time
+     * while the event loop runs, and searched in another thread.  Lines
+     * dropped from the history meanwhile do not move the match.
+     *
+     * A start column of -1 searches backwards from the end of the start line.
+     */
+    void search();
+
+    /** Stops the search and deletes it, it emits no more signals. */
+    void cancel();
 
 signals:
-    void matchFound(int startColumn, int startLine, int endColumn, int endLine, int lastBackwardsPosition, int loseChinese, int matchChinese);
+    void matchFound(int startColumn, int startLine, int endColumn, int endLine, int loseChinese, int matchChinese);
     void noMatchFound();
+    /**
+     * Emitted with the number of matches counted so far if the search counts
+     * them, @p complete once the whole output is searched.
+     */
+    void matchCount(int count, bool complete);
+
+private slots:
+    // called once the blocks were searched in the other thread
+    void blocksSearched();
 
 private:
-    bool search(int startColumn, int startLine, int endColumn, int endLine);
-    int findLineNumberInString(QList<int> linePositions, int position);
+    class BlockSearcher;
+
+    // the lines of a range as Emulation::writeToStream() writes them, which
+    // are decoded to text in the other thread.  The thread only reads the
+    // block, the extended characters of its cells are copied when it is
+    // taken since the screen changes its table meanwhile.
+    struct Block {
+        int firstLine;
+        QVector<Character> cells;
+        QVector<QPair<int, LineProperty>> lines;
+        ExtendedCharTable extendedChars;
+
+        QString text;
+        QList<int> linePositions;
+        QVector<int> matches;
+    };
+
+    struct Match {
+        int startColumn;
+        int startLine;
+        int endColumn;
+        int endLine;
+        int loseChinese;
+        int matchChinese;
+    };
+
+    // copies the next ranges and starts to search them
+    void searchRanges();
+    void findMatch(const Block &block, bool wrapped);
+    void finish();
+    bool emitMatch(const Match &match);
+    Match match(const Block &block, int matchStart) const;
+    int findLineNumberInString(QList<int> linePositions, int position) const;
 
 
     EmulationPtr m_emulation;
     QString m_searchText;
     bool m_forwards;
-    bool m_isLastForwards;
+    bool m_countMatches;
     int m_startColumn;
     int m_startLine;
 
-    int m_foundStartColumn;
-    int m_foundStartLine;
-    int m_foundEndColumn;
-    int m_foundEndLine;
-
-    int m_loseChinese;
-    int m_matchChinese;
-    int m_currBackwardsPosition;
-    int m_lastBackwardsPosition;
-
-    int m_lastFoundStartColumn;
-    int m_lastFoundStartLine;
+    // Line numbers are those at the start of the search, a current one is
+    // less by the lines dropped since.
+    qint64 m_droppedLines;
+    // the candidates in the order they are searched, from m_wrapRange on
+    // those after the search wrapped around the end of the output
+    QVector<QPair<int, int>> m_ranges;
+    int m_wrapRange;
+    int m_nextRange;
+
+    // the blocks searched in the other thread and the range of each
+    QVector<Block> m_blocks;
+    QVector<int> m_blockRanges;
+    bool m_searching;
+    QSemaphore m_searched;
+    QAtomicInt m_cancelled;
+    bool m_screenChanged;
+
+    bool m_found;
+    bool m_hasWrapMatch;
+    Match m_wrapMatch;
+    int m_count;
 };
 
 #endif	/* TASK_H */
@@ -46,12 +46,19 @@
 #include <QRegExp>
 #include <QRegExpValidator>
 #include <QTextCodec>
+#include <QTimer>
 
 #include "kpty.h"
 #include "kptydevice.h"
+#include "ByteMatcher.h"
 
 using namespace Konsole;
 
+// Output handed to the emulation per pass of the event loop, see dataReceived()
+static const int OutputBatchSize = 256 * 1024;
+// High-water mark of the pty read buffer, see KPtyDevice::setReadBufferLimit()
+static const int ReadBufferLimit = 1024 * 1024;
+
 void Pty::setWindowSize(int lines, int cols)
 {
     _windowColumns = cols;
@@ -272,6 +279,7 @@ void Pty::init()
     _utf8 = true;
     _bUninstall = false;
 
+    pty()->setReadBufferLimit(ReadBufferLimit);
     connect(pty(), SIGNAL(readyRead()), this, SLOT(dataReceived()));
     setPtyChannels(KPtyProcess::AllChannels);
 }
@@ -500,13 +508,15 @@ void Pty::sendData(const char *data, int length, const QTextCodec *codec)
         }
     }
 
+    if (codec != _inputTranscoder.codec()) {
+        _inputTranscoder.setCodec(codec);
+    }
+
     //为GBK/GB2312/GB18030编码，且不是输入命令执行的情况（没有按回车）
-    if (QString(codec->name()).toUpper().startsWith("GB") && !_isCommandExec) {
-        QTextCodec *utf8Codec = QTextCodec::codecForName("UTF-8");
-        QString unicodeData = codec->toUnicode(data);
-        QByteArray unicode = utf8Codec->fromUnicode(unicodeData);
+    if (_inputTranscoder.isEnabled() && !_isCommandExec) {
+        const QByteArray &utf8Data = _inputTranscoder.encodeInput(data, length);
 
-        if (!pty()->write(unicode.constData(), unicode.length())) {
+        if (!pty()->write(utf8Data.constData(), utf8Data.length())) {
             qWarning() << "Pty::doSendJobs - Could not send input data to terminal process.";
             return;
         }
@@ -520,13 +530,77 @@ void Pty::sendData(const char *data, int length, const QTextCodec *codec)
 
 }
 
+// Patterns looked for in the output of the terminal process, see dataReceived()
+enum OutputPattern {
+    // garbage printed by bash/rz when an upload or download goes wrong
+    RzGarbageBash = 0,
+    RzGarbageBashFullwidth,
+    RzGarbageCaret,
+    // only counts at the start of a block
+    RzGarbageHeader,
+    // U+008A, the garbage character of bug#23741
+    GarbageLineTabSet,
+    // start of a zmodem transfer
+    ZModemStart
+};
+
+static ByteMatcher *createOutputMatcher()
+{
+    ByteMatcher *matcher = new ByteMatcher();
+    matcher->addPattern(QByteArray("bash: $'\\212"));
+    matcher->addPattern(QByteArray("bash: **0800000000022d："));
+    matcher->addPattern(QByteArray("**^XB0800000000022d"));
+    matcher->addPattern(QByteArray("**\030B0800000000022d\r\xC2\x8A"));
+    matcher->addPattern(QByteArray("\xC2\x8A"));
+    matcher->addPattern(QByteArray("\030B00"));
+    Q_ASSERT(matcher->patternCount() == ZModemStart + 1);
+    matcher->compile();
+    return matcher;
+}
+
+static const ByteMatcher &outputMatcher()
+{
+    static const ByteMatcher *matcher = createOutputMatcher();
+    return *matcher;
+}
+
 void Pty::dataReceived()
 {
-    QByteArray data = pty()->readAll();
+    // called again from a nested event loop, the outer call carries on
+    if (_processingOutput) {
+        return;
+    }
+    _processingOutput = true;
+
+    // Hand the buffered output over in place, at most OutputBatchSize bytes
+    // per pass of the event loop so that input and painting keep up with a
+    // flooding program.  What is left stays in the pty's read buffer, which
+    // stops polling the pty at its limit and lets the kernel block the writer.
+    int budget = OutputBatchSize;
+    const char *data = nullptr;
+    int length = 0;
+    while (budget > 0 && (length = pty()->bufferedData(&data)) > 0) {
+        length = qMin(length, budget);
+        processOutput(data, length);
+        pty()->skipBufferedData(length);
+        budget -= length;
+    }
 
-    QString recvData = QString(data);
+    _processingOutput = false;
 
+    if (!_outputScheduled && pty()->bytesAvailable() > 0) {
+        _outputScheduled = true;
+        QTimer::singleShot(0, this, [this] {
+            _outputScheduled = false;
+            dataReceived();
+        });
+    }
+}
+
+void Pty::processOutput(const char *buffer, int length)
+{
     if (_bNeedBlockCommand) {
+        QString recvData = QString::fromUtf8(buffer, qstrnlen(buffer, length));
         QString judgeData = recvData;
         if (recvData.length() > 1) {
             judgeData = recvData.replace("\r", "");
@@ -565,7 +639,7 @@ void Pty::dataReceived()
                 }
                 QString helpData = recvData.replace("\n", "");
                 recvData = "\r\n" + helpData + "\r\n";
-                data = recvData.toUtf8();
+                QByteArray data = recvData.toUtf8();
                 emit receivedData(data.constData(), data.count(), _textCodec);
             }
             else {
@@ -576,26 +650,57 @@ void Pty::dataReceived()
     }
 
     /******** Modify by m000714 daizhengwen 2020-04-30: 处理上传下载时乱码显示命令不执行****************/
+    // Scan the raw bytes once for all patterns; the scanner state is kept
+    // between blocks so that the zmodem marker is found even when split.
+    // The garbage checks only look at matches inside this block.
+    bool isGarbage = false;
+    bool hasLineTabSet = false;
+    bool isZModemStart = false;
+    const ByteMatcher &matcher = outputMatcher();
+    matcher.scan(_outputScanState, buffer, length, [&](int pattern, int end) {
+        const int begin = end - matcher.patternLength(pattern);
+        switch (pattern) {
+        case ZModemStart:
+            isZModemStart = true;
+            break;
+        case RzGarbageHeader:
+            isGarbage = isGarbage || (0 == begin);
+            break;
+        case GarbageLineTabSet:
+            hasLineTabSet = hasLineTabSet || (begin >= 0);
+            break;
+        default:
+            isGarbage = isGarbage || (begin >= 0);
+            break;
+        }
+    });
+
     // 乱码提示信息不显示
-    if (recvData.contains("bash: $'\\212")
-            || recvData.contains("bash: **0800000000022d：")
-            || recvData.contains("**^XB0800000000022d")
-            || recvData.startsWith("**\u0018B0800000000022d\r\u008A")) {
+    if (isGarbage) {
         return;
     }
 
     // "\u008A"这个乱码不替换调会导致显示时有\b的效果导致命令错乱bug#23741
-    if (recvData.contains("\u008A")) {
-        recvData.replace("\u008A", "\b \b #");
-        data = recvData.toUtf8();
-    }
+    // 只有需要修改输出时才复制
+    const QByteArray rawData = QByteArray::fromRawData(buffer, length);
+    if (hasLineTabSet || rawData == "rz waiting to receive.") {
+        QByteArray data(buffer, length);
+        if (hasLineTabSet) {
+            data.replace(QByteArray("\xC2\x8A"), QByteArray("\b \b #"));
+        }
 
-    if (recvData == "rz waiting to receive.") {
-        recvData += "\r\n";
-        data = recvData.toUtf8();
+        if (data == "rz waiting to receive.") {
+            data += "\r\n";
+        }
+        emit receivedData(data.constData(), data.count(), _isCommandExec);
+    } else {
+        emit receivedData(buffer, length, _isCommandExec);
     }
     /********************* Modify by m000714 daizhengwen End ************************/
-    emit receivedData(data.constData(), data.count(), _isCommandExec);
+
+    if (isZModemStart) {
+        emit zmodemDetected();
+    }
 }
 
 void Pty::lockPty(bool lock)
@@ -39,6 +39,7 @@
 
 // KDE
 #include "kptyprocess.h"
+#include "GbTranscoder.h"
 
 namespace Konsole {
 
@@ -190,6 +191,12 @@ Q_OBJECT
      */
     void receivedData(const char* buffer, int length, bool isCommandExec);
 
+    /**
+     * Emitted after receivedData() when the received data contains the
+     * start of a zmodem transfer.
+     */
+    void zmodemDetected();
+
     /******** Modify by nt001000 renfeixiang 2020-05-27:修改 增加参数区别remove和purge卸载命令 Begin***************/
     bool ptyUninstallTerminal(QString commandname);
     /******** Modify by nt001000 renfeixiang 2020-05-14:修改 增加参数区别remove和purge卸载命令 End***************/
@@ -203,6 +210,8 @@ Q_OBJECT
 
   private:
     void init();
+    // filters one block of output and emits receivedData()
+    void processOutput(const char *buffer, int length);
     bool isTerminalRemoved();
     bool bWillRemoveTerminal(QString strCommand);
     /******** Add by nt001000 renfeixiang 2020-05-14:增加 Purge卸载命令的判断，显示不同的卸载提示框 Begin***************/
@@ -225,6 +234,14 @@ Q_OBJECT
     int _receiveDataIndex = -1;
     const QTextCodec *_textCodec = nullptr;
     bool _isCommandExec = false;
+    // position of the output pattern scanner, kept across blocks
+    int _outputScanState = 0;
+    // converts input typed in a GB codec to the UTF-8 of the local shell
+    GbTranscoder _inputTranscoder;
+    // dataReceived() is running, or has been scheduled to handle the rest of
+    // the buffered output
+    bool _processingOutput = false;
+    bool _outputScheduled = false;
 
     QString _program;
 };
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <cstring>
 #include <cctype>
+#include <algorithm>
 
 // Qt
 #include <QTextStream>
@@ -46,6 +47,7 @@
 #include "TerminalDisplay.h"
 #include "history/HistoryType.h"
 #include "history/HistoryScrollNone.h"
+#include "history/ReflowedHistory.h"
 #include "EscapeSequenceUrlExtractor.h"
 
 using namespace Konsole;
@@ -54,6 +56,12 @@ using namespace Konsole;
 //FIXME: see if we can get this from terminfo.
 #define BS_CLEARS false
 
+// lines of the history reflowed by each continueReflow()
+#define REFLOW_STEP_LINES 2000
+
+// most lines of a range returned by searchCandidates()
+#define SEARCH_BLOCK_LINES 10000
+
 //Macro to convert x,y position on screen to position within an image.
 //
 //Originally the image was stored as one large contiguous block of
@@ -75,14 +83,20 @@ const Character Screen::DefaultChar = Character(' ',
 
 //#define REVERSE_WRAPPED_LINES  // for wrapped line debug
 
+quint64 Screen::_lastLineGeneration = 0;
+
 Screen::Screen(int l, int c)
     : _lines(l)
     , _columns(c)
     , _screenLines(_lines + 1)
     , _screenLinesSize(_lines)
+    , _screenLinesStart(0)
     , _scrolledLines(0)
     , _droppedLines(0)
+    , _totalDroppedLines(0)
+    , _historyGeneration(++_lastLineGeneration)
     , _history(new HistoryScrollNone())
+    , _reflowedHistory(new ReflowedHistory(_history))
     , _cuX(0)
     , _cuY(0)
     , _currentRendition(0)
@@ -101,8 +115,14 @@ Screen::Screen(int l, int c)
 
 {
     _escapeSequenceUrlExtractor->setScreen(this);
+    _reflowedHistory->setExtendedCharTable(&_extendedChars);
     _lineProperties.resize(_lines + 1);
     std::fill(_lineProperties.begin(), _lineProperties.end(), LINE_DEFAULT);
+    _lineGenerations.resize(_lines + 1);
+    linesChanged();
+    _promptStart.line = -1;
+    _commandStart.line = -1;
+    _commandExecuted = false;
 
     initTabStops();
     clearSelection();
@@ -114,6 +134,7 @@ Screen::Screen(int l, int c)
 
 Screen::~Screen()
 {
+    delete _reflowedHistory;
     delete _history;
     delete _escapeSequenceUrlExtractor;
 }
@@ -235,29 +256,31 @@ void Screen::deleteChars(int n)
         n = 1;
 
     // if cursor is beyond the end of the line there is nothing to do
-    if ( _cuX >= _screenLines[_cuY].count() )
+    if ( _cuX >= screenLine(_cuY).count() )
         return;
 
-    if ( _cuX+n > _screenLines[_cuY].count() )
-        n = _screenLines[_cuY].count() - _cuX;
+    if ( _cuX+n > screenLine(_cuY).count() )
+        n = screenLine(_cuY).count() - _cuX;
 
     Q_ASSERT( n >= 0 );
-    Q_ASSERT( _cuX+n <= _screenLines[_cuY].count() );
+    Q_ASSERT( _cuX+n <= screenLine(_cuY).count() );
 
-    _screenLines[_cuY].remove(_cuX,n);
+    screenLine(_cuY).remove(_cuX,n);
+    lineChanged(_cuY);
 }
 
 void Screen::insertChars(int n)
 {
     if (n == 0) n = 1; // Default
 
-    if ( _screenLines[_cuY].size() < _cuX )
-        _screenLines[_cuY].resize(_cuX);
+    if ( screenLine(_cuY).size() < _cuX )
+        screenLine(_cuY).resize(_cuX);
 
-    _screenLines[_cuY].insert(_cuX,n,' ');
+    screenLine(_cuY).insert(_cuX,n,' ');
 
-    if ( _screenLines[_cuY].count() > _columns )
-        _screenLines[_cuY].resize(_columns);
+    if ( screenLine(_cuY).count() > _columns )
+        screenLine(_cuY).resize(_columns);
+    lineChanged(_cuY);
 }
 
 void Screen::repeatChars(int count)
@@ -352,6 +375,13 @@ void Screen::resizeImage(int new_lines, int new_columns)
         return;
     }
 
+    // the code below inserts and removes lines
+    linearizeLines();
+
+    // the reflow below moves the text of the marked positions
+    _promptStart.line = -1;
+    _commandStart.line = -1;
+
     // Adjust scroll position, and fix glitches
     _oldTotalLines = getLines() + getHistLines();
     _isResize = true;
@@ -360,19 +390,15 @@ void Screen::resizeImage(int new_lines, int new_columns)
     const int oldCursorLine = (cursorLine == _lines - 1 || cursorLine > new_lines - 1) ? new_lines - 1 : cursorLine;
 
     // Check if _history need to change
-    if (_enableReflowLines && new_columns != _columns && _history->getLines() && _history->getMaxLines()) {
+    if (_enableReflowLines && new_columns != _columns && _reflowedHistory->getLines() && _history->getMaxLines()) {
         // Join next line from _screenLine to _history
-        while (_history->isWrappedLine(_history->getLines() - 1)) {
+        while (_reflowedHistory->isWrappedLine(_reflowedHistory->getLines() - 1)) {
             fastAddHistLine();
             cursorLine--;
         }
-        auto removedLines = _history->reflowLines(new_columns);
-
-        // If _history size > max _history size it will drop a line from _history.
-        // We need to verify if we need to remove a URL.
-        if (removedLines) {
-            _escapeSequenceUrlExtractor->historyLinesRemoved(removedLines);
-        }
+        // Only the rows next to the screen are reflowed now, continueReflow()
+        // does the rest of the history in steps.
+        _reflowedHistory->reflow(new_columns, 2 * new_lines);
     }
 
     if (_enableReflowLines && new_columns != _columns) {
@@ -432,15 +458,15 @@ void Screen::resizeImage(int new_lines, int new_columns)
         // Check cursor position and send from _history to _screenLines
         ImageLine histLine;
         histLine.reserve(1024);
-        while (cursorLine < oldCursorLine && _history->getLines()) {
-            int histPos = _history->getLines() - 1;
-            int histLineLen = _history->getLineLen(histPos);
-            LineProperty lineProperty = _history->getLineProperty(histPos);
+        while (cursorLine < oldCursorLine && _reflowedHistory->getLines()) {
+            int histPos = _reflowedHistory->getLines() - 1;
+            int histLineLen = _reflowedHistory->getLineLen(histPos);
+            LineProperty lineProperty = _reflowedHistory->getLineProperty(histPos);
             histLine.resize(histLineLen);
-            _history->getCells(histPos, 0, histLineLen, histLine.data());
+            _reflowedHistory->getCells(histPos, 0, histLineLen, histLine.data());
             _screenLines.insert(0, histLine);
             _lineProperties.insert(0, lineProperty);
-            _history->removeCells();
+            _reflowedHistory->removeLastLine();
             cursorLine++;
         }
     }
@@ -450,6 +476,10 @@ void Screen::resizeImage(int new_lines, int new_columns)
         std::fill(_lineProperties.begin() + _screenLines.size(), _lineProperties.end(), LINE_DEFAULT);
     }
     _screenLines.resize(new_lines + 1);
+    // lines were joined, split and moved to and from the history
+    _lineGenerations.resize(new_lines + 1);
+    linesChanged();
+    _historyGeneration = ++_lastLineGeneration;
 
     _screenLinesSize = new_lines;
     _lines = new_lines;
@@ -534,14 +564,14 @@ void Screen::updateEffectiveRendition()
 
 void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 {
-    Q_ASSERT( startLine >= 0 && count > 0 && startLine + count <= _history->getLines() );
+    Q_ASSERT( startLine >= 0 && count > 0 && startLine + count <= _reflowedHistory->getLines() );
 
     for (int line = startLine; line < startLine + count; line++)
     {
-        const int length = qMin(_columns, _history->getLineLen(line));
+        const int length = qMin(_columns, _reflowedHistory->getLineLen(line));
         const int destLineOffset  = (line-startLine) * _columns;
 
-        _history->getCells(line,0,length,dest + destLineOffset);
+        _reflowedHistory->getCells(line,0,length,dest + destLineOffset);
 
         for (int column = length; column < _columns; column++)
             dest[destLineOffset+column] = DefaultChar;
@@ -574,10 +604,10 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
             int srcIndex = srcLineStartIndex + column;
             int destIndex = destLineStartIndex + column;
 
-            dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, DefaultChar);
+            dest[destIndex] = screenLine(srcIndex / _columns).value(srcIndex % _columns, DefaultChar);
 
             // invert selected text
-            if (_selBegin != -1 && isSelected(column,line + _history->getLines()))
+            if (_selBegin != -1 && isSelected(column,line + _reflowedHistory->getLines()))
                 reverseRendition(dest[destIndex]);
         }
 
@@ -587,14 +617,14 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
 void Screen::getImage( Character* dest, int size, int startLine, int endLine ) const
 {
     Q_ASSERT( startLine >= 0 );
-    Q_ASSERT( endLine >= startLine && endLine < _history->getLines() + _lines );
+    Q_ASSERT( endLine >= startLine && endLine < _reflowedHistory->getLines() + _lines );
 
     const int mergedLines = endLine - startLine + 1;
 
     Q_ASSERT( size >= mergedLines * _columns );
     Q_UNUSED( size );
 
-    const int linesInHistoryBuffer = qBound(0, _history->getLines()-startLine,mergedLines);
+    const int linesInHistoryBuffer = qBound(0, _reflowedHistory->getLines()-startLine,mergedLines);
     const int linesInScreenBuffer = mergedLines - linesInHistoryBuffer;
 
     // copy _lines from _history buffer
@@ -604,7 +634,7 @@ void Screen::getImage( Character* dest, int size, int startLine, int endLine ) c
     // copy _lines from screen buffer
     if (linesInScreenBuffer > 0)
         copyFromScreen(dest + linesInHistoryBuffer * _columns,
-                startLine + linesInHistoryBuffer - _history->getLines(),
+                startLine + linesInHistoryBuffer - _reflowedHistory->getLines(),
                 linesInScreenBuffer);
 
     // invert display when in screen mode
@@ -623,10 +653,10 @@ void Screen::getImage( Character* dest, int size, int startLine, int endLine ) c
 QVector<LineProperty> Screen::getLineProperties( int startLine , int endLine ) const
 {
     Q_ASSERT( startLine >= 0 );
-    Q_ASSERT( endLine >= startLine && endLine < _history->getLines() + _lines );
+    Q_ASSERT( endLine >= startLine && endLine < _reflowedHistory->getLines() + _lines );
 
     const int mergedLines = endLine-startLine+1;
-    const int linesInHistory = qBound(0, _history->getLines()-startLine,mergedLines);
+    const int linesInHistory = qBound(0, _reflowedHistory->getLines()-startLine,mergedLines);
     const int linesInScreen = mergedLines - linesInHistory;
 
     QVector<LineProperty> result(mergedLines);
@@ -635,24 +665,66 @@ QVector<LineProperty> Screen::getLineProperties( int startLine , int endLine ) c
     // copy properties for _lines in _history
     for (int line = startLine; line < startLine + linesInHistory; line++)
     {
-        result[index] = _history->getLineProperty(line);
+        result[index] = _reflowedHistory->getLineProperty(line);
         index++;
     }
 
     // copy properties for lines in screen buffer
-    const int firstScreenLine = startLine + linesInHistory - _history->getLines();
+    const int firstScreenLine = startLine + linesInHistory - _reflowedHistory->getLines();
+    for (int line = firstScreenLine; line < firstScreenLine+linesInScreen; line++)
+    {
+        result[index] = lineProperty(line);
+        index++;
+    }
+
+    return result;
+}
+
+QVector<quint64> Screen::getLineGenerations( int startLine , int endLine ) const
+{
+    Q_ASSERT( startLine >= 0 );
+    Q_ASSERT( endLine >= startLine && endLine < _reflowedHistory->getLines() + _lines );
+
+    const int mergedLines = endLine-startLine+1;
+    const int linesInHistory = qBound(0, _reflowedHistory->getLines()-startLine,mergedLines);
+    const int linesInScreen = mergedLines - linesInHistory;
+
+    QVector<quint64> result(mergedLines);
+    int index = 0;
+
+    // The rows of the history do not change until it is reflowed or
+    // replaced.  Their generations are a hash of the one of the history and
+    // the number of the row, with the top bit set, which the generations of
+    // screen lines do not reach.
+    for (int line = startLine; line < startLine + linesInHistory; line++)
+    {
+        quint64 hash = (_historyGeneration * 0x9E3779B97F4A7C15ULL) ^ static_cast<quint64>(_totalDroppedLines + line);
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+        result[index] = (hash ^ (hash >> 31)) | (Q_UINT64_C(1) << 63);
+        index++;
+    }
+
+    const int firstScreenLine = startLine + linesInHistory - _reflowedHistory->getLines();
     for (int line = firstScreenLine; line < firstScreenLine+linesInScreen; line++)
     {
-        result[index] = _lineProperties[line];
+        result[index] = _lineGenerations[screenLineIndex(line)];
         index++;
     }
 
     return result;
 }
 
+void Screen::linesChanged()
+{
+    for (quint64 &generation : _lineGenerations) {
+        generation = ++_lastLineGeneration;
+    }
+}
+
 int Screen::getScreenLineColumns(const int line) const
 {
-    const int doubleWidthLine = _lineProperties[line] & LINE_DOUBLEWIDTH;
+    const int doubleWidthLine = lineProperty(line) & LINE_DOUBLEWIDTH;
 
     if (doubleWidthLine) {
         return _columns / 2;
@@ -691,11 +763,12 @@ void Screen::backspace()
     _cuX = qMin(_columns - 1, _cuX); // nowrap!
     _cuX = qMax(0, _cuX - 1);
 
-    if (_screenLines[_cuY].size() < _cuX + 1)
-        _screenLines[_cuY].resize(_cuX + 1);
+    if (screenLine(_cuY).size() < _cuX + 1)
+        screenLine(_cuY).resize(_cuX + 1);
 
     if (BS_CLEARS)
-        _screenLines[_cuY][_cuX].character = ' ';
+        screenLine(_cuY)[_cuX].character = ' ';
+    lineChanged(_cuY);
 }
 
 void Screen::tab(int n)
@@ -755,7 +828,7 @@ void Screen::checkSelection(int from, int to)
 {
     if (_selBegin == -1)
         return;
-    int scr_TL = loc(0, _history->getLines());
+    int scr_TL = loc(0, _reflowedHistory->getLines());
     //Clear entire selection if it overlaps region [from, to]
     if ( (_selBottomRight >= (from+scr_TL)) && (_selTopLeft <= (to+scr_TL)) )
         clearSelection();
@@ -769,12 +842,16 @@ void Screen::displayCharacter(uint c)
     // putting the cursor one right to the last column of the screen.
 
     int w = Character::width(c);
+    if (w == 0) {
+        combineCharacter(c);
+    }
     if (w <= 0)
         return;
 
     if (_cuX + w > _columns) {
         if (getMode(MODE_Wrap)) {
-            _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | LINE_WRAPPED);
+            lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | LINE_WRAPPED);
+            lineChanged(_cuY);
             nextLine();
         }
         else
@@ -782,10 +859,10 @@ void Screen::displayCharacter(uint c)
     }
 
     // ensure current line vector has enough elements
-    int size = _screenLines[_cuY].size();
+    int size = screenLine(_cuY).size();
     if (size < _cuX+w)
     {
-        _screenLines[_cuY].resize(_cuX+w);
+        screenLine(_cuY).resize(_cuX+w);
     }
 
     if (getMode(MODE_Insert)) insertChars(w);
@@ -795,7 +872,7 @@ void Screen::displayCharacter(uint c)
     // check if selection is still valid.
     checkSelection(_lastPos, _lastPos);
 
-    Character& currentChar = _screenLines[_cuY][_cuX];
+    Character& currentChar = screenLine(_cuY)[_cuX];
 
     currentChar.character = c;
     currentChar.foregroundColor = _effectiveForeground;
@@ -810,10 +887,10 @@ void Screen::displayCharacter(uint c)
     {
         i++;
 
-        if ( _screenLines[_cuY].size() < _cuX + i + 1 )
-            _screenLines[_cuY].resize(_cuX+i+1);
+        if ( screenLine(_cuY).size() < _cuX + i + 1 )
+            screenLine(_cuY).resize(_cuX+i+1);
 
-        Character& ch = _screenLines[_cuY][_cuX + i];
+        Character& ch = screenLine(_cuY)[_cuX + i];
         ch.character = 0;
         ch.foregroundColor = _effectiveForeground;
         ch.backgroundColor = _effectiveBackground;
@@ -821,10 +898,176 @@ void Screen::displayCharacter(uint c)
 
         w--;
     }
+    lineChanged(_cuY);
     _cuX = newCursorX;
     _escapeSequenceUrlExtractor->appendUrlText(QChar(c));
 }
 
+void Screen::combineCharacter(uint c)
+{
+    // only marks and the joiners of emoji sequences belong to a character
+    const QChar::Category category = QChar::category(c);
+    if (category != QChar::Mark_NonSpacing && category != QChar::Mark_SpacingCombining
+            && category != QChar::Mark_Enclosing && c != 0x200D && (c < 0xFE00 || c > 0xFE0F)) {
+        return;
+    }
+
+    // the character before the cursor, which is at the end of the line
+    // before it if that was wrapped
+    int x = _cuX - 1;
+    int y = _cuY;
+    if (x < 0) {
+        if (y == 0 || (lineProperty(y - 1) & LINE_WRAPPED) == 0) {
+            return;
+        }
+        y--;
+        x = screenLine(y).size() - 1;
+    }
+    ImageLine &line = screenLine(y);
+    if (x < 0 || x >= line.size()) {
+        return;
+    }
+    // a wide character is followed by a placeholder
+    if (x > 0 && line[x].character == 0 && (line[x].rendition & RE_EXTENDED_CHAR) == 0) {
+        x--;
+    }
+    Character &currentChar = line[x];
+    if (currentChar.character == 0) {
+        return;
+    }
+
+    ushort length = 1;
+    const uint *sequence = &currentChar.character;
+    if (currentChar.rendition & RE_EXTENDED_CHAR) {
+        sequence = _extendedChars.lookupExtendedChar(currentChar.character, length);
+        // a long sequence is garbage, such as the output of cat /dev/urandom
+        if (sequence == nullptr || length >= 8) {
+            return;
+        }
+    }
+    uint chars[8];
+    std::copy(sequence, sequence + length, chars);
+    chars[length] = c;
+
+    currentChar.character = _extendedChars.createExtendedChar(chars, length + 1);
+    currentChar.rendition |= RE_EXTENDED_CHAR;
+    lineChanged(y);
+    if (_extendedChars.needsCollect()) {
+        collectExtendedChars();
+    }
+}
+
+void Screen::collectExtendedChars()
+{
+    // the history holds references to its sequences, only those on the
+    // screen are looked for
+    QVector<bool> used(static_cast<int>(_extendedChars.maxId()) + 1, false);
+    for (int i = 0; i < _lines; ++i) {
+        const ImageLine &il = screenLine(i);
+        for (int j = 0; j < il.length(); ++j) {
+            if (il[j].rendition & RE_EXTENDED_CHAR) {
+                const uint id = il[j].character;
+                if (id < static_cast<uint>(used.size())) {
+                    used[static_cast<int>(id)] = true;
+                }
+            }
+        }
+    }
+    _extendedChars.collect(used);
+}
+
+void Screen::displayCharacters(const uint *chars, int count)
+{
+    // Insert mode shifts the rest of the line for every character and OSC 8
+    // link text is recorded character by character, so both stay on the slow path.
+    if (getMode(MODE_Insert) || _escapeSequenceUrlExtractor->reading()) {
+        for (int i = 0; i < count; i++) {
+            displayCharacter(chars[i]);
+        }
+        return;
+    }
+
+    int i = 0;
+    while (i < count) {
+        int w = Character::width(chars[i]);
+        if (w <= 0) {
+            if (w == 0) {
+                combineCharacter(chars[i]);
+            }
+            i++;
+            continue;
+        }
+
+        // same wrapping rule as displayCharacter(), applied once per run
+        if (_cuX + w > _columns) {
+            if (getMode(MODE_Wrap)) {
+                lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | LINE_WRAPPED);
+                lineChanged(_cuY);
+                nextLine();
+            } else {
+                _cuX = _columns - w;
+            }
+        }
+
+        // collect the characters which still fit on the current line
+        int end = i + 1;
+        int endX = _cuX + w;
+        while (end < count) {
+            const int cw = Character::width(chars[end]);
+            if (cw == 0) {
+                // combined with the character before it once that is shown
+                break;
+            }
+            if (cw > 0) {
+                if (endX + cw > _columns) {
+                    break;
+                }
+                endX += cw;
+            }
+            end++;
+        }
+
+        ImageLine &line = screenLine(_cuY);
+        if (line.size() < endX) {
+            line.resize(endX);
+        }
+
+        checkSelection(loc(_cuX, _cuY), loc(endX - 1, _cuY));
+
+        Character *data = line.data();
+        int x = _cuX;
+        for (int j = i; j < end; j++) {
+            const uint c = chars[j];
+            int cw = (j == i) ? w : Character::width(c);
+            if (cw <= 0) {
+                continue;
+            }
+
+            Character &currentChar = data[x];
+            currentChar.character = c;
+            currentChar.foregroundColor = _effectiveForeground;
+            currentChar.backgroundColor = _effectiveBackground;
+            currentChar.rendition = _effectiveRendition;
+            _lastPos = loc(x, _cuY);
+            _lastDrawnChar = c;
+
+            // wide characters are followed by placeholder cells
+            for (int k = 1; k < cw; k++) {
+                Character &ch = data[x + k];
+                ch.character = 0;
+                ch.foregroundColor = _effectiveForeground;
+                ch.backgroundColor = _effectiveBackground;
+                ch.rendition = _effectiveRendition;
+            }
+            x += cw;
+        }
+        lineChanged(_cuY);
+
+        _cuX = x;
+        i = end;
+    }
+}
+
 void Screen::compose(const QString& /*compose*/)
 {
     Q_ASSERT( 0 /*Not implemented yet*/ );
@@ -850,6 +1093,75 @@ void Screen::resetDroppedLines()
 {
     _droppedLines = 0;
 }
+qint64 Screen::totalDroppedLines() const
+{
+    return _totalDroppedLines;
+}
+
+void Screen::markShellPosition(ShellMark mark)
+{
+    const ShellPosition position = {_totalDroppedLines + getHistLines() + _cuY, _cuX};
+    switch (mark) {
+    case PromptStart:
+        _promptStart = position;
+        _commandStart.line = -1;
+        _commandExecuted = false;
+        break;
+    case CommandStart:
+        _commandStart = position;
+        _commandExecuted = false;
+        break;
+    case CommandExecuted:
+        _commandExecuted = true;
+        break;
+    case CommandFinished:
+        break;
+    }
+}
+
+bool Screen::hasShellIntegration() const
+{
+    // a prompt which was dropped from the history is not known any more
+    return shellPositionIndex(_promptStart) >= 0;
+}
+
+int Screen::shellPositionIndex(const ShellPosition &position) const
+{
+    const qint64 line = position.line - _totalDroppedLines;
+    if (position.line < 0 || line < 0 || line >= getHistLines() + _lines) {
+        return -1;
+    }
+    return static_cast<int>(line) * _columns + position.column;
+}
+
+QString Screen::shellPrompt() const
+{
+    const int startIndex = shellPositionIndex(_promptStart);
+    const int endIndex = shellPositionIndex(_commandStart);
+    if (startIndex < 0 || endIndex <= startIndex) {
+        return QString();
+    }
+    return text(startIndex, endIndex - 1, PlainText);
+}
+
+QString Screen::shellCommand() const
+{
+    const int startIndex = shellPositionIndex(_commandStart);
+    if (startIndex < 0 || _commandExecuted) {
+        return QString();
+    }
+
+    // the command line ends with the lines joined to the one of the cursor
+    int endLine = _cuY;
+    while (endLine < _lines - 1 && (lineProperty(endLine) & LINE_WRAPPED)) {
+        endLine++;
+    }
+    const int endIndex = loc(_columns - 1, getHistLines() + endLine);
+    if (endIndex < startIndex) {
+        return QString();
+    }
+    return text(startIndex, endIndex, PlainText);
+}
 void Screen::resetScrolledLines()
 {
     _scrolledLines = 0;
@@ -884,7 +1196,9 @@ void Screen::scrollUp(int from, int n)
     _lastScrolledRegion = QRect(0, _topMargin, _columns - 1,(_bottomMargin - _topMargin));
 
     //FIXME: make sure `topMargin', `bottomMargin', `from', `n' is in bounds.
-    moveImage(loc(0, from), loc(0,from + n), loc(_columns, _bottomMargin));
+    if (from + n <= _bottomMargin) {
+        moveImage(loc(0, from), loc(0, from + n), loc(_columns - 1, _bottomMargin));
+    }
     clearImage(loc(0, _bottomMargin - n + 1), loc(_columns - 1, _bottomMargin), ' ');
 }
 
@@ -956,7 +1270,7 @@ int Screen::getCursorY() const
 
 void Screen::clearImage(int loca, int loce, char c, bool resetLineRendition)
 {
-    int scr_TL=loc(0, _history->getLines());
+    int scr_TL=loc(0, _reflowedHistory->getLines());
     //FIXME: check positions
 
     //Clear entire selection if it overlaps region to be moved...
@@ -976,12 +1290,12 @@ void Screen::clearImage(int loca, int loce, char c, bool resetLineRendition)
 
     for (int y=topLine;y<=bottomLine;y++)
     {
-        _lineProperties[y] = 0;
+        lineProperty(y) = 0;
 
         int endCol = ( y == bottomLine) ? loce % _columns : _columns - 1;
         int startCol = ( y == topLine ) ? loca % _columns : 0;
 
-        QVector<Character>& line = _screenLines[y];
+        QVector<Character>& line = screenLine(y);
 
         if ( isDefaultCh && endCol == _columns - 1 )
         {
@@ -998,8 +1312,9 @@ void Screen::clearImage(int loca, int loce, char c, bool resetLineRendition)
         }
 
         if (resetLineRendition && startCol == 0 && endCol == _columns - 1) {
-                _lineProperties[y] &= ~(LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT_TOP | LINE_DOUBLEHEIGHT_BOTTOM);
+                lineProperty(y) &= ~(LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT_TOP | LINE_DOUBLEHEIGHT_BOTTOM);
         }
+        lineChanged(y);
     }
 }
 
@@ -1009,26 +1324,18 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
     int lines = (sourceEnd - sourceBegin) / _columns;
 
-    //move screen image and line properties:
-    //the source and destination areas of the image may overlap,
-    //so it matters that we do the copy in the right order -
-    //forwards if dest < sourceBegin or backwards otherwise.
-    //(search the web for 'memmove implementation' for details)
-    if (dest < sourceBegin)
+    //move screen image and line properties by rotating the lines between
+    //the source and the destination, the overwritten lines end up in the
+    //area left behind, which the caller clears.
+    const int destLine = dest / _columns;
+    const int sourceLine = sourceBegin / _columns;
+    if (destLine < sourceLine)
     {
-        for (int i=0;i<=lines;i++)
-        {
-            _screenLines[(dest / _columns)+i ] = _screenLines[ (sourceBegin / _columns)+i ];
-            _lineProperties[(dest / _columns)+i] =_lineProperties[(sourceBegin / _columns)+i];
-        }
+        rotateLines(destLine, sourceLine + lines, sourceLine - destLine);
     }
-    else
+    else if (destLine > sourceLine)
     {
-        for (int i=lines;i>=0;i--)
-        {
-            _screenLines[(dest / _columns)+i ] = _screenLines[ (sourceBegin / _columns)+i ];
-            _lineProperties[(dest / _columns)+i] =_lineProperties[(sourceBegin / _columns)+i];
-        }
+        rotateLines(sourceLine, destLine + lines, sourceLine - destLine);
     }
 
     if (_lastPos != -1)
@@ -1044,7 +1351,7 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
     {
         bool beginIsTL = (_selBegin == _selTopLeft);
         int diff = dest - sourceBegin; // Scroll by this amount
-        int scr_TL=loc(0, _history->getLines());
+        int scr_TL=loc(0, _reflowedHistory->getLines());
         int srca = sourceBegin+scr_TL; // Translate index from screen to global
         int srce = sourceEnd+scr_TL; // Translate index from screen to global
         int desta = srca+diff;
@@ -1077,6 +1384,58 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
     }
 }
 
+void Screen::rotateLines(int top, int bottom, int n)
+{
+    Q_ASSERT(top >= 0 && bottom < _lines && qAbs(n) < bottom - top + 1);
+
+    auto swapLines = [this](int first, int second) {
+        std::swap(screenLine(first), screenLine(second));
+        std::swap(lineProperty(first), lineProperty(second));
+        std::swap(_lineGenerations[screenLineIndex(first)], _lineGenerations[screenLineIndex(second)]);
+    };
+
+    const int size = _screenLines.size();
+    if (top == 0 && bottom == size - 2) {
+        // the whole screen: move the start of the ring, then move the extra
+        // line at the end of the ring, which came round into the screen,
+        // back past the 'n' lines which wrapped around
+        _screenLinesStart = screenLineIndex(n > 0 ? n : size + n);
+        if (n > 0) {
+            for (int line = bottom + 1 - n; line <= bottom; line++) {
+                swapLines(line, line + 1);
+            }
+        } else {
+            for (int line = -n - 1; line > 0; line--) {
+                swapLines(line, line - 1);
+            }
+            swapLines(0, bottom + 1);
+        }
+        return;
+    }
+
+    // rotate by three reversals, swapping lines does not copy them
+    auto reverse = [&swapLines](int first, int last) {
+        for (; first < last; first++, last--) {
+            swapLines(first, last);
+        }
+    };
+    const int split = n > 0 ? top + n : bottom + 1 + n;
+    reverse(top, split - 1);
+    reverse(split, bottom);
+    reverse(top, bottom);
+}
+
+void Screen::linearizeLines()
+{
+    if (_screenLinesStart == 0) {
+        return;
+    }
+    std::rotate(_screenLines.begin(), _screenLines.begin() + _screenLinesStart, _screenLines.end());
+    std::rotate(_lineProperties.begin(), _lineProperties.begin() + _screenLinesStart, _lineProperties.end());
+    std::rotate(_lineGenerations.begin(), _lineGenerations.begin() + _screenLinesStart, _lineGenerations.end());
+    _screenLinesStart = 0;
+}
+
 void Screen::clearToEndOfScreen()
 {
     clearImage(loc(_cuX,_cuY), loc(_columns - 1, _lines - 1), ' ');
@@ -1317,6 +1676,8 @@ void Screen::writeToStream(TerminalCharacterDecoder* decoder,
 
     Q_ASSERT( top >= 0 && left >= 0 && bottom >= 0 && right >= 0 );
 
+    decoder->setExtendedCharTable(&_extendedChars);
+
     for (int y=top;y<=bottom;y++)
     {
         int start = 0;
@@ -1350,10 +1711,10 @@ void Screen::writeToStream(TerminalCharacterDecoder* decoder,
 int Screen::getLineLength(const int line) const
 {
     // determine if the line is in the history buffer or the screen image
-    const bool isInHistoryBuffer = line < _history->getLines();
+    const bool isInHistoryBuffer = line < _reflowedHistory->getLines();
 
     if (isInHistoryBuffer) {
-        return _history->getLineLen(line);
+        return _reflowedHistory->getLineLen(line);
     }
 
     return _columns;
@@ -1389,7 +1750,7 @@ int Screen::copyLineToStream(int line ,
     LineProperty currentLineProperties = 0;
 
     // determine if the line is in the history buffer or the screen image
-    if (line < _history->getLines()) {
+    if (line < _reflowedHistory->getLines()) {
         // ensure that start position is before end of line
         start = qBound(0, start, lineLength - 1);
 
@@ -1405,11 +1766,11 @@ int Screen::copyLineToStream(int line ,
         // safety checks
         Q_ASSERT(start >= 0);
         Q_ASSERT(count >= 0);
-        Q_ASSERT((start + count) <= _history->getLineLen(line));
+        Q_ASSERT((start + count) <= _reflowedHistory->getLineLen(line));
 
-        _history->getCells(line, start, count, characterBuffer);
+        _reflowedHistory->getCells(line, start, count, characterBuffer);
 
-        if (_history->isWrappedLine(line)) {
+        if (_reflowedHistory->isWrappedLine(line)) {
             currentLineProperties |= LINE_WRAPPED;
         }
     } else {
@@ -1419,17 +1780,17 @@ int Screen::copyLineToStream(int line ,
 
         Q_ASSERT(count >= 0);
 
-        int screenLine = line - _history->getLines();
+        int lineOnScreen = line - _reflowedHistory->getLines();
 
-        Q_ASSERT(screenLine <= _screenLinesSize);
+        Q_ASSERT(lineOnScreen <= _screenLinesSize);
 
-        screenLine = qMin(screenLine, _screenLinesSize);
+        lineOnScreen = qMin(lineOnScreen, _screenLinesSize);
 
-        auto* data = _screenLines[screenLine].data();
-        int length = _screenLines[screenLine].count();
+        auto* data = screenLine(lineOnScreen).data();
+        int length = screenLine(lineOnScreen).count();
 
         // Don't remove end spaces in lines that wrap
-        if (options.testFlag(TrimTrailingWhitespace) && ((_lineProperties[screenLine] & LINE_WRAPPED) == 0))
+        if (options.testFlag(TrimTrailingWhitespace) && ((lineProperty(lineOnScreen) & LINE_WRAPPED) == 0))
         {
             // ignore trailing white space at the end of the line
             while (length > 0 && QChar(data[length - 1].character).isSpace()) {
@@ -1446,8 +1807,8 @@ int Screen::copyLineToStream(int line ,
         // count cannot be any greater than length
         count = qBound(0, count, length - start);
 
-        Q_ASSERT(screenLine < _lineProperties.count());
-        currentLineProperties |= _lineProperties[screenLine];
+        Q_ASSERT(lineOnScreen < _lineProperties.count());
+        currentLineProperties |= lineProperty(lineOnScreen);
     }
 
     if (appendNewLine) {
@@ -1491,16 +1852,64 @@ void Screen::writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine,
     writeToStream(decoder, loc(0,fromLine), loc(_columns-1,toLine), PreserveLineBreaks);
 }
 
+QVector<QPair<int, int>> Screen::searchCandidates(const QString& text)
+{
+    const int histLines = _reflowedHistory->getLines();
+    const int lineCount = histLines + _lines;
+    auto isWrapped = [this, histLines](int line) {
+        return line < histLines ? _reflowedHistory->isWrappedLine(line)
+                                : (lineProperty(line - histLines) & LINE_WRAPPED) != 0;
+    };
+
+    // the screen is not indexed, neither is the end of a line which
+    // continues from the history on the screen
+    QVector<QPair<int, int>> candidates = histLines > 0 ? _reflowedHistory->candidateRows(text)
+                                                        : QVector<QPair<int, int>>();
+    candidates.append(qMakePair(qMax(0, histLines - 1), lineCount));
+
+    QVector<QPair<int, int>> ranges;
+    for (QPair<int, int> range : qAsConst(candidates)) {
+        while (range.first > 0 && isWrapped(range.first - 1)) {
+            range.first--;
+        }
+        while (range.second < lineCount && isWrapped(range.second - 1)) {
+            range.second++;
+        }
+        if (!ranges.isEmpty() && ranges.last().second >= range.first) {
+            ranges.last().second = qMax(ranges.last().second, range.second);
+        } else {
+            ranges.append(range);
+        }
+    }
+
+    // long ranges are split at the end of a line, so each can be read at once
+    QVector<QPair<int, int>> blocks;
+    for (const QPair<int, int> &range : qAsConst(ranges)) {
+        int first = range.first;
+        while (range.second - first > SEARCH_BLOCK_LINES) {
+            int end = first + SEARCH_BLOCK_LINES;
+            while (end < range.second && isWrapped(end - 1)) {
+                end++;
+            }
+            if (end == range.second) {
+                break;
+            }
+            blocks.append(qMakePair(first, end));
+            first = end;
+        }
+        blocks.append(qMakePair(first, range.second));
+    }
+    return blocks;
+}
+
 void Screen::fastAddHistLine()
 {
-    const bool removeLine = _history->getLines() == _history->getMaxLines();
-    _history->addCellsVector(_screenLines[0]);
-    _history->addLine(_lineProperties[0]);
+    const int removedLines = _reflowedHistory->addLine(_screenLines[0], _lineProperties[0]);
 
     // If history size > max history size it will drop a line from history.
     // We need to verify if we need to remove a URL.
-    if (removeLine) {
-        _escapeSequenceUrlExtractor->historyLinesRemoved(1);
+    if (removedLines) {
+        _escapeSequenceUrlExtractor->historyLinesRemoved(removedLines);
     }
 
     _screenLines.pop_front();
@@ -1514,27 +1923,30 @@ void Screen::addHistLine()
 
     if (hasScroll())
     {
-        int oldHistLines = _history->getLines();
-
-        _history->addCellsVector(_screenLines[0]);
-        _history->addLine(static_cast<bool>(_lineProperties[0] & LINE_WRAPPED ));
+        // a reflowed history may drop more than one row with its first line
+        const quint64 revision = _reflowedHistory->revision();
+        const int removedLines = _reflowedHistory->addLine(screenLine(0), static_cast<bool>(lineProperty(0) & LINE_WRAPPED ));
+        // and show other cells in the rows of the group of that line
+        if (_reflowedHistory->revision() != revision) {
+            _historyGeneration = ++_lastLineGeneration;
+        }
 
-        int newHistLines = _history->getLines();
+        int newHistLines = _reflowedHistory->getLines();
 
         bool beginIsTL = (_selBegin == _selTopLeft);
 
         // If the history is full, increment the count
         // of dropped _lines
-        if ( newHistLines == oldHistLines )
-            _droppedLines++;
+        _droppedLines += removedLines;
+        _totalDroppedLines += removedLines;
 
         // Adjust selection for the new point of reference
-        if (newHistLines > oldHistLines)
+        if (removedLines != 1)
         {
             if (_selBegin != -1)
             {
-                _selTopLeft += _columns;
-                _selBottomRight += _columns;
+                _selTopLeft += (1 - removedLines) * _columns;
+                _selBottomRight += (1 - removedLines) * _columns;
             }
         }
 
@@ -1568,21 +1980,70 @@ void Screen::addHistLine()
 
 int Screen::getHistLines() const
 {
-    return _history->getLines();
+    return _reflowedHistory->getLines();
+}
+
+qint64 Screen::historyMemoryUsage() const
+{
+    return _history->memoryUsage() + _reflowedHistory->indexMemoryUsage();
 }
 
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
     clearSelection();
 
+    const int oldRows = _reflowedHistory->getLines();
     if ( copyPreviousScroll )
         _history = t.scroll(_history);
     else
     {
         HistoryScroll* oldScroll = _history;
+        _totalDroppedLines += _reflowedHistory->getLines();
         _history = t.scroll(nullptr);
         delete oldScroll;
     }
+
+    // the lines copied from the old history may be wrapped at another width
+    _reflowedHistory->setHistory(_history);
+    _historyGeneration = ++_lastLineGeneration;
+    if (_enableReflowLines) {
+        _reflowedHistory->reflow(_columns, 2 * _lines);
+    }
+    if (copyPreviousScroll) {
+        // the copy may keep fewer lines or wrap them in fewer rows, the rows
+        // at the end of the history keep their numbers like in continueReflow()
+        _totalDroppedLines += oldRows - _reflowedHistory->getLines();
+    }
+}
+
+bool Screen::continueReflow()
+{
+    if (!_reflowedHistory->isReflowing()) {
+        return false;
+    }
+
+    int firstRow = 0;
+    int oldRows = 0;
+    int newRows = 0;
+    _reflowedHistory->continueReflow(REFLOW_STEP_LINES, firstRow, oldRows, newRows);
+
+    // Rows after the reflowed ones move, keep the view and the selection on
+    // them.  A selection of reflowed rows is not valid anymore.
+    const int movedRows = newRows - oldRows;
+    _droppedLines -= movedRows;
+    _totalDroppedLines -= movedRows;
+    _historyGeneration = ++_lastLineGeneration;
+    if (_selBegin != -1) {
+        if (_selTopLeft >= loc(0, firstRow + oldRows)) {
+            _selBegin += movedRows * _columns;
+            _selTopLeft += movedRows * _columns;
+            _selBottomRight += movedRows * _columns;
+        } else if (_selBottomRight >= loc(0, firstRow)) {
+            clearSelection();
+        }
+    }
+
+    return _reflowedHistory->isReflowing();
 }
 
 bool Screen::hasScroll() const
@@ -1598,9 +2059,10 @@ const HistoryType& Screen::getScroll() const
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if ( enable )
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | property);
+        lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | property);
     else
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] & ~property);
+        lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) & ~property);
+    lineChanged(_cuY);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
@@ -27,6 +27,7 @@
 #include <QRect>
 #include <QTextStream>
 #include <QBitArray>
+#include <QPair>
 #include <QVarLengthArray>
 #include <QSet>
 
@@ -49,6 +50,7 @@ class TerminalCharacterDecoder;
 class TerminalDisplay;
 class HistoryType;
 class HistoryScroll;
+class ReflowedHistory;
 class EscapeSequenceUrlExtractor;
 
 /**
@@ -372,6 +374,15 @@ public:
      */
     void displayCharacter(uint c);
 
+    /**
+     * Displays @p count characters from @p chars starting at the current cursor
+     * position.  This is equivalent to calling displayCharacter() for each of
+     * them, but line wrapping, cell allocation and selection checks are done
+     * once for every run of characters which fits on a line instead of once
+     * per character.
+     */
+    void displayCharacters(const uint *chars, int count);
+
     // Do composition with last shown character FIXME: Not implemented yet for KDE 4
     void compose(const QString& compose);
 
@@ -407,6 +418,14 @@ public:
      */
     QVector<LineProperty> getLineProperties( int startLine , int endLine ) const;
 
+    /**
+     * Returns the generations of the lines in the image, which are never 0.
+     * The generation of a line changes whenever its characters or properties
+     * do, and no other line of any screen has it, so a line with the same
+     * generation as before shows the same text.
+     */
+    QVector<quint64> getLineGenerations( int startLine , int endLine ) const;
+
 
     /** Return the number of lines. */
     int getLines() const
@@ -416,6 +435,8 @@ public:
     { return _columns; }
     /** Return the number of lines in the history buffer. */
     int getHistLines() const;
+    /** Returns the bytes of memory used by the history. */
+    qint64 historyMemoryUsage() const;
     /**
      * Sets the type of storage used to keep lines in the history.
      * If @p copyPreviousScroll is true then the contents of the previous
@@ -496,6 +517,16 @@ public:
      */
     void writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const;
 
+    /**
+     * Returns the ranges of lines, first line and line after the last one,
+     * which may contain @p text.  Lines of the history are looked up in an
+     * index, the lines of the screen are always returned.  Each range starts
+     * and ends with a whole line of wrapped lines, so the text written by
+     * writeLinesToStream() for a range has no part of a match cut off.  Long
+     * ranges are split into ranges of about 10000 lines.
+     */
+    QVector<QPair<int, int>> searchCandidates(const QString &text);
+
     /**
      * Copies the selected characters, set using @see setSelBeginXY and @see setSelExtentXY
      * into a stream.
@@ -579,6 +610,51 @@ public:
      */
     void resetDroppedLines();
 
+    /**
+     * Returns the number of lines of output which have been dropped from
+     * the history since the screen was created, less the lines which moved
+     * down after a reflow.  A line number taken before is the number of the
+     * same line now, less the increase of this count.
+     */
+    qint64 totalDroppedLines() const;
+
+    /**
+     * The positions which a shell with integration marks with the
+     * semantic prompt sequence, OSC 133.
+     */
+    enum ShellMark {
+        /** The prompt starts, OSC 133 ; A */
+        PromptStart,
+        /** The prompt ends and the command line starts, OSC 133 ; B */
+        CommandStart,
+        /** The command line was entered and its output starts, OSC 133 ; C */
+        CommandExecuted,
+        /** The output of the command ends, OSC 133 ; D */
+        CommandFinished
+    };
+
+    /** Marks the cursor position as @p mark, see ShellMark. */
+    void markShellPosition(ShellMark mark);
+
+    /**
+     * Returns true if the shell marked the start of the last prompt, it was
+     * not moved since by a resize and it is still in the history.
+     */
+    bool hasShellIntegration() const;
+
+    /**
+     * Returns the text of the last prompt marked by the shell, or an empty
+     * string if it was dropped from the history.
+     */
+    QString shellPrompt() const;
+
+    /**
+     * Returns the command line after the last prompt marked by the shell,
+     * which the user is typing, or an empty string once the shell marked it
+     * as executed.
+     */
+    QString shellCommand() const;
+
     /**
       * Fills the buffer @p dest with @p count instances of the default (ie. blank)
       * Character style.
@@ -595,18 +671,13 @@ public:
         return _currentTerminalDisplay;
     }
 
-    QSet<uint> usedExtendedChars() const
+    /**
+     * Returns the table of the sequences of unicode characters of the cells
+     * with the RE_EXTENDED_CHAR rendition, in the screen and its history.
+     */
+    const ExtendedCharTable &extendedCharTable() const
     {
-        QSet<uint> result;
-        for (int i = 0; i < _lines; ++i) {
-            const ImageLine &il = _screenLines[i];
-            for (int j = 0; j < il.length(); ++j) {
-                if (il[j].rendition & RE_EXTENDED_CHAR) {
-                    result << il[j].character;
-                }
-            }
-        }
-        return result;
+        return _extendedChars;
     }
 
     static const Character DefaultChar;
@@ -620,6 +691,12 @@ public:
     // Set reflow condition
     void setReflowLines(bool enable);
 
+    /**
+     * Reflows the next part of the history after a resize, older than the
+     * part reflowed at once.  Returns true if there is more to reflow.
+     */
+    bool continueReflow();
+
     // 设置sessionId
     void setSessionId(int sessionId);
 
@@ -629,6 +706,12 @@ private:
 
     EscapeSequenceUrlExtractor *urlExtractor() const;
 
+    // adds the zero width character 'c' to the character before the cursor
+    void combineCharacter(uint c);
+    // frees the extended characters which are neither on the screen nor in
+    // the history
+    void collectExtendedChars();
+
     //copies a line of text from the screen or history into a stream using a
     //specified character decoder.  Returns the number of lines actually copied,
     //which may be less than 'count' if (start+count) is more than the number of characters on
@@ -656,8 +739,16 @@ private:
     //the parameters are specified as offsets from the start of the screen image.
     //the loc(x,y) macro can be used to generate these values from a column,line pair.
     //
-    //NOTE: moveImage() can only move whole lines
+    //NOTE: moveImage() can only move whole lines, the lines which are
+    //overwritten are moved to the area left behind, which the caller clears
     void moveImage(int dest, int sourceBegin, int sourceEnd);
+    // rotates screen lines 'top' to 'bottom' up by 'n' lines (down if 'n' is
+    // negative), so line 'top + n' becomes line 'top'
+    void rotateLines(int top, int bottom, int n);
+    // makes the ring buffer of screen lines start at index 0 again, for code
+    // which inserts or removes lines (resizing)
+    void linearizeLines();
+
     // scroll up 'i' lines in current region, clearing the bottom 'i' lines
     void scrollUp(int from, int i);
     // scroll down 'i' lines in current region, clearing the top 'i' lines
@@ -665,6 +756,7 @@ private:
 
     void addHistLine();
     // add lines from screen to history and remove from screen the added lines (used to resize lines and columns)
+    // the screen lines must have been linearized with linearizeLines()
     void fastAddHistLine();
 
     void initTabStops();
@@ -705,22 +797,84 @@ private:
     int _columns;
 
     typedef QVector<Character> ImageLine;      // [0..columns]
+    // _screenLines and _lineProperties are ring buffers starting at
+    // _screenLinesStart, so scrolling the whole screen only moves the start
+    // and scrolling a region swaps lines instead of copying them.
+    // Use screenLine() and lineProperty() to access them by screen line.
     QVector<ImageLine> _screenLines;           // [lines]
     int _screenLinesSize;                      // _screenLines.size()
+    int _screenLinesStart;
 
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    qint64 _totalDroppedLines;
+
+    // A position marked by the shell, the line counts the dropped lines
+    // like totalDroppedLines() and is -1 if there is none.  The column may
+    // be _columns after the last character of a full line.
+    struct ShellPosition {
+        qint64 line;
+        int column;
+    };
+    // see markShellPosition()
+    ShellPosition _promptStart;
+    ShellPosition _commandStart;
+    bool _commandExecuted;
+    // returns the index of 'position' for text(), or -1 if it was dropped
+    int shellPositionIndex(const ShellPosition &position) const;
 
     int _oldTotalLines;
     bool _isResize;
     bool _enableReflowLines = true;//自动换行功能，默认为true
 
     QVarLengthArray<LineProperty,64> _lineProperties;
+    // the generations of _screenLines, a ring buffer like it
+    QVector<quint64> _lineGenerations;
+    // the generation of the rows of the history, the one of a row is made
+    // from it and the number of the row counting the dropped lines, so it
+    // changes when the rows are reflowed or replaced
+    quint64 _historyGeneration;
+    // the last generation given to a line, shared by all screens
+    static quint64 _lastLineGeneration;
+
+    // index in _screenLines and _lineProperties of screen line 'line'
+    int screenLineIndex(int line) const
+    {
+        const int index = _screenLinesStart + line;
+        return index < _screenLines.size() ? index : index - _screenLines.size();
+    }
+    ImageLine &screenLine(int line)
+    {
+        return _screenLines[screenLineIndex(line)];
+    }
+    const ImageLine &screenLine(int line) const
+    {
+        return _screenLines[screenLineIndex(line)];
+    }
+    LineProperty &lineProperty(int line)
+    {
+        return _lineProperties[screenLineIndex(line)];
+    }
+    LineProperty lineProperty(int line) const
+    {
+        return _lineProperties[screenLineIndex(line)];
+    }
+    // gives screen line 'line' a new generation after it changed
+    void lineChanged(int line)
+    {
+        _lineGenerations[screenLineIndex(line)] = ++_lastLineGeneration;
+    }
+    // gives all lines of the screen new generations
+    void linesChanged();
 
     // history buffer ---------------
     HistoryScroll* _history;
+    // the rows of _history, reflowed to _columns
+    ReflowedHistory* _reflowedHistory;
+    // sequences of the cells with RE_EXTENDED_CHAR on the screen and in _history
+    ExtendedCharTable _extendedChars;
 
     // cursor location
     int _cuX;
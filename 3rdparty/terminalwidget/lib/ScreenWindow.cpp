@@ -31,6 +31,7 @@ ScreenWindow::ScreenWindow(QObject* parent)
     , _windowBuffer(nullptr)
     , _windowBufferSize(0)
     , _bufferNeedsUpdate(true)
+    , _windowGenerations()
     , _windowLines(1)
     , _currentLine(0)
     , _trackOutput(true)
@@ -70,6 +71,8 @@ Character* ScreenWindow::getImage()
 
     _screen->getImage(_windowBuffer,size,
                       currentLine(),endWindowLine());
+    _windowGenerations = _screen->getLineGenerations(currentLine(),endWindowLine());
+    _windowGenerations.resize(windowLines());
 
     // this window may look beyond the end of the screen, in which
     // case there will be an unused area which needs to be filled
@@ -113,6 +116,13 @@ QVector<LineProperty> ScreenWindow::getLineProperties()
     return result;
 }
 
+QVector<quint64> ScreenWindow::getLineGenerations()
+{
+    // those of the lines in the image, which is only copied once it changed
+    getImage();
+    return _windowGenerations;
+}
+
 QString ScreenWindow::selectedText( const Screen::DecodingOptions options ) const
 {
     return _screen->selectedText( options );
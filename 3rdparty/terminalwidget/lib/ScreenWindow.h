@@ -88,6 +88,13 @@ public:
      */
     QVector<LineProperty> getLineProperties();
 
+    /**
+     * Returns the generations of the lines which are currently visible
+     * through this window, see Screen::getLineGenerations().  Lines past
+     * the end of the screen have the generation 0.
+     */
+    QVector<quint64> getLineGenerations();
+
     /**
      * Returns the number of lines which the region of the window
      * specified by scrollRegion() has been scrolled by since the last call
@@ -256,6 +263,7 @@ private:
     Character* _windowBuffer;
     int _windowBufferSize;
     bool _bufferNeedsUpdate;
+    QVector<quint64> _windowGenerations; // of the lines in _windowBuffer
 
     int  _windowLines;
     int  _currentLine; // see scrollTo() , currentLine()
@@ -33,8 +33,10 @@
 #include <QByteRef>
 #include <QDir>
 #include <QFile>
+#include <QMetaMethod>
 #include <QRegExp>
 #include <QStringList>
+#include <QSysInfo>
 #include <QFile>
 #include <QtDebug>
 
@@ -114,6 +116,7 @@ Session::Session(QObject* parent) :
 
     connect( _shellProcess,SIGNAL(receivedData(const char *,int,bool)),this,
              SLOT(onReceiveBlock(const char *,int,bool)) );
+    connect( _shellProcess,SIGNAL(zmodemDetected()),_emulation,SIGNAL(zmodemDetected()) );
     connect( _emulation,SIGNAL(sendData(const char *,int,const QTextCodec *)),_shellProcess,
              SLOT(sendData(const char *,int,const QTextCodec *)) );
     connect( _emulation,SIGNAL(lockPtyRequest(bool)),_shellProcess,SLOT(lockPty(bool)) );
@@ -226,6 +229,9 @@ void Session::addView(TerminalDisplay * widget)
         widget->setBracketedPasteMode(_emulation->programBracketedPasteMode());
 
         widget->setScreenWindow(_emulation->createWindow());
+
+        // the history of the session shown last is the last to be moved to disk
+        connect( widget , SIGNAL(termGetFocus()) , _emulation , SLOT(touchHistory()) );
     }
 
     //connect view signals and slots
@@ -492,6 +498,27 @@ void Session::setUserTitle( int what, const QString & caption )
         emit openUrlRequest(cwd);
     }
 
+    // the directory reported by a shell with integration, \033]7;file://host/path\007,
+    // which is only used for the local host
+    if (what == 7) {
+        const QUrl url(caption);
+        if (url.isLocalFile()
+                && (url.host().isEmpty() || url.host().compare(QSysInfo::machineHostName(), Qt::CaseInsensitive) == 0)) {
+            _reportedWorkingUrl = url;
+            const QString dir = url.toLocalFile();
+            if (_currentWorkingDir != dir) {
+                _currentWorkingDir = dir;
+                emit currentDirectoryChanged(_currentWorkingDir);
+            }
+            if (_currentDir != dir) {
+                _currentDir = dir;
+                emit titleArgsChange(QLatin1String("%D"), _currentDir);
+            }
+        } else {
+            _reportedWorkingUrl.clear();
+        }
+    }
+
     // change icon via \033]32;Icon\007
     if (what == 32) {
         _isTitleChanged = true;
@@ -696,6 +723,101 @@ void Session::sendKeyEvent(QKeyEvent* e) const
     _emulation->sendKeyEvent(e);
 }
 
+int Session::addOutputTrigger(const QList<QByteArray> &patterns, Qt::CaseSensitivity caseSensitivity,
+                              const OutputTriggerCallback &callback)
+{
+    OutputTrigger trigger;
+    trigger.id = ++_lastOutputTriggerId;
+    trigger.patterns = patterns;
+    trigger.caseSensitivity = caseSensitivity;
+    trigger.callback = callback;
+    trigger.matchEnd = -1;
+    _outputTriggers.append(trigger);
+    _outputTriggersChanged = true;
+    return trigger.id;
+}
+
+int Session::addOutputTrigger(const QByteArray &pattern, Qt::CaseSensitivity caseSensitivity,
+                              const OutputTriggerCallback &callback)
+{
+    return addOutputTrigger(QList<QByteArray>() << pattern, caseSensitivity, callback);
+}
+
+void Session::removeOutputTrigger(int id)
+{
+    for (int i = 0; i < _outputTriggers.count(); i++) {
+        if (_outputTriggers.at(i).id == id) {
+            _outputTriggers.remove(i);
+            _outputTriggersChanged = true;
+            return;
+        }
+    }
+}
+
+void Session::compileOutputTriggers()
+{
+    _outputMatchers[0] = ByteMatcher(Qt::CaseSensitive);
+    _outputMatchers[1] = ByteMatcher(Qt::CaseInsensitive);
+    for (int i = 0; i < 2; i++) {
+        _outputMatcherStates[i] = 0;
+        _outputPatternTriggers[i].clear();
+    }
+
+    for (int index = 0; index < _outputTriggers.count(); index++) {
+        const OutputTrigger &trigger = _outputTriggers.at(index);
+        const int matcher = trigger.caseSensitivity == Qt::CaseSensitive ? 0 : 1;
+        for (const QByteArray &pattern : trigger.patterns) {
+            if (pattern.isEmpty()) {
+                continue;
+            }
+            _outputMatchers[matcher].addPattern(pattern);
+            _outputPatternTriggers[matcher].append(index);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (_outputMatchers[i].patternCount() > 0) {
+            _outputMatchers[i].compile();
+        }
+    }
+    _outputTriggersChanged = false;
+}
+
+void Session::scanOutputTriggers(const char *data, int length)
+{
+    if (_outputTriggersChanged) {
+        compileOutputTriggers();
+    }
+
+    bool matched = false;
+    for (int i = 0; i < 2; i++) {
+        if (_outputMatchers[i].patternCount() == 0) {
+            continue;
+        }
+        const QVector<int> &patternTriggers = _outputPatternTriggers[i];
+        _outputMatchers[i].scan(_outputMatcherStates[i], data, length, [&](int pattern, int end) {
+            _outputTriggers[patternTriggers.at(pattern)].matchEnd = end;
+            matched = true;
+        });
+    }
+
+    if (!matched) {
+        return;
+    }
+
+    // a callback may add or remove triggers, so collect the matches first
+    QVector<QPair<OutputTriggerCallback, int>> matches;
+    for (OutputTrigger &trigger : _outputTriggers) {
+        if (trigger.matchEnd >= 0) {
+            matches.append(qMakePair(trigger.callback, trigger.matchEnd));
+            trigger.matchEnd = -1;
+        }
+    }
+    for (const auto &match : matches) {
+        match.first(data, length, match.second);
+    }
+}
+
 Session::~Session()
 {
     _wantedClose = true;
@@ -1072,7 +1194,13 @@ void Session::zmodemFinished()
 void Session::onReceiveBlock(const char * buf, int len, bool isCommandExec)
 {
     _emulation->receiveData(buf, len, isCommandExec);
-    emit receivedData( QString::fromLatin1( buf, len ) );
+    scanOutputTriggers(buf, len);
+
+    static const QMetaMethod receivedDataSignal = QMetaMethod::fromSignal(&Session::receivedData);
+    if (isSignalConnected(receivedDataSignal)) {
+        emit receivedData( QString::fromLatin1( buf, len ) );
+    }
+    emit outputReceived();
 }
 
 QSize Session::size()
@@ -28,6 +28,9 @@
 #include <QStringList>
 #include <QWidget>
 
+#include <functional>
+
+#include "ByteMatcher.h"
 #include "Emulation.h"
 #include "history/HistoryType.h"
 #include "history/HistoryScrollNone.h"
@@ -323,6 +326,33 @@ public:
 
     void sendKeyEvent(QKeyEvent* e) const;
 
+    /**
+     * Callback of an output trigger.  @p data and @p length are the block of
+     * output in which a pattern of the trigger was found and @p matchEnd is
+     * the offset just past the last match within that block.
+     */
+    typedef std::function<void(const char *data, int length, int matchEnd)> OutputTriggerCallback;
+
+    /**
+     * Registers @p callback to be called when any of @p patterns appears in
+     * the output of the terminal process and returns an id for
+     * removeOutputTrigger().
+     *
+     * The raw output is scanned once per block for all triggers together,
+     * including matches which span two blocks.  The callback is called at
+     * most once per block, after the block has been passed to the emulation.
+     *
+     * @param caseSensitivity With Qt::CaseInsensitive ASCII letters in
+     * @p patterns match either case.
+     */
+    int addOutputTrigger(const QList<QByteArray> &patterns, Qt::CaseSensitivity caseSensitivity,
+                         const OutputTriggerCallback &callback);
+    int addOutputTrigger(const QByteArray &pattern, Qt::CaseSensitivity caseSensitivity,
+                         const OutputTriggerCallback &callback);
+
+    /** Removes the output trigger with the given @p id */
+    void removeOutputTrigger(int id);
+
     /** Returns dynamic process name. */
     QString getDynamicProcessName();
 
@@ -454,9 +484,16 @@ signals:
 
     /**
      * Emitted when output is received from the terminal process.
+     *
+     * Converting every block of output is not free, so this is only done
+     * while something is connected.  Prefer outputReceived() or an output
+     * trigger (see addOutputTrigger()) where the text is not needed.
      */
     void receivedData( const QString & text );
 
+    /** Emitted for every block of output received from the terminal process. */
+    void outputReceived();
+
     /** Emitted when the session's title has changed. */
     void titleChanged();
 
@@ -582,6 +619,9 @@ private:
     void updateTerminalSize(int height, int width);
     WId windowId() const;
 
+    void compileOutputTriggers();
+    void scanOutputTriggers(const char *data, int length);
+
     int            _uniqueIdentifier;
 
     Pty     *_shellProcess;
@@ -651,6 +691,22 @@ private:
 
     QTimer *_updateTimer = nullptr;
     bool _isPrimaryScreen;
+
+    struct OutputTrigger {
+        int id;
+        QList<QByteArray> patterns;
+        Qt::CaseSensitivity caseSensitivity;
+        OutputTriggerCallback callback;
+        int matchEnd; // last match in the current block, -1 if none
+    };
+    QVector<OutputTrigger> _outputTriggers;
+    int _lastOutputTriggerId = 0;
+    bool _outputTriggersChanged = false;
+    // [0] holds the case sensitive and [1] the case insensitive patterns
+    ByteMatcher _outputMatchers[2];
+    int _outputMatcherStates[2] = {0, 0};
+    // maps pattern ids of _outputMatchers to indexes in _outputTriggers
+    QVector<int> _outputPatternTriggers[2];
 };
 
 /**
@@ -29,6 +29,7 @@
 #include <QDebug>
 
 // Konsole
+#include "Emulation.h"
 #include "Session.h"
 
 using namespace Konsole;
@@ -125,6 +126,9 @@ void SessionManager::saveCurrShellPrompt(int sessionId, QString strPrompt)
 
 QString SessionManager::getCurrShellPrompt(int sessionId)
 {
+    if (hasShellIntegration(sessionId)) {
+        return idToSession(sessionId)->emulation()->shellPrompt().trimmed();
+    }
     return _shellPromptSessionMap.value(sessionId);
 }
 
@@ -136,9 +140,29 @@ void SessionManager::saveCurrShellCommand(int sessionId, QString strCommand)
 
 QString SessionManager::getCurrShellCommand(int sessionId)
 {
+    if (hasShellIntegration(sessionId)) {
+        // like the command saved for a root prompt, see TerminalImageFilterChain::setImage()
+        QString strCommand = idToSession(sessionId)->emulation()->shellCommand().trimmed();
+        if (!strCommand.isEmpty() && getCurrShellPrompt(sessionId).endsWith("#")
+                && !strCommand.contains("sudo ")) {
+            strCommand = QString("sudo %1").arg(strCommand);
+        }
+        return strCommand;
+    }
     return _shellCommandSessionMap.value(sessionId);
 }
 
+bool SessionManager::hasShellIntegration(int sessionId)
+{
+    // called for every frame, so without the debug message of idToSession()
+    for (Session *session : qAsConst(_sessions)) {
+        if (session->sessionId() == sessionId) {
+            return session->emulation()->hasShellIntegration();
+        }
+    }
+    return false;
+}
+
 void SessionManager::setTerminalResizing(int sessionId, bool bTerminalResizing)
 {
     _terminalResizeStateMap.insert(sessionId, bTerminalResizing);
@@ -79,6 +79,13 @@ public:
     void saveCurrShellCommand(int sessionId, QString strCommand);
     QString getCurrShellCommand(int sessionId);
 
+    /**
+     * Returns true if the shell of the session marks its prompts with
+     * OSC 133, then the prompt and the command line are read from the
+     * marked positions instead of the ones saved above.
+     */
+    bool hasShellIntegration(int sessionId);
+
     //用于存储终端控件是否正在resize的状态值  true表示正在resize
     void setTerminalResizing(int sessionId, bool bTerminalResizing);
     bool isTerminalResizing(int sessionId);
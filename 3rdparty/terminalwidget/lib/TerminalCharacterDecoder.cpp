@@ -67,6 +67,20 @@ void PlainTextDecoder::setRecordLinePositions(bool record)
 {
     _recordLinePositions = record;
 }
+const uint *TerminalCharacterDecoder::cellCharacters(const Character &cell, ushort &length) const
+{
+    if (cell.rendition & RE_EXTENDED_CHAR) {
+        const uint *characters = _extendedChars ? _extendedChars->lookupExtendedChar(cell.character, length) : nullptr;
+        if (characters)
+            return characters;
+        static const uint replacement = QChar::ReplacementCharacter;
+        length = 1;
+        return &replacement;
+    }
+    length = 1;
+    return &cell.character;
+}
+
 QList<int> PlainTextDecoder::linePositions() const
 {
     return _linePositions;
@@ -107,8 +121,10 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
 
     for (int i=0;i<outputCount;)
     {
-        plainText.push_back( characters[i].character );
-        i += qMax(1,Character::width(characters[i].character));
+        ushort length = 0;
+        const uint *sequence = cellCharacters(characters[i], length);
+        plainText.append(sequence, sequence + length);
+        i += qMax(1,Character::width(sequence[0]));
     }
     *_output << QString::fromStdWString(plainText);
 }
@@ -160,7 +176,9 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 
     for (int i=0;i<count;i++)
     {
-        wchar_t ch(characters[i].character);
+        ushort length = 0;
+        const uint *sequence = cellCharacters(characters[i], length);
+        wchar_t ch(sequence[0]);
 
         //check if appearance of character is different from previous char
         if ( characters[i].rendition != _lastRendition  ||
@@ -222,7 +240,7 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
             else if (ch == '>')
                     text.append(L"&gt;");
             else
-                    text.push_back(ch);
+                    text.append(sequence, sequence + length);
         }
         else
         {
@@ -61,6 +61,18 @@ public:
     virtual void decodeLine(const Character* const characters,
                             int count,
                             LineProperty properties) = 0;
+
+    /**
+     * Sets the table of the extended characters of the lines, a cell with
+     * RE_EXTENDED_CHAR is written as U+FFFD without one.
+     */
+    void setExtendedCharTable(const ExtendedCharTable *table) { _extendedChars = table; }
+
+protected:
+    // returns the characters of 'cell', the sequence of an extended character
+    const uint *cellCharacters(const Character &cell, ushort &length) const;
+
+    const ExtendedCharTable *_extendedChars = nullptr;
 };
 
 /**
@@ -44,7 +44,9 @@
 #include <QUrl>
 #include <QMimeData>
 #include <QDrag>
+#include <QElapsedTimer>
 #include <QScroller>
+#include <QtMath>
 
 // KDE
 //#include <kshell.h>
@@ -61,6 +63,7 @@
 // Konsole
 //#include <config-apps.h>
 #include "Filter.h"
+#include "FrameScheduler.h"
 #include "konsole_wcwidth.h"
 #include "ScreenWindow.h"
 #include "Screen.h"
@@ -148,9 +151,9 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
 
 // TODO: Determine if this is an issue.
 //#warning "The order here is not specified - does it matter whether updateImage or updateLineProperties comes first?"
-        connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateLineProperties()) );
-        connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateImage()) );
-        connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateFilters()) );
+        // the line properties, the image and the filters are updated with
+        // the other displays of the window, see FrameScheduler
+        connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(requestFrame()) );
         connect( _screenWindow , SIGNAL(scrolled(int)) , this , SLOT(updateFilters()) );
         connect( _screenWindow, SIGNAL(selectionCleared()), this, SLOT(selectionCleared()) );
         window->setWindowLines(_lines);
@@ -289,6 +292,9 @@ void TerminalDisplay::fontChange(const QFont&)
 
     _fontAscent = fm.ascent();
 
+    // the shaped text depends on the font family and size
+    _glyphRunCache.clear();
+
     emit changedFontMetricSignal( _fontHeight, _fontWidth );
     propagateSize();
 
@@ -455,6 +461,7 @@ TerminalDisplay::TerminalDisplay(QWidget *parent)
 ,_wordCharacters(QLatin1String(":@-./_~"))
 ,_bellMode(SystemBeepBell)
 ,_blinking(false)
+,_frameRequested(false)
 ,_hasBlinker(false)
 ,_cursorBlinking(false)
 ,_hasBlinkingCursor(false)
@@ -841,7 +848,20 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
          {
             QRectF drawRect(rect.topLeft(), rect.size());
             drawRect.setHeight(rect.height() + _drawTextAdditionHeight);
-            painter.drawText(drawRect, Qt::AlignBottom, LTR_OVERRIDE_CHAR + text);
+
+            // same placement as drawText(drawRect, Qt::AlignBottom, LTR_OVERRIDE_CHAR + text),
+            // but the shaped glyphs are reused from the cache
+            const GlyphRunCache::Entry *entry = _glyphRunCache.lookup(text, painter.font(), this);
+            const QPointF origin(drawRect.left(), drawRect.bottom() - entry->height);
+            const bool clip = entry->width > drawRect.width() || entry->height > drawRect.height();
+            if (clip) {
+                painter.save();
+                painter.setClipRect(drawRect, Qt::IntersectClip);
+            }
+            for (const QGlyphRun &glyphRun : entry->glyphRuns)
+                painter.drawGlyphRun(origin, glyphRun);
+            if (clip)
+                painter.restore();
          }
         }
     }
@@ -852,7 +872,7 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QString& text,
                                        const Character* style)
 {
-    painter.save();
+    // the painter state is saved once per drawContents() call, not per fragment
 
     // setup painter
     //const QColor foregroundColor = style->foregroundColor.color(_colorTable);
@@ -879,8 +899,6 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
 
     // draw text
     drawCharacters(painter,rect,text,style,invertCharacterColor);
-
-    painter.restore();
 }
 
 void TerminalDisplay::setRandomSeed(uint randomSeed) { _randomSeed = randomSeed; }
@@ -1009,7 +1027,33 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
     Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
     //scroll the display vertically to match internal _image
-    scroll( 0 , _fontHeight * (-lines) , scrollRect );
+    //with a fractional scale factor the distance is not a whole number of
+    //device pixels, moving the pixels would smear the lines, so repaint instead
+    const qreal scrollDistance = _fontHeight * lines * devicePixelRatioF();
+    if (qFuzzyCompare(scrollDistance, qreal(qRound(scrollDistance))))
+        scroll( 0 , _fontHeight * (-lines) , scrollRect );
+    else
+        update( snapToDevicePixels(scrollRect) );
+}
+
+QRect TerminalDisplay::snapToDevicePixels(const QRect &rect) const
+{
+    const qreal ratio = devicePixelRatioF();
+    if (rect.isEmpty() || qFuzzyCompare(ratio, qreal(qRound(ratio))))
+        return rect;
+
+    // With a fractional scale factor the edge between two lines of text falls
+    // inside a device pixel which both lines touch.  Grow the rectangle to whole
+    // device pixels plus one, so that the neighbouring lines are repainted
+    // (clipped) as well and no half painted pixel row is left behind.
+    const int left = qFloor(rect.left() * ratio) - 1;
+    const int top = qFloor(rect.top() * ratio) - 1;
+    const int right = qCeil((rect.left() + rect.width()) * ratio) + 1;
+    const int bottom = qCeil((rect.top() + rect.height()) * ratio) + 1;
+
+    const QPoint topLeft(qFloor(left / ratio), qFloor(top / ratio));
+    const QPoint bottomRight(qCeil(right / ratio), qCeil(bottom / ratio));
+    return QRect(topLeft, bottomRight - QPoint(1, 1)) & QWidget::rect();
 }
 
 QRegion TerminalDisplay::hotSpotRegion() const
@@ -1063,8 +1107,9 @@ void TerminalDisplay::processFilters()
     _filterChain->setImage( _screenWindow->getImage(),
                             _screenWindow->windowLines(),
                             _screenWindow->windowColumns(),
-                            _screenWindow->getLineProperties() );
-    _filterChain->process();
+                            _screenWindow->getLineProperties(),
+                            _screenWindow->getLineGenerations(),
+                            &_screenWindow->screen()->extendedCharTable() );
 
     QRegion postUpdateHotSpots = hotSpotRegion();
 
@@ -1217,7 +1262,7 @@ void TerminalDisplay::updateImage()
                                  _fontWidth * columnsToUpdate ,
                                  _fontHeight );
 
-        dirtyRegion |= dirtyRect;
+        dirtyRegion |= snapToDevicePixels(dirtyRect);
     }
 
     // replace the line of characters in the old _image with the
@@ -1229,32 +1274,30 @@ void TerminalDisplay::updateImage()
   // outside the new _image is cleared
   if ( linesToUpdate < _usedLines )
   {
-    dirtyRegion |= QRect(   _leftMargin+tLx ,
-                            _topMargin+tLy+_fontHeight*linesToUpdate ,
-                            _fontWidth * this->_columns ,
-                            _fontHeight * (_usedLines-linesToUpdate) );
+    dirtyRegion |= snapToDevicePixels(QRect( _leftMargin+tLx ,
+                                             _topMargin+tLy+_fontHeight*linesToUpdate ,
+                                             _fontWidth * this->_columns ,
+                                             _fontHeight * (_usedLines-linesToUpdate) ));
   }
   _usedLines = linesToUpdate;
 
   if ( columnsToUpdate < _usedColumns )
   {
-    dirtyRegion |= QRect(   _leftMargin+tLx+columnsToUpdate*_fontWidth ,
-                            _topMargin+tLy ,
-                            _fontWidth * (_usedColumns-columnsToUpdate) ,
-                            _fontHeight * this->_lines );
+    dirtyRegion |= snapToDevicePixels(QRect( _leftMargin+tLx+columnsToUpdate*_fontWidth ,
+                                             _topMargin+tLy ,
+                                             _fontWidth * (_usedColumns-columnsToUpdate) ,
+                                             _fontHeight * this->_lines ));
   }
   _usedColumns = columnsToUpdate;
 
-  dirtyRegion |= _inputMethodData.previousPreeditRect;
+  dirtyRegion |= snapToDevicePixels(_inputMethodData.previousPreeditRect);
 
   _screenWindow->resetScrollCount();
   // update the parts of the display which have changed
-   //--modified and added by qinyaning(nyq) to solve When the screen zooms to 1.25 and 2.75,
-  /*the terminal interface will display colored lines. time: 2020.4.10 14:18
-   * */
-  //update(dirtyRegion);
-  update();
-  //-------------------------------------------------
+  // the rectangles are snapped to device pixels, which fixes the coloured
+  // lines seen at 1.25 and 2.75 scaling without repainting the whole display
+  if (!dirtyRegion.isEmpty())
+      update(dirtyRegion);
 
   if ( _hasBlinker && !_blinkTimer->isActive()) _blinkTimer->start( TEXT_BLINK_DELAY );
   if (!_hasBlinker && _blinkTimer->isActive()) { _blinkTimer->stop(); _blinking = false; }
@@ -1371,7 +1414,11 @@ void TerminalDisplay::focusInEvent(QFocusEvent*)
 
 void TerminalDisplay::paintEvent( QPaintEvent* pe )
 {
+  QElapsedTimer paintTimer;
+  paintTimer.start();
+
   QPainter paint(this);
+  _glyphRunCache.setDevice(this);
 
   if ( !_backgroundImage.isNull() && qAlpha(_blendColor) < 0xff )
   {
@@ -1404,6 +1451,34 @@ void TerminalDisplay::paintEvent( QPaintEvent* pe )
   }
   drawInputMethodPreeditString(paint, preeditRect());
   paintFilters(paint);
+
+  FrameScheduler::forWindow(this)->reportPaintTime(paintTimer.nsecsElapsed());
+}
+
+bool TerminalDisplay::isRenderSuspended() const
+{
+    return !isVisible() || window()->isMinimized();
+}
+
+void TerminalDisplay::requestFrame()
+{
+    if (_frameRequested)
+        return;
+
+    _frameRequested = true;
+    FrameScheduler::forWindow(this)->requestFrame(this);
+}
+
+void TerminalDisplay::updateFrame()
+{
+    if (!_frameRequested || isRenderSuspended())
+        return;
+
+    _frameRequested = false;
+    FrameScheduler::forWindow(this)->cancel(this);
+    updateLineProperties();
+    updateImage();
+    updateFilters();
 }
 
 QPoint TerminalDisplay::cursorPosition() const
@@ -1604,12 +1679,12 @@ QRect TerminalDisplay::calculateTextArea(int topLeftX, int topLeftY, int startCo
                _fontHeight};
 }
 
-static uint baseCodePoint(const Character &ch) {
+static uint baseCodePoint(const Character &ch, const ExtendedCharTable *extendedChars) {
     if (ch.rendition & RE_EXTENDED_CHAR) {
         // sequence of characters
         ushort extendedCharLength = 0;
-        const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(ch.character, extendedCharLength);
-        return chars[0];
+        const uint* chars = extendedChars ? extendedChars->lookupExtendedChar(ch.character, extendedCharLength) : nullptr;
+        return chars ? chars[0] : uint(QChar::ReplacementCharacter);
     } else {
         return ch.character;
     }
@@ -1617,6 +1692,13 @@ static uint baseCodePoint(const Character &ch) {
 
 void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
 {
+    // drawTextFragment() changes the pen and font
+    paint.save();
+
+    // the sequences of the extended characters of the image, an id the
+    // screen freed since the image was copied is not drawn
+    const ExtendedCharTable *extendedChars = _screenWindow ? &_screenWindow->screen()->extendedCharTable() : nullptr;
+
     const int numberOfColumns = _usedColumns;
     QVector<uint> univec;
     univec.reserve(numberOfColumns);
@@ -1638,7 +1720,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
             if ((_image[loc(x, y)].rendition & RE_EXTENDED_CHAR) != 0) {
                 // sequence of characters
                 ushort extendedCharLength = 0;
-                const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(_image[loc(x, y)].character, extendedCharLength);
+                const uint* chars = extendedChars ? extendedChars->lookupExtendedChar(_image[loc(x, y)].character, extendedCharLength) : nullptr;
                 if (chars != nullptr) {
                     Q_ASSERT(extendedCharLength > 1);
                     bufferSize += extendedCharLength - 1;
@@ -1663,7 +1745,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
             const CharacterColor currentForeground = _image[loc(x, y)].foregroundColor;
             const CharacterColor currentBackground = _image[loc(x, y)].backgroundColor;
             const RenditionFlags currentRendition = _image[loc(x, y)].rendition;
-            const QChar::Script currentScript = QChar::script(baseCodePoint(_image[loc(x, y)]));
+            const QChar::Script currentScript = QChar::script(baseCodePoint(_image[loc(x, y)], extendedChars));
 
             const auto isInsideDrawArea = [&](int column) { return column <= rect.right(); };
             const auto hasSameColors = [&](int column) {
@@ -1683,7 +1765,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
                     == lineDraw;
             };
             const auto isSameScript = [&](int column) {
-                const QChar::Script script = QChar::script(baseCodePoint(_image[loc(column, y)]));
+                const QChar::Script script = QChar::script(baseCodePoint(_image[loc(column, y)], extendedChars));
                 if (currentScript == QChar::Script_Common || script == QChar::Script_Common
                     || currentScript == QChar::Script_Inherited || script == QChar::Script_Inherited) {
                     return true;
@@ -1705,7 +1787,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
                     if ((_image[loc(x + len, y)].rendition & RE_EXTENDED_CHAR) != 0) {
                         // sequence of characters
                         ushort extendedCharLength = 0;
-                        const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(c, extendedCharLength);
+                        const uint* chars = extendedChars ? extendedChars->lookupExtendedChar(c, extendedCharLength) : nullptr;
                         if (chars != nullptr) {
                             Q_ASSERT(extendedCharLength > 1);
                             bufferSize += extendedCharLength - 1;
@@ -1809,6 +1891,8 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
             x += len - 1;
         }
     }
+
+    paint.restore();
 }
 
 void TerminalDisplay::blinkEvent()
@@ -1926,6 +2010,9 @@ void TerminalDisplay::updateImageSize()
 //the same signal as the one for a content size change
 void TerminalDisplay::showEvent(QShowEvent*)
 {
+    // the output while the display was hidden, before it is painted
+    updateFrame();
+
     emit changedContentSizeSignal(_contentHeight,_contentWidth);
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
@@ -3207,6 +3294,8 @@ QVariant TerminalDisplay::inputMethodQuery( Qt::InputMethodQuery query ) const
                 QString lineText;
                 QTextStream stream(&lineText);
                 PlainTextDecoder decoder;
+                if (_screenWindow)
+                    decoder.setExtendedCharTable(&_screenWindow->screen()->extendedCharTable());
                 decoder.begin(&stream);
                 decoder.decodeLine(&_image[loc(0,cursorPos.y())],_usedColumns,_lineProperties[cursorPos.y()]);
                 decoder.end();
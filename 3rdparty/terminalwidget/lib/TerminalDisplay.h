@@ -29,6 +29,7 @@
 // Konsole
 #include "Filter.h"
 #include "Character.h"
+#include "GlyphRunCache.h"
 #include "qtermwidget.h"
 //#include "konsole_export.h"
 #include "tools.h"
@@ -361,6 +362,12 @@ public:
      */
     void setVTFont(const QFont& font);
 
+    /**
+     * Returns the cache of shaped text used for painting, e.g. to read its
+     * hit and miss counters.
+     */
+    const GlyphRunCache &glyphRunCache() const { return _glyphRunCache; }
+
     /**
      * Specified whether anti-aliasing of text in the terminal display
      * is enabled or not.  Defaults to enabled.
@@ -442,6 +449,13 @@ public:
 
     void setSessionId(int sessionId);
 
+    /**
+     * Returns true if the display cannot be seen, in a hidden tab or a hidden
+     * or minimised window.  Output then only marks the display for an update,
+     * which is made when it is shown again.
+     */
+    bool isRenderSuspended() const;
+
     // 获取是否允许输出时滚动
     bool getIsAllowScroll() const;
     // 设置是否允许输出时滚动
@@ -465,6 +479,18 @@ public slots:
      */
     void updateLineProperties();
 
+    /**
+     * Asks the FrameScheduler of the window to call updateFrame() on the next
+     * frame, after the output of the screen window changed.
+     */
+    void requestFrame();
+
+    /**
+     * Updates the line properties, the image and the filters after
+     * requestFrame(), unless the display is render suspended.
+     */
+    void updateFrame();
+
     /** Copies the selected text to the clipboard. */
     void copyClipboard();
     /**
@@ -733,6 +759,10 @@ private:
     // the left and right are ignored.
     void scrollImage(int lines , const QRect& region);
 
+    // grows a rectangle in widget coordinates to whole device pixels, so that
+    // partial updates stay clean with fractional scale factors
+    QRect snapToDevicePixels(const QRect &rect) const;
+
     void calcGeometry();
     void propagateSize();
     void updateImageSize();
@@ -771,6 +801,7 @@ private:
     int  _fontAscent;     // ascend
     bool _boldIntense;   // Whether intense colors should be rendered with bold font
     int  _drawTextAdditionHeight;   // additional height to prevent font trancation
+    GlyphRunCache _glyphRunCache;    // shaped text fragments, see drawCharacters()
     bool _drawTextTestFlag;         // indicate it is a testing or not
 
     int _leftMargin;    // offset
@@ -825,6 +856,7 @@ private:
     int         _bellMode;
 
     bool _blinking;   // hide text in paintEvent
+    bool _frameRequested; // see requestFrame()
     bool _hasBlinker; // has characters to blink
     bool _cursorBlinking;     // hide cursor in paintEvent
     bool _hasBlinkingCursor;  // has blinking cursor enabled
@@ -0,0 +1,181 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "Utf8Decoder.h"
+
+// System
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTF8DECODER_HAVE_AVX2_DISPATCH
+#endif
+
+using namespace Konsole;
+
+static const uint ReplacementCharacter = 0xFFFD;
+
+// Copies the leading ASCII bytes of 'src' into 'dst' as code points, stops at
+// the first byte >= 0x80 and returns the number of bytes copied.
+static int widenAsciiGeneric(const uchar *src, int length, uint *dst)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (_mm_movemask_epi8(chunk) != 0) {
+            break;
+        }
+
+        const __m128i low = _mm_unpacklo_epi8(chunk, zero);
+        const __m128i high = _mm_unpackhi_epi8(chunk, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 12), _mm_unpackhi_epi16(high, zero));
+    }
+#else
+    // check eight bytes at a time for a set high bit
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        memcpy(&word, src + i, sizeof(word));
+        if ((word & Q_UINT64_C(0x8080808080808080)) != 0) {
+            break;
+        }
+        for (int j = 0; j < 8; j++) {
+            dst[i + j] = src[i + j];
+        }
+    }
+#endif
+
+    for (; i < length && src[i] < 0x80; i++) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+#ifdef UTF8DECODER_HAVE_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static int widenAsciiAvx2(const uchar *src, int length, uint *dst)
+{
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (_mm256_movemask_epi8(chunk) != 0) {
+            break;
+        }
+
+        const __m128i low = _mm256_castsi256_si128(chunk);
+        const __m128i high = _mm256_extracti128_si256(chunk, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_cvtepu8_epi32(low));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 16), _mm256_cvtepu8_epi32(high));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+    }
+
+    // the remaining tail (or the chunk holding the first non-ASCII byte)
+    return i + widenAsciiGeneric(src + i, length - i, dst + i);
+}
+#endif
+
+typedef int (*WidenAsciiFunction)(const uchar *, int, uint *);
+
+static WidenAsciiFunction resolveWidenAscii()
+{
+#ifdef UTF8DECODER_HAVE_AVX2_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return widenAsciiAvx2;
+    }
+#endif
+    return widenAsciiGeneric;
+}
+
+static const WidenAsciiFunction widenAscii = resolveWidenAscii();
+
+Utf8Decoder::Utf8Decoder()
+{
+    reset();
+}
+
+void Utf8Decoder::reset()
+{
+    _codePoint = 0;
+    _needed = 0;
+    _lowerBound = 0x80;
+    _upperBound = 0xBF;
+}
+
+int Utf8Decoder::decode(const char *data, int length, uint *output)
+{
+    const uchar *src = reinterpret_cast<const uchar *>(data);
+    const uchar *end = src + length;
+    uint *dst = output;
+
+    while (src < end) {
+        if (_needed == 0) {
+            // between sequences: copy any ASCII run in bulk first
+            const int ascii = widenAscii(src, int(end - src), dst);
+            src += ascii;
+            dst += ascii;
+            if (src == end) {
+                break;
+            }
+
+            const uchar lead = *src++;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                _needed = 1;
+                _codePoint = lead & 0x1F;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                _needed = 2;
+                _codePoint = lead & 0x0F;
+                if (lead == 0xE0) {
+                    _lowerBound = 0xA0;
+                } else if (lead == 0xED) {
+                    _upperBound = 0x9F;
+                }
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                _needed = 3;
+                _codePoint = lead & 0x07;
+                if (lead == 0xF0) {
+                    _lowerBound = 0x90;
+                } else if (lead == 0xF4) {
+                    _upperBound = 0x8F;
+                }
+            } else {
+                // stray continuation byte or a lead byte which is never valid
+                *dst++ = ReplacementCharacter;
+            }
+            continue;
+        }
+
+        const uchar byte = *src;
+        if (byte < _lowerBound || byte > _upperBound) {
+            // the pending sequence is truncated: replace it and process
+            // this byte again as the start of a new sequence
+            *dst++ = ReplacementCharacter;
+            reset();
+            continue;
+        }
+
+        src++;
+        _lowerBound = 0x80;
+        _upperBound = 0xBF;
+        _codePoint = (_codePoint << 6) | (byte & 0x3F);
+        if (--_needed == 0) {
+            *dst++ = _codePoint;
+        }
+    }
+
+    return int(dst - output);
+}
@@ -0,0 +1,55 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef UTF8DECODER_H
+#define UTF8DECODER_H
+
+// Qt
+#include <QtGlobal>
+
+namespace Konsole
+{
+
+/**
+ * A stateful UTF-8 to UCS-4 decoder for the terminal output stream.
+ *
+ * Unlike QTextDecoder it writes straight into a caller supplied buffer of
+ * code points, so decoding a block does not allocate, and pure ASCII runs
+ * are validated and widened 16 (SSE2) or 32 (AVX2) bytes at a time.
+ *
+ * Multi-byte sequences which are split across two calls to decode() are
+ * completed on the next call.  Invalid input is replaced with U+FFFD, one
+ * replacement character per maximal invalid subpart, as QTextCodec does.
+ */
+class Utf8Decoder
+{
+public:
+    Utf8Decoder();
+
+    /**
+     * Decodes @p length bytes from @p data into @p output and returns the
+     * number of code points written.
+     *
+     * @p output must have room for at least @p length + 1 code points.
+     */
+    int decode(const char *data, int length, uint *output);
+
+    /** Drops any partially decoded sequence. */
+    void reset();
+
+private:
+    uint _codePoint;
+    // number of continuation bytes still expected for the current sequence
+    int _needed;
+    // valid range of the next continuation byte, used to reject overlong
+    // forms, surrogates and code points above U+10FFFF
+    uchar _lowerBound;
+    uchar _upperBound;
+};
+
+}
+
+#endif // UTF8DECODER_H
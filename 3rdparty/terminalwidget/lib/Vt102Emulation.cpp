@@ -395,6 +395,36 @@ void Vt102Emulation::receiveChar(wchar_t cc)
     return;
   }
 }
+// process a block of incoming unicode characters
+void Vt102Emulation::receiveChars(const uint *chars, int count)
+{
+  int i = 0;
+  while (i < count)
+  {
+    // Runs of plain printable characters received in ground state (no escape
+    // sequence pending) would each end up as a TY_CHR token, so hand them to
+    // the screen in one go. The VT52 mode and the graphic/pound charsets keep
+    // going through receiveChar().
+    const CharCodes &charset = _charset[_currentScreen == _screen[1]];
+    if (tokenBufferPos == 0 && getMode(MODE_Ansi) && !charset.graphic && !charset.pound)
+    {
+      int end = i;
+      while (end < count && chars[end] >= 32 && chars[end] != DEL && chars[end] != ESC + 128)
+        end++;
+
+      if (end > i)
+      {
+        _currentScreen->displayCharacters(chars + i, end - i);
+        i = end;
+        continue;
+      }
+    }
+
+    receiveChar(chars[i]);
+    i++;
+  }
+}
+
 void Vt102Emulation::processWindowAttributeChange()
 {
   // Describes the window or terminal session attribute to change
@@ -419,6 +449,21 @@ void Vt102Emulation::processWindowAttributeChange()
   // ignored, only the second char in ST ("\e\\") is appended to tokenBuffer.
   QString newValue = QString::fromWCharArray(tokenBuffer + i + 1, tokenBufferPos-i-2);
 
+  // The semantic prompt marks of a shell with integration, "\e]133;A\a" and
+  // so on, mark the cursor position, so they are not delayed like titles.
+  if (attributeToChange == 133)
+  {
+    if (newValue.startsWith(QLatin1Char('A')))
+      _currentScreen->markShellPosition(Screen::PromptStart);
+    else if (newValue.startsWith(QLatin1Char('B')))
+      _currentScreen->markShellPosition(Screen::CommandStart);
+    else if (newValue.startsWith(QLatin1Char('C')))
+      _currentScreen->markShellPosition(Screen::CommandExecuted);
+    else if (newValue.startsWith(QLatin1Char('D')))
+      _currentScreen->markShellPosition(Screen::CommandFinished);
+    return;
+  }
+
   _pendingTitleUpdates[attributeToChange] = newValue;
   _titleUpdateTimer->start(20);
 }
@@ -26,10 +26,13 @@
 
 // System
 #include <cerrno>
+#include <cstring>
 #include <unistd.h>
 
 // Qt
 #include <QDir>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QUrl>
 #include <QDebug>
 
@@ -37,11 +40,74 @@ using namespace Konsole;
 
 Q_GLOBAL_STATIC(QString, historyFileLocation)
 
+const qint64 HistoryFile::WINDOW_SIZE;
+
+namespace
+{
+
+// One thread writes the history files of all sessions, in the order the
+// writes were started
+class HistoryWriterPool : public QThreadPool
+{
+public:
+    HistoryWriterPool()
+    {
+        setMaxThreadCount(1);
+    }
+};
+
+class HistoryFileWriter : public QRunnable
+{
+public:
+    HistoryFileWriter(int fd, const char *data, qint64 size, qint64 offset, int *error, QSemaphore *done)
+        : _fd(fd)
+        , _data(data)
+        , _size(size)
+        , _offset(offset)
+        , _error(error)
+        , _done(done)
+    {
+    }
+
+    void run() override
+    {
+        qint64 written = 0;
+        while (written < _size) {
+            const ssize_t rc = pwrite(_fd, _data + written, static_cast<size_t>(_size - written), _offset + written);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                *_error = errno;
+                break;
+            }
+            written += rc;
+        }
+        _done->release();
+    }
+
+private:
+    int _fd;
+    const char *_data;
+    qint64 _size;
+    qint64 _offset;
+    int *_error;
+    QSemaphore *_done;
+};
+
+}
+
+Q_GLOBAL_STATIC(HistoryWriterPool, historyWriterPool)
+
 // History File ///////////////////////////////////////////
 HistoryFile::HistoryFile() :
     _length(0),
-    _fileMap(nullptr),
-    _readWriteBalance(0)
+    _fileLength(0),
+    _lostLength(0),
+    _writing(false),
+    _writeError(0),
+    _writeFailed(false),
+    _windowUses(0)
 {
     // Determine the temp directory once
     // This class is called 3 times for each "unlimited" scrollback.
@@ -87,64 +153,159 @@ HistoryFile::HistoryFile() :
 
 HistoryFile::~HistoryFile()
 {
-    if (_fileMap != nullptr) {
-        unmap();
+    finishWrite(true);
+    while (!_windows.isEmpty()) {
+        unmapWindow(_windows.size() - 1);
     }
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
+uchar *HistoryFile::mapWindow(qint64 start, qint64 end)
 {
-    Q_ASSERT(_fileMap == nullptr);
-
-    if (_tmpFile.flush()) {
-        Q_ASSERT(_tmpFile.size() >= _length);
-        _fileMap = _tmpFile.map(0, _length);
+    int leastRecentlyUsed = -1;
+    for (int i = 0; i < _windows.size(); i++) {
+        Window &window = _windows[i];
+        if (window.start == start) {
+            if (window.start + window.length >= end) {
+                window.lastUse = ++_windowUses;
+                return window.data;
+            }
+            // the window was mapped when the file ended inside of it
+            unmapWindow(i);
+            leastRecentlyUsed = -1;
+            break;
+        }
+        if (leastRecentlyUsed == -1 || window.lastUse < _windows[leastRecentlyUsed].lastUse) {
+            leastRecentlyUsed = i;
+        }
+    }
+    if (_windows.size() >= MAX_WINDOWS) {
+        unmapWindow(leastRecentlyUsed);
     }
 
-    //if mmap'ing fails, fall back to the read-lseek combination
-    if (_fileMap == nullptr) {
-        _readWriteBalance = 0;
-        //qDebug() << "mmap'ing history failed.  errno = " << errno;
+    Window window;
+    window.start = start;
+    window.length = qMin(WINDOW_SIZE, _fileLength - start);
+    window.data = _tmpFile.map(start, window.length);
+    window.lastUse = ++_windowUses;
+    //if mmap'ing fails, the caller falls back to the read-lseek combination
+    if (window.data == nullptr) {
+        return nullptr;
     }
+    _windows.append(window);
+    return window.data;
 }
 
-void HistoryFile::unmap()
+void HistoryFile::unmapWindow(int index)
 {
-    Q_ASSERT(_fileMap != nullptr);
+    _tmpFile.unmap(_windows[index].data);
+    _windows.remove(index);
+}
 
-    if (_tmpFile.unmap(_fileMap)) {
-        _fileMap = nullptr;
+void HistoryFile::startWrite()
+{
+    Q_ASSERT(!_writing);
+
+    const qint64 start = _fileLength + _lostLength;
+    const qint64 end = (start + _appendBuffer.size()) / WRITE_ALIGNMENT * WRITE_ALIGNMENT;
+    const int count = static_cast<int>(end - start);
+    if (count <= 0) {
+        return;
     }
 
-    Q_ASSERT(_fileMap == nullptr);
+    // the buffers keep their capacity, see add()
+    _writeBuffer.swap(_appendBuffer);
+    if (_appendBuffer.capacity() == 0) {
+        _appendBuffer.reserve(APPEND_BUFFER_SIZE + WRITE_ALIGNMENT);
+    }
+    _appendBuffer.append(_writeBuffer.constData() + count, _writeBuffer.size() - count);
+    _writeBuffer.resize(count);
 
+    _writing = true;
+    historyWriterPool()->start(new HistoryFileWriter(_tmpFile.handle(), _writeBuffer.constData(), count,
+                                                     start, &_writeError, &_writeDone));
 }
 
-void HistoryFile::add(const char *buffer, qint64 count)
+void HistoryFile::finishWrite(bool wait)
 {
-    if (_fileMap != nullptr) {
-        unmap();
+    if (!_writing) {
+        return;
     }
+    if (wait) {
+        _writeDone.acquire();
+    } else if (!_writeDone.tryAcquire()) {
+        return;
+    }
+    _writing = false;
 
-    if (_readWriteBalance < INT_MAX) {
-        _readWriteBalance++;
+    if (_writeError != 0) {
+        // e.g. while the disk is full
+        if (!_writeFailed) {
+            errno = _writeError;
+            perror("HistoryFile::write");
+            _writeFailed = true;
+        }
+        _writeError = 0;
+        // write the data again with the next batch, but do not keep more of
+        // it in memory than a batch
+        _writeBuffer.append(_appendBuffer);
+        _writeBuffer.swap(_appendBuffer);
+        const int lost = _appendBuffer.size() - MAX_APPEND_BUFFER_SIZE;
+        if (lost > 0) {
+            _appendBuffer.remove(0, lost);
+            _lostLength += lost;
+        }
+    } else {
+        // the lost data is a hole in the file now
+        _fileLength += _lostLength + _writeBuffer.size();
+        _lostLength = 0;
+        _writeFailed = false;
     }
+    _writeBuffer.resize(0);
+}
 
-    qint64 rc = 0;
+void HistoryFile::add(const char *buffer, qint64 count)
+{
+    finishWrite(false);
 
-    if (!_tmpFile.seek(_length)) {
-        perror("HistoryFile::add.seek");
-        return;
+    // reserved buffers are not freed by resize(0)
+    if (_appendBuffer.capacity() == 0) {
+        _appendBuffer.reserve(APPEND_BUFFER_SIZE + WRITE_ALIGNMENT);
     }
-    rc = _tmpFile.write(buffer, count);
-    if (rc < 0) {
-        perror("HistoryFile::add.write");
-        return;
+    _appendBuffer.append(buffer, static_cast<int>(count));
+    _length += count;
+
+    if (_appendBuffer.size() >= APPEND_BUFFER_SIZE) {
+        if (_appendBuffer.size() >= MAX_APPEND_BUFFER_SIZE) {
+            finishWrite(true);
+        }
+        if (!_writing) {
+            startWrite();
+        }
+    }
+}
+
+void HistoryFile::readFile(char *buffer, qint64 size, qint64 loc)
+{
+    while (size > 0) {
+        const qint64 start = loc - loc % WINDOW_SIZE;
+        const qint64 count = qMin(size, start + WINDOW_SIZE - loc);
+
+        const uchar *data = mapWindow(start, loc + count);
+        if (data != nullptr) {
+            memcpy(buffer, data + (loc - start), static_cast<size_t>(count));
+        } else {
+            // the file is written by the writer thread, so do not use
+            // QFile's buffered reads
+            if (pread(_tmpFile.handle(), buffer, static_cast<size_t>(count), loc) < 0) {
+                perror("HistoryFile::get.read");
+                return;
+            }
+        }
+
+        buffer += count;
+        size -= count;
+        loc += count;
     }
-    _length += rc;
 }
 
 void HistoryFile::get(char *buffer, qint64 size, qint64 loc)
@@ -155,31 +316,33 @@ void HistoryFile::get(char *buffer, qint64 size, qint64 loc)
         return;
     }
 
-    //count number of get() calls vs. number of add() calls.
-    //If there are many more get() calls compared with add()
-    //calls (decided by using MAP_THRESHOLD) then mmap the log
-    //file to improve performance.
-    if (_readWriteBalance > INT_MIN) {
-        _readWriteBalance--;
+    finishWrite(false);
+
+    const qint64 fileEnd = qMin(loc + size, _fileLength);
+    if (loc < fileEnd) {
+        readFile(buffer, fileEnd - loc, loc);
+        buffer += fileEnd - loc;
+        size -= fileEnd - loc;
+        loc = fileEnd;
     }
-    if ((_fileMap == nullptr) && _readWriteBalance < MAP_THRESHOLD) {
-        map();
+    const qint64 writeStart = _fileLength + _lostLength;
+    const qint64 lostEnd = qMin(loc + size, writeStart);
+    if (loc < lostEnd) {
+        memset(buffer, 0, static_cast<size_t>(lostEnd - loc));
+        buffer += lostEnd - loc;
+        size -= lostEnd - loc;
+        loc = lostEnd;
     }
-
-    if (_fileMap != nullptr) {
-        memcpy(buffer, _fileMap + loc, size);
-    } else {
-        qint64 rc = 0;
-
-        if (!_tmpFile.seek(loc)) {
-            perror("HistoryFile::get.seek");
-            return;
-        }
-        rc = _tmpFile.read(buffer, size);
-        if (rc < 0) {
-            perror("HistoryFile::get.read");
-            return;
-        }
+    const qint64 writeEnd = qMin(loc + size, writeStart + _writeBuffer.size());
+    if (loc < writeEnd) {
+        memcpy(buffer, _writeBuffer.constData() + (loc - writeStart), static_cast<size_t>(writeEnd - loc));
+        buffer += writeEnd - loc;
+        size -= writeEnd - loc;
+        loc = writeEnd;
+    }
+    if (size > 0) {
+        const qint64 appendStart = writeStart + _writeBuffer.size();
+        memcpy(buffer, _appendBuffer.constData() + (loc - appendStart), static_cast<size_t>(size));
     }
 }
 
@@ -189,6 +352,20 @@ void HistoryFile::removeLast(qint64 loc)
         fprintf(stderr, "removeLast(%lld): invalid args.\n", loc);
         return;
     }
+    finishWrite(true);
+
+    const qint64 appendStart = _fileLength + _lostLength;
+    if (loc >= appendStart) {
+        _appendBuffer.resize(static_cast<int>(loc - appendStart));
+    } else if (loc >= _fileLength) {
+        _appendBuffer.resize(0);
+        _lostLength = loc - _fileLength;
+    } else {
+        // the rest of the file is overwritten by the next write
+        _appendBuffer.resize(0);
+        _lostLength = 0;
+        _fileLength = loc;
+    }
     _length = loc;
 }
 
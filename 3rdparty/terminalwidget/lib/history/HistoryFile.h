@@ -19,13 +19,24 @@
 #define HISTORYFILE_H
 
 // Qt
+#include <QByteArray>
+#include <QSemaphore>
 #include <QTemporaryFile>
+#include <QVector>
 
 namespace Konsole
 {
 
 /*
    An extendable tmpfile(1) based buffer.
+
+   Data is appended to an in-memory buffer.  Once it is large enough, the
+   buffer is written to the file by a background thread in page aligned
+   batches while new data goes to the next buffer, so adding data does not
+   make system calls and reads of recently added data do not touch the file.
+   The file is read through read-only mappings of fixed size windows of the
+   file, of which only the least recently used few are kept, so the history
+   can grow beyond the available memory and address space.
 */
 class HistoryFile
 {
@@ -38,26 +49,61 @@ public:
     virtual void removeLast(qint64 loc);
     virtual qint64 len() const;
 
-    //mmaps the file in read-only mode
-    void map();
-    //un-mmaps the file
-    void unmap();
-
 private:
+    struct Window {
+        qint64 start;       // offset in the file, a multiple of WINDOW_SIZE
+        qint64 length;
+        uchar *data;
+        quint64 lastUse;
+    };
+
+    //starts writing the append buffer to the file in the background
+    void startWrite();
+    //takes the result of the background write if it has finished, or waits
+    //for it to finish if 'wait' is true
+    void finishWrite(bool wait);
+    //copies data from the part of the history which is in the file
+    void readFile(char *buffer, qint64 size, qint64 loc);
+    //returns the mapping of the window starting at 'start' which covers at
+    //least up to 'end', or nullptr if the file cannot be mapped
+    uchar *mapWindow(qint64 start, qint64 end);
+    void unmapWindow(int index);
+
     qint64 _length;
     QTemporaryFile _tmpFile;
 
-    //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-    uchar *_fileMap;
+    //the first _fileLength bytes of the history are in the file, followed
+    //by _lostLength bytes which could not be written, _writeBuffer, which is
+    //being written to the file, and _appendBuffer
+    qint64 _fileLength;
+    qint64 _lostLength;
+    QByteArray _writeBuffer;
+    QByteArray _appendBuffer;
+
+    //whether _writeBuffer is being written, released by the writer when done
+    bool _writing;
+    QSemaphore _writeDone;
+    //errno of the failed background write, or 0
+    int _writeError;
+    //true after a write failed until one succeeds, to report the error once
+    bool _writeFailed;
 
-    //incremented whenever 'add' is called and decremented whenever
-    //'get' is called.
-    //this is used to detect when a large number of lines are being read and processed from the history
-    //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-    int _readWriteBalance;
+    //mapped windows of the file.  The file is only appended to or
+    //overwritten after removeLast(), never truncated, so writes do not
+    //invalidate the (shared) mappings.
+    QVector<Window> _windows;
+    quint64 _windowUses;
 
-    //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-    static const int MAP_THRESHOLD = -1000;
+    static const qint64 WINDOW_SIZE = 4 * 1024 * 1024;
+    static const int MAX_WINDOWS = 8;
+    //the append buffer is written to the file when it reaches this size, or
+    //waits for the previous write if it grows to MAX_APPEND_BUFFER_SIZE.
+    //While writes fail, the data before the last MAX_APPEND_BUFFER_SIZE
+    //bytes is lost and read as zeros.
+    static const int APPEND_BUFFER_SIZE = 256 * 1024;
+    static const int MAX_APPEND_BUFFER_SIZE = 4 * APPEND_BUFFER_SIZE;
+    //writes end at a multiple of this, the rest waits for the next write
+    static const int WRITE_ALIGNMENT = 4096;
 };
 
 }
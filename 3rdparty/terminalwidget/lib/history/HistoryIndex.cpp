@@ -0,0 +1,231 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "HistoryIndex.h"
+
+using namespace Konsole;
+
+HistoryIndex::HistoryIndex(HistoryScroll *history, const ExtendedCharTable *extendedChars) :
+    _history(history),
+    _extendedChars(extendedChars),
+    _firstLine(0),
+    _firstGroup(0),
+    _lastGroup(0),
+    _wrapped(),
+    _blocks(),
+    _firstBlock(0),
+    _tailLength(0),
+    _skippedCells(0),
+    _cells()
+{
+    const int lines = _history->getLines();
+    for (int line = 0; line < lines; line++) {
+        indexLine(line);
+    }
+}
+
+uint HistoryIndex::trigramBit(uint first, uint second, uint third)
+{
+    uint hash = first * 0x9E3779B1u;
+    hash = (hash ^ (hash >> 15) ^ second) * 0x85EBCA77u;
+    hash = (hash ^ (hash >> 13) ^ third) * 0xC2B2AE3Du;
+    return (hash ^ (hash >> 16)) & (BLOCK_BITS - 1);
+}
+
+void HistoryIndex::readLine(int line)
+{
+    const int length = _history->getLineLen(line);
+    _cells.resize(length);
+    _history->getCells(line, 0, length, _cells.data());
+}
+
+const uint *HistoryIndex::cellCharacters(const Character &cell, ushort &length) const
+{
+    if (cell.rendition & RE_EXTENDED_CHAR) {
+        const uint *characters = _extendedChars ? _extendedChars->lookupExtendedChar(cell.character, length) : nullptr;
+        if (characters) {
+            return characters;
+        }
+        static const uint replacement = QChar::ReplacementCharacter;
+        length = 1;
+        return &replacement;
+    }
+    length = 1;
+    return &cell.character;
+}
+
+void HistoryIndex::indexLine(int line)
+{
+    Q_ASSERT(line == static_cast<int>(_wrapped.size()));
+
+    // a line starts a group unless the line before it is wrapped
+    const bool continued = line > 0 ? _wrapped.back() : _firstGroup < _firstLine;
+    if (!continued) {
+        _lastGroup = _firstLine + line;
+        _tailLength = 0;
+        _skippedCells = 0;
+    }
+
+    const qint64 block = _lastGroup / BLOCK_LINES;
+    if (_blocks.empty()) {
+        _firstBlock = block;
+    }
+    while (_firstBlock + static_cast<qint64>(_blocks.size()) <= block) {
+        _blocks.push_back(Block());
+    }
+    quint64 *bits = _blocks[static_cast<size_t>(block - _firstBlock)].bits;
+
+    // The characters as PlainTextDecoder writes them, without the cells
+    // after a wide character, which may be on the next line of the group.
+    readLine(line);
+    int i = _skippedCells;
+    while (i < _cells.size()) {
+        ushort length = 0;
+        const uint *characters = cellCharacters(_cells[i], length);
+        i += qMax(1, Character::width(characters[0]));
+        for (int c = 0; c < length; c++) {
+            if (_tailLength < 2) {
+                _tail[_tailLength++] = characters[c];
+                continue;
+            }
+
+            const uint bit = trigramBit(_tail[0], _tail[1], characters[c]);
+            bits[bit / 64] |= quint64(1) << (bit % 64);
+            _tail[0] = _tail[1];
+            _tail[1] = characters[c];
+        }
+    }
+    _skippedCells = i - _cells.size();
+
+    _wrapped.push_back(_history->isWrappedLine(line));
+}
+
+void HistoryIndex::addLine()
+{
+    indexLine(_history->getLines() - 1);
+}
+
+void HistoryIndex::removeLastLine()
+{
+    if (_wrapped.empty()) {
+        return;
+    }
+
+    // The trigrams of the line stay in the index, they can only name a block
+    // which does not contain a text.
+    _wrapped.pop_back();
+    _tailLength = 0;
+    _skippedCells = 0;
+    const int last = static_cast<int>(_wrapped.size()) - 1;
+    if (last < 0) {
+        _lastGroup = _firstGroup;
+        return;
+    }
+
+    int start = last;
+    while (start > 0 && _wrapped[static_cast<size_t>(start - 1)]) {
+        start--;
+    }
+    _lastGroup = start == 0 ? _firstGroup : _firstLine + start;
+
+    // The tail of the group is in its last cells.  Only the cell after a
+    // wide character is skipped, so a few more than two are enough.
+    const int tailCells = 6;
+    QVector<Character> cells;
+    for (int line = last; line >= start && cells.size() < tailCells; line--) {
+        readLine(line);
+        const int count = qMin(tailCells - cells.size(), _cells.size());
+        cells = _cells.mid(_cells.size() - count) + cells;
+    }
+    int i = 0;
+    while (i < cells.size()) {
+        ushort length = 0;
+        const uint *characters = cellCharacters(cells[i], length);
+        i += qMax(1, Character::width(characters[0]));
+        for (int c = 0; c < length; c++) {
+            if (_tailLength == 2) {
+                _tail[0] = _tail[1];
+                _tailLength--;
+            }
+            _tail[_tailLength++] = characters[c];
+        }
+    }
+    _skippedCells = i - cells.size();
+}
+
+void HistoryIndex::dropFirstLine()
+{
+    if (_wrapped.empty()) {
+        return;
+    }
+
+    if (!_wrapped.front()) {
+        _firstGroup = _firstLine + 1;
+    }
+    _wrapped.pop_front();
+    _firstLine++;
+
+    while (!_blocks.empty() && _firstBlock < _firstGroup / BLOCK_LINES) {
+        _blocks.pop_front();
+        _firstBlock++;
+    }
+}
+
+QVector<QPair<int, int>> HistoryIndex::candidateLines(const QString &text) const
+{
+    QVector<QPair<int, int>> ranges;
+    const int lines = static_cast<int>(_wrapped.size());
+    if (lines == 0) {
+        return ranges;
+    }
+
+    const QVector<uint> characters = text.toUcs4();
+    if (characters.size() < 3) {
+        ranges.append(qMakePair(0, lines));
+        return ranges;
+    }
+
+    QVector<uint> textBits;
+    for (int i = 0; i + 2 < characters.size(); i++) {
+        textBits.append(trigramBit(characters[i], characters[i + 1], characters[i + 2]));
+    }
+
+    // The block of the group of the first line may start before it, those
+    // after the last line were removed.
+    for (size_t index = 0; index < _blocks.size(); index++) {
+        const qint64 start = (_firstBlock + static_cast<qint64>(index)) * BLOCK_LINES - _firstLine;
+        if (start >= lines) {
+            break;
+        }
+        const quint64 *bits = _blocks[index].bits;
+        bool found = true;
+        for (uint bit : qAsConst(textBits)) {
+            if (!(bits[bit / 64] & (quint64(1) << (bit % 64)))) {
+                found = false;
+                break;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+
+        const int first = static_cast<int>(qMax<qint64>(0, start));
+        const int end = static_cast<int>(qMax<qint64>(first + 1, qMin<qint64>(start + BLOCK_LINES, lines)));
+        if (!ranges.isEmpty() && ranges.last().second >= first) {
+            ranges.last().second = qMax(ranges.last().second, end);
+        } else {
+            ranges.append(qMakePair(first, end));
+        }
+    }
+    return ranges;
+}
+
+qint64 HistoryIndex::memoryUsage() const
+{
+    return static_cast<qint64>(_wrapped.size()) * sizeof(bool)
+           + static_cast<qint64>(_blocks.size()) * sizeof(Block);
+}
@@ -0,0 +1,108 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+// STD
+#include <deque>
+
+// Qt
+#include <QPair>
+#include <QVector>
+
+#include "HistoryScroll.h"
+
+namespace Konsole
+{
+
+/**
+ * A trigram index of the lines of a HistoryScroll, used to find the lines
+ * which may contain a text without reading the whole history.
+ *
+ * Lines joined by LINE_WRAPPED are indexed as one text, so a text which
+ * continues on the next line is found as well.  The lines are indexed in
+ * blocks of BLOCK_LINES lines, every block has a bitmap of the trigrams,
+ * sequences of three characters, of the groups of joined lines which start
+ * in it.  A trigram sets the bit of its hash, so adding a line only sets
+ * bits and a search only tests the bits of its trigrams in every block.
+ * A text can only be in the blocks which have all of them.
+ *
+ * The index may name blocks which do not contain a text, when trigrams share
+ * a bit or after a line was removed, but it never misses one which does.
+ * The lines it names have to be read to find the text.
+ */
+class HistoryIndex
+{
+public:
+    /**
+     * Indexes the lines which are in @p history, with the extended
+     * characters in @p extendedChars.
+     */
+    HistoryIndex(HistoryScroll *history, const ExtendedCharTable *extendedChars);
+
+    /** Indexes the last line of the history, which was just added. */
+    void addLine();
+    /** Forgets the last line of the history, which is about to be removed. */
+    void removeLastLine();
+    /** Forgets the first line of the history, which was just dropped. */
+    void dropFirstLine();
+
+    /**
+     * Returns the ranges of lines, first line and line after the last one,
+     * in which @p text may start.  A range may start in the middle of a group
+     * of joined lines.  All lines are returned for a text shorter than a
+     * trigram.
+     */
+    QVector<QPair<int, int>> candidateLines(const QString &text) const;
+
+    /** Returns the bytes of memory used by the index. */
+    qint64 memoryUsage() const;
+
+private:
+    static const int BLOCK_LINES = 64;
+    static const int BLOCK_BITS = 16 * 1024;
+
+    struct Block {
+        quint64 bits[BLOCK_BITS / 64];
+    };
+
+    static uint trigramBit(uint first, uint second, uint third);
+    // reads the cells of 'line' into _cells
+    void readLine(int line);
+    // returns the characters of 'cell' as PlainTextDecoder writes them
+    const uint *cellCharacters(const Character &cell, ushort &length) const;
+    void indexLine(int line);
+
+    HistoryScroll *_history;
+    const ExtendedCharTable *_extendedChars;
+
+    // Lines are identified by numbers which do not change when lines are
+    // dropped from the start of the history, the block of a line is its
+    // number divided by BLOCK_LINES.
+    qint64 _firstLine;          // number of the first line of the history
+    qint64 _firstGroup;         // first line of the group of _firstLine
+    qint64 _lastGroup;          // first line of the group of the last line
+    std::deque<bool> _wrapped;  // LINE_WRAPPED of each line
+
+    // the blocks from the one of _firstGroup on
+    std::deque<Block> _blocks;
+    qint64 _firstBlock;
+
+    // the last two characters of the last group, for the trigrams which
+    // continue on the next line
+    uint _tail[2];
+    int _tailLength;
+    // cells of the next line after a wide character at the end of the last
+    int _skippedCells;
+
+    // reused to read lines
+    QVector<Character> _cells;
+};
+
+}
+
+#endif
@@ -39,3 +39,8 @@ bool HistoryScroll::hasScroll()
 {
     return true;
 }
+
+qint64 HistoryScroll::memoryUsage()
+{
+    return 0;
+}
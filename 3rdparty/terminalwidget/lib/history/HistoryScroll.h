@@ -41,6 +41,8 @@ public:
     virtual ~HistoryScroll();
 
     virtual bool hasScroll();
+    // bytes of memory used to keep the lines
+    virtual qint64 memoryUsage();
 
     // access to history
     virtual int  getLines() = 0;
@@ -63,7 +65,6 @@ public:
 
     // modify history
     virtual void removeCells() = 0;
-    virtual int reflowLines(int columns) = 0;
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -76,7 +77,6 @@ public:
 
 protected:
     HistoryType *_historyType;
-    const int MAX_REFLOW_LINES = 20000;
 };
 
 }
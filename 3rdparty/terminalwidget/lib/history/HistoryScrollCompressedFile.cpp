@@ -0,0 +1,494 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "HistoryScrollCompressedFile.h"
+
+#include "HistoryTypeCompressedFile.h"
+
+// Qt
+#include <QDebug>
+#include <QRunnable>
+#include <QThreadPool>
+
+// STD
+#include <algorithm>
+#include <cstring>
+
+/*
+   A frame is compressed with qCompress() from
+
+     qint32 lineCount, cellCount, runCount, charSize
+     qint32 lineEnds[lineCount]
+     quint8 flags[lineCount]
+     runs[runCount] of cells with the same rendition and colours:
+       qint32 length, quint8 rendition, CharacterColor foreground, background
+     characters[cellCount], of charSize (1, 2 or 4) bytes each
+
+   which is a few times smaller than the cells themselves for terminal
+   output, so compressing and decompressing it takes much less time.
+*/
+
+using namespace Konsole;
+
+static_assert(sizeof(LineProperty) == 1, "line flags are stored as bytes");
+static_assert(sizeof(CharacterColor) == 4, "colours are stored as 4 bytes");
+
+static const int FrameHeaderSize = 4 * sizeof(qint32);
+static const int LineSize = sizeof(qint32) + sizeof(LineProperty);
+static const int RunSize = sizeof(qint32) + sizeof(quint8) + 2 * sizeof(CharacterColor);
+
+namespace
+{
+
+class FrameCompressor : public QRunnable
+{
+public:
+    FrameCompressor(const QByteArray *input, QByteArray *output, QSemaphore *done)
+        : _input(input)
+        , _output(output)
+        , _done(done)
+    {
+    }
+
+    void run() override
+    {
+        // the fastest level, larger levels gain little on terminal output
+        *_output = qCompress(*_input, 1);
+        _done->release();
+    }
+
+private:
+    const QByteArray *_input;
+    QByteArray *_output;
+    QSemaphore *_done;
+};
+
+}
+
+template<typename T>
+static void writeCharacters(const Character cells[], int count, char *out)
+{
+    for (int i = 0; i < count; i++, out += sizeof(T)) {
+        const T character = static_cast<T>(cells[i].character);
+        memcpy(out, &character, sizeof(T));
+    }
+}
+
+template<typename T>
+static void readCharacters(const char *in, int count, Character cells[])
+{
+    for (int i = 0; i < count; i++, in += sizeof(T)) {
+        T character;
+        memcpy(&character, in, sizeof(T));
+        cells[i].character = character;
+    }
+}
+
+void HistoryScrollCompressedFile::FrameLines::truncate(int lines)
+{
+    cells.resize(startOfLine(lines));
+    lineEnds.resize(lines);
+    flags.resize(lines);
+}
+
+void HistoryScrollCompressedFile::FrameLines::clear()
+{
+    cells.clear();
+    lineEnds.clear();
+    flags.clear();
+}
+
+HistoryScrollCompressedFile::HistoryScrollCompressedFile(int maxLines) :
+    HistoryScroll(new HistoryTypeCompressedFile(maxLines)),
+    _frameData(new HistoryFile()),
+    _frameLineCount(0),
+    _droppedLines(0),
+    _maxLines(maxLines),
+    _compressing(false),
+    _cacheUses(0)
+{
+}
+
+HistoryScrollCompressedFile::~HistoryScrollCompressedFile()
+{
+    // the compressor uses the buffers
+    if (_compressing) {
+        _compressDone.acquire();
+    }
+}
+
+int HistoryScrollCompressedFile::getLines()
+{
+    return _frameLineCount + _compressingFrame.lineCount() + _openFrame.lineCount() - _droppedLines;
+}
+
+int HistoryScrollCompressedFile::getMaxLines()
+{
+    return _maxLines >= 0 ? _maxLines : getLines();
+}
+
+qint64 HistoryScrollCompressedFile::memoryUsage()
+{
+    // the frames in the file are not counted, only what is kept decompressed
+    qint64 cells = _compressingFrame.cells.size() + _openFrame.cells.size();
+    qint64 lines = _compressingFrame.lineCount() + _openFrame.lineCount();
+    for (const CachedFrame &cached : qAsConst(_cache)) {
+        cells += cached.lines.cells.size();
+        lines += cached.lines.lineCount();
+    }
+    return cells * sizeof(Character) + lines * (sizeof(int) + sizeof(LineProperty))
+           + _frames.size() * sizeof(Frame) + _compressInput.size() + _buffer.size();
+}
+
+int HistoryScrollCompressedFile::frameOf(int lineno) const
+{
+    auto it = std::upper_bound(_frames.constBegin(), _frames.constEnd(), lineno,
+                               [](int line, const Frame &frame) { return line < frame.firstLine; });
+    return static_cast<int>(it - _frames.constBegin()) - 1;
+}
+
+const HistoryScrollCompressedFile::FrameLines &HistoryScrollCompressedFile::linesOf(int lineno, int &line)
+{
+    lineno += _droppedLines;
+    if (lineno >= _frameLineCount + _compressingFrame.lineCount()) {
+        line = lineno - _frameLineCount - _compressingFrame.lineCount();
+        return _openFrame;
+    }
+    if (lineno >= _frameLineCount) {
+        line = lineno - _frameLineCount;
+        return _compressingFrame;
+    }
+
+    const int frame = frameOf(lineno);
+    line = lineno - _frames[frame].firstLine;
+    return decompressFrame(frame);
+}
+
+HistoryScrollCompressedFile::CachedFrame &HistoryScrollCompressedFile::cacheSlot(int frame)
+{
+    CachedFrame *slot;
+    if (_cache.size() < MAX_CACHED_FRAMES) {
+        _cache.append(CachedFrame());
+        slot = &_cache.last();
+    } else {
+        slot = &_cache[0];
+        for (CachedFrame &cached : _cache) {
+            if (cached.lastUse < slot->lastUse) {
+                slot = &cached;
+            }
+        }
+    }
+    slot->frame = frame;
+    slot->lastUse = ++_cacheUses;
+    return *slot;
+}
+
+const HistoryScrollCompressedFile::FrameLines &HistoryScrollCompressedFile::decompressFrame(int frame)
+{
+    for (CachedFrame &cached : _cache) {
+        if (cached.frame == frame) {
+            cached.lastUse = ++_cacheUses;
+            return cached.lines;
+        }
+    }
+
+    const Frame &info = _frames[frame];
+    const int lineCount = (frame + 1 < _frames.size() ? _frames[frame + 1].firstLine : _frameLineCount)
+                          - info.firstLine;
+    _buffer.resize(info.size);
+    _frameData->get(_buffer.data(), info.size, info.offset);
+    const QByteArray data = qUncompress(_buffer);
+
+    FrameLines &lines = cacheSlot(frame).lines;
+    lines.clear();
+
+    qint32 header[4] = {0, 0, 0, 0};
+    if (data.size() >= FrameHeaderSize) {
+        memcpy(header, data.constData(), sizeof(header));
+    }
+    const int cellCount = header[1];
+    const int runCount = header[2];
+    const int charSize = header[3];
+    if (header[0] != lineCount || cellCount < 0 || runCount < 0
+        || (charSize != sizeof(quint8) && charSize != sizeof(quint16) && charSize != sizeof(quint32))
+        || data.size() != FrameHeaderSize + qint64(lineCount) * LineSize + qint64(runCount) * RunSize
+                          + qint64(cellCount) * charSize) {
+        // keep the line numbers of the rest of the history, with empty lines
+        qWarning() << "Unable to read history frame" << frame;
+        lines.lineEnds.fill(0, lineCount);
+        lines.flags.fill(0, lineCount);
+        return lines;
+    }
+
+    const char *in = data.constData() + FrameHeaderSize;
+    lines.lineEnds.resize(lineCount);
+    memcpy(lines.lineEnds.data(), in, lineCount * sizeof(qint32));
+    in += lineCount * sizeof(qint32);
+    lines.flags.resize(lineCount);
+    memcpy(lines.flags.data(), in, lineCount * sizeof(LineProperty));
+    in += lineCount * sizeof(LineProperty);
+
+    lines.cells.resize(cellCount);
+    Character *cells = lines.cells.data();
+    int cell = 0;
+    for (int i = 0; i < runCount; i++, in += RunSize) {
+        Character style;
+        qint32 length;
+        memcpy(&length, in, sizeof(qint32));
+        style.rendition = static_cast<quint8>(in[sizeof(qint32)]);
+        memcpy(&style.foregroundColor, in + sizeof(qint32) + sizeof(quint8), sizeof(CharacterColor));
+        memcpy(&style.backgroundColor, in + sizeof(qint32) + sizeof(quint8) + sizeof(CharacterColor),
+               sizeof(CharacterColor));
+        length = qMin(length, cellCount - cell);
+        std::fill_n(cells + cell, length, style);
+        cell += length;
+    }
+
+    if (charSize == sizeof(quint8)) {
+        readCharacters<quint8>(in, cellCount, cells);
+    } else if (charSize == sizeof(quint16)) {
+        readCharacters<quint16>(in, cellCount, cells);
+    } else {
+        readCharacters<quint32>(in, cellCount, cells);
+    }
+    return lines;
+}
+
+void HistoryScrollCompressedFile::sealFrame()
+{
+    // usually done long ago, frames fill up much slower than they compress
+    finishCompression(true);
+
+    const int lineCount = _openFrame.lineCount();
+    const int cellCount = _openFrame.cells.size();
+    const Character *cells = _openFrame.cells.constData();
+
+    uint maxCharacter = 0;
+    int runCount = 0;
+    for (int i = 0; i < cellCount; i++) {
+        maxCharacter = qMax(maxCharacter, cells[i].character);
+        if (i == 0 || !cells[i].equalsFormat(cells[i - 1])) {
+            runCount++;
+        }
+    }
+    const int charSize = maxCharacter <= 0xFF ? sizeof(quint8)
+                         : maxCharacter <= 0xFFFF ? sizeof(quint16) : sizeof(quint32);
+    _compressInput.resize(FrameHeaderSize + lineCount * LineSize + runCount * RunSize + cellCount * charSize);
+
+    char *out = _compressInput.data();
+    const qint32 header[4] = {lineCount, cellCount, runCount, charSize};
+    memcpy(out, header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, _openFrame.lineEnds.constData(), lineCount * sizeof(qint32));
+    out += lineCount * sizeof(qint32);
+    memcpy(out, _openFrame.flags.constData(), lineCount * sizeof(LineProperty));
+    out += lineCount * sizeof(LineProperty);
+
+    for (int start = 0; start < cellCount; out += RunSize) {
+        qint32 length = 1;
+        while (start + length < cellCount && cells[start + length].equalsFormat(cells[start])) {
+            length++;
+        }
+        memcpy(out, &length, sizeof(qint32));
+        out[sizeof(qint32)] = static_cast<char>(cells[start].rendition);
+        memcpy(out + sizeof(qint32) + sizeof(quint8), &cells[start].foregroundColor, sizeof(CharacterColor));
+        memcpy(out + sizeof(qint32) + sizeof(quint8) + sizeof(CharacterColor), &cells[start].backgroundColor,
+               sizeof(CharacterColor));
+        start += length;
+    }
+
+    if (charSize == sizeof(quint8)) {
+        writeCharacters<quint8>(cells, cellCount, out);
+    } else if (charSize == sizeof(quint16)) {
+        writeCharacters<quint16>(cells, cellCount, out);
+    } else {
+        writeCharacters<quint32>(cells, cellCount, out);
+    }
+
+    std::swap(_compressingFrame, _openFrame);
+    _openFrame.clear();
+    _compressing = true;
+    QThreadPool::globalInstance()->start(new FrameCompressor(&_compressInput, &_compressOutput, &_compressDone));
+}
+
+void HistoryScrollCompressedFile::finishCompression(bool wait)
+{
+    if (!_compressing) {
+        return;
+    }
+    if (wait) {
+        _compressDone.acquire();
+    } else if (!_compressDone.tryAcquire()) {
+        return;
+    }
+    _compressing = false;
+
+    Frame frame;
+    frame.offset = _frameData->len();
+    frame.size = _compressOutput.size();
+    frame.firstLine = _frameLineCount;
+    _frameData->add(_compressOutput.constData(), _compressOutput.size());
+    _frames.append(frame);
+    _frameLineCount += _compressingFrame.lineCount();
+
+    // recent lines are the most likely to be read, keep the frame decompressed
+    FrameLines &lines = cacheSlot(_frames.size() - 1).lines;
+    std::swap(lines, _compressingFrame);
+    _compressingFrame.clear();
+}
+
+void HistoryScrollCompressedFile::truncate(int lineCount)
+{
+    finishCompression(true);
+
+    if (lineCount < _frameLineCount) {
+        // open the frame which holds the new last line again
+        const int frame = frameOf(lineCount);
+        _openFrame = decompressFrame(frame);
+        for (int i = _cache.size() - 1; i >= 0; i--) {
+            if (_cache[i].frame >= frame) {
+                _cache.remove(i);
+            }
+        }
+        _frameData->removeLast(_frames[frame].offset);
+        _frameLineCount = _frames[frame].firstLine;
+        _frames.resize(frame);
+    }
+    _openFrame.truncate(lineCount - _frameLineCount);
+}
+
+void HistoryScrollCompressedFile::dropFrames()
+{
+    int frames = 0;
+    while (frames < _frames.size()
+           && (frames + 1 < _frames.size() ? _frames[frames + 1].firstLine : _frameLineCount) <= _droppedLines) {
+        frames++;
+    }
+    if (frames == 0) {
+        return;
+    }
+
+    // the stored lines are numbered from the first frame which is left
+    const int lines = frames < _frames.size() ? _frames[frames].firstLine : _frameLineCount;
+    for (int i = _cache.size() - 1; i >= 0; i--) {
+        if (_cache[i].frame < frames) {
+            _cache.remove(i);
+        } else {
+            _cache[i].frame -= frames;
+        }
+    }
+    _frames.remove(0, frames);
+    for (Frame &frame : _frames) {
+        frame.firstLine -= lines;
+    }
+    _frameLineCount -= lines;
+    _droppedLines -= lines;
+
+    // every byte of a dropped frame is copied at most once
+    const qint64 droppedBytes = _frames.isEmpty() ? _frameData->len() : _frames.first().offset;
+    if (droppedBytes >= MIN_COMPACT_SIZE && droppedBytes >= _frameData->len() - droppedBytes) {
+        compactFile();
+    }
+}
+
+void HistoryScrollCompressedFile::compactFile()
+{
+    // a frame which is being compressed is added to the new file
+    std::unique_ptr<HistoryFile> file(new HistoryFile());
+    for (Frame &frame : _frames) {
+        _buffer.resize(frame.size);
+        _frameData->get(_buffer.data(), frame.size, frame.offset);
+        frame.offset = file->len();
+        file->add(_buffer.constData(), frame.size);
+    }
+    _frameData = std::move(file);
+}
+
+int HistoryScrollCompressedFile::getLineLen(int lineno)
+{
+    if (lineno < 0 || lineno >= getLines()) {
+        return 0;
+    }
+
+    int line;
+    const FrameLines &lines = linesOf(lineno, line);
+    return lines.lineEnds[line] - lines.startOfLine(line);
+}
+
+void HistoryScrollCompressedFile::getCells(int lineno, int colno, int count, Character res[])
+{
+    if (count == 0) {
+        return;
+    }
+    Q_ASSERT(lineno >= 0 && lineno < getLines());
+
+    int line;
+    const FrameLines &lines = linesOf(lineno, line);
+    Q_ASSERT(colno >= 0 && lines.startOfLine(line) + colno + count <= lines.lineEnds[line]);
+    std::copy_n(lines.cells.constData() + lines.startOfLine(line) + colno, count, res);
+}
+
+bool HistoryScrollCompressedFile::isWrappedLine(int lineno)
+{
+    return getLineProperty(lineno) & LINE_WRAPPED;
+}
+
+LineProperty HistoryScrollCompressedFile::getLineProperty(int lineno)
+{
+    if (lineno < 0 || lineno >= getLines()) {
+        return 0;
+    }
+
+    int line;
+    const FrameLines &lines = linesOf(lineno, line);
+    return lines.flags[line];
+}
+
+void HistoryScrollCompressedFile::addCells(const Character text[], int count)
+{
+    const int size = _openFrame.cells.size();
+    _openFrame.cells.resize(size + count);
+    std::copy_n(text, count, _openFrame.cells.data() + size);
+}
+
+void HistoryScrollCompressedFile::addLine(LineProperty lineProperty)
+{
+    _openFrame.lineEnds.append(_openFrame.cells.size());
+    _openFrame.flags.append(lineProperty);
+
+    finishCompression(false);
+    if (_openFrame.cells.size() >= FRAME_CELLS || _openFrame.lineCount() >= FRAME_LINES) {
+        sealFrame();
+    }
+
+    if (_maxLines >= 0 && getLines() > _maxLines) {
+        _droppedLines++;
+        dropFrames();
+    }
+}
+
+void HistoryScrollCompressedFile::removeCells()
+{
+    if (getLines() > 0) {
+        truncate(_droppedLines + getLines() - 1);
+    }
+}
+
+void HistoryScrollCompressedFile::setMaxLines(int maxLines)
+{
+    // the type may be the one which sets the limit, see HistoryTypeCompressedFile::scroll()
+    if (maxLines != _maxLines) {
+        delete _historyType;
+        _historyType = new HistoryTypeCompressedFile(maxLines);
+        _maxLines = maxLines;
+    }
+
+    if (_maxLines >= 0 && getLines() > _maxLines) {
+        _droppedLines += getLines() - _maxLines;
+        dropFrames();
+    }
+}
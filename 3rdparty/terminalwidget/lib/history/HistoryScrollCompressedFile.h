@@ -0,0 +1,149 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef HISTORYSCROLLCOMPRESSEDFILE_H
+#define HISTORYSCROLLCOMPRESSEDFILE_H
+
+// Qt
+#include <QByteArray>
+#include <QSemaphore>
+#include <QVector>
+
+// STD
+#include <memory>
+
+// History
+#include "HistoryFile.h"
+#include "HistoryScroll.h"
+
+namespace Konsole
+{
+
+/**
+ * File-based history, stored compressed.
+ *
+ * Lines are collected in an uncompressed frame in memory.  Once the frame
+ * holds FRAME_CELLS cells or FRAME_LINES lines it is compressed on its own
+ * by a background thread and appended to the history file, and a frame
+ * index remembers the first line and file offset of every frame.  Reading a line decompresses only
+ * the frame which holds it, and the last few decompressed frames are kept,
+ * so scrolling through the history does not decompress a frame per line.
+ *
+ * Before compression the cells of a frame are split into runs of cells with
+ * the same colours and rendition and the characters alone, as narrow as the
+ * widest character of the frame allows, so log style output takes a small
+ * fraction of the size of Character cells on disk.
+ *
+ * The history may be limited to a number of lines.  Lines dropped from its
+ * front are skipped until the whole first frame is dropped, and the history
+ * file is rewritten without the dropped frames once they take more space
+ * than the frames which are left.
+ */
+class HistoryScrollCompressedFile : public HistoryScroll
+{
+public:
+    explicit HistoryScrollCompressedFile(int maxLines = -1);
+    ~HistoryScrollCompressedFile() override;
+
+    int  getLines() override;
+    int  getMaxLines() override;
+    qint64 memoryUsage() override;
+    int  getLineLen(int lineno) override;
+    void getCells(int lineno, int colno, int count, Character res[]) override;
+    bool isWrappedLine(int lineno) override;
+    LineProperty getLineProperty(int lineno) override;
+
+    void addCells(const Character text[], int count) override;
+    void addLine(LineProperty lineProperty = 0) override;
+
+    // Modify history
+    void removeCells() override;
+
+    // -1 for an unlimited history
+    void setMaxLines(int maxLines);
+
+private:
+    // lines of a frame, decompressed
+    struct FrameLines {
+        QVector<Character> cells;
+        QVector<int> lineEnds;          // cell after the last cell of each line
+        QVector<LineProperty> flags;
+
+        int lineCount() const { return lineEnds.size(); }
+        int startOfLine(int line) const { return line == 0 ? 0 : lineEnds[line - 1]; }
+        void truncate(int lines);
+        void clear();
+    };
+
+    struct Frame {
+        qint64 offset;          // in _frameData
+        int size;               // compressed bytes
+        int firstLine;
+    };
+
+    struct CachedFrame {
+        int frame;              // index in _frames
+        quint64 lastUse;
+        FrameLines lines;
+    };
+
+    // index of the frame which holds the stored line 'lineno', which must
+    // be in _frames
+    int frameOf(int lineno) const;
+    // returns the lines of the frame which holds the line 'lineno' of the
+    // history and sets 'line' to its index in the frame.  The reference is
+    // valid until the next read or modification of the history.
+    const FrameLines &linesOf(int lineno, int &line);
+    const FrameLines &decompressFrame(int frame);
+    // returns the cache entry for 'frame', evicting the least recently used
+    CachedFrame &cacheSlot(int frame);
+    // starts compressing the open frame in the background
+    void sealFrame();
+    // appends the frame compressed in the background to the file if it has
+    // been compressed, or waits for it to be compressed if 'wait' is true
+    void finishCompression(bool wait);
+    // removes all stored lines from 'lineCount' on
+    void truncate(int lineCount);
+    // removes the frames whose lines have all been dropped
+    void dropFrames();
+    // moves the frames which are left to a new history file
+    void compactFile();
+
+    std::unique_ptr<HistoryFile> _frameData;
+    QVector<Frame> _frames;
+    int _frameLineCount;        // lines in _frames
+
+    // the first stored lines, which are no longer part of the history
+    int _droppedLines;
+    int _maxLines;
+
+    // the lines after the last frame while they are compressed, read from
+    // here until the compressed frame is in the file
+    FrameLines _compressingFrame;
+    QByteArray _compressInput;
+    QByteArray _compressOutput;
+    bool _compressing;
+    QSemaphore _compressDone;
+
+    // the lines after those, not compressed yet
+    FrameLines _openFrame;
+
+    QVector<CachedFrame> _cache;
+    quint64 _cacheUses;
+
+    // reused to decode frames
+    QByteArray _buffer;
+
+    static const int FRAME_CELLS = 32 * 1024;
+    static const int FRAME_LINES = 4096;
+    static const int MAX_CACHED_FRAMES = 4;
+    // the file is not rewritten for fewer bytes of dropped frames
+    static const qint64 MIN_COMPACT_SIZE = 4 * 1024 * 1024;
+};
+
+}
+
+#endif
@@ -47,7 +47,6 @@ public:
 
     // Modify history
     void removeCells() override;
-    int reflowLines(int columns) override;
 
 private:
     qint64 startOfLine(int lineno);
@@ -55,11 +54,6 @@ private:
     HistoryFile _index; // lines Row(qint64)
     HistoryFile _cells; // text  Row(Character)
     HistoryFile _lineflags; // flags Row(unsigned char)
-
-    struct reflowData { // data to reflow lines
-        qint64 index;
-        bool lineFlag;
-    };
 };
 
 }
@@ -79,7 +79,3 @@ void HistoryScrollNone::removeCells()
 {
 }
 
-int HistoryScrollNone::reflowLines(int)
-{
-    return 0;
-}
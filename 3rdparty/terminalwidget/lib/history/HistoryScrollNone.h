@@ -46,7 +46,6 @@ public:
 
     // Modify history (do nothing here)
     void removeCells() override;
-    int reflowLines(int) override;
 };
 
 }
@@ -0,0 +1,50 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "HistoryTypeCompressedFile.h"
+
+#include "HistoryScrollCompressedFile.h"
+
+using namespace Konsole;
+
+HistoryTypeCompressedFile::HistoryTypeCompressedFile(int maxLines) :
+    _maxLines(maxLines)
+{
+}
+
+bool HistoryTypeCompressedFile::isEnabled() const
+{
+    return true;
+}
+
+HistoryScroll *HistoryTypeCompressedFile::scroll(HistoryScroll *old) const
+{
+    auto *compressedScroll = dynamic_cast<HistoryScrollCompressedFile *>(old);
+    if (compressedScroll != nullptr) {
+        compressedScroll->setMaxLines(_maxLines);
+        return compressedScroll;
+    }
+    HistoryScroll *newScroll = new HistoryScrollCompressedFile(_maxLines);
+
+    QVector<Character> line;
+    const int lines = (old != nullptr) ? old->getLines() : 0;
+    for (int i = _maxLines >= 0 ? qMax(lines - _maxLines, 0) : 0; i < lines; i++) {
+        const int size = old->getLineLen(i);
+        line.resize(size);
+        old->getCells(i, 0, size, line.data());
+        newScroll->addCells(line.constData(), size);
+        newScroll->addLine(old->getLineProperty(i));
+    }
+
+    delete old;
+    return newScroll;
+}
+
+int HistoryTypeCompressedFile::maximumLineCount() const
+{
+    return _maxLines;
+}
@@ -0,0 +1,35 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef HISTORYTYPECOMPRESSEDFILE_H
+#define HISTORYTYPECOMPRESSEDFILE_H
+
+#include "HistoryType.h"
+
+namespace Konsole
+{
+
+/**
+ * History like HistoryTypeFile, stored in compressed frames, which is
+ * unlimited or keeps the last @p maxLines lines, see HistoryScrollCompressedFile.
+ */
+class HistoryTypeCompressedFile : public HistoryType
+{
+public:
+    explicit HistoryTypeCompressedFile(int maxLines = -1);
+
+    bool isEnabled() const override;
+    int maximumLineCount() const override;
+
+    HistoryScroll *scroll(HistoryScroll *) const override;
+
+private:
+    int _maxLines;
+};
+
+}
+
+#endif
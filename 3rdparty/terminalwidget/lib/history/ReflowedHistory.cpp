@@ -0,0 +1,486 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+// Own
+#include "ReflowedHistory.h"
+
+// STD
+#include <algorithm>
+
+using namespace Konsole;
+
+ReflowedHistory::ReflowedHistory(HistoryScroll *history) :
+    _history(history),
+    _columns(0),
+    _droppedLines(0),
+    _mappedLinesStart(0),
+    _mappedLinesEnd(0),
+    _mappedRowsStart(0),
+    _mappedRowsEnd(0),
+    _groups(),
+    _revision(0),
+    _index(),
+    _extendedChars(nullptr),
+    _extendedLines()
+{
+}
+
+ReflowedHistory::~ReflowedHistory() = default;
+
+void ReflowedHistory::setHistory(HistoryScroll *history)
+{
+    _history = history;
+    _columns = 0;
+    _droppedLines = 0;
+    _mappedLinesStart = 0;
+    _mappedLinesEnd = 0;
+    _mappedRowsStart = 0;
+    _mappedRowsEnd = 0;
+    _groups.clear();
+    _index.reset();
+
+    // the lines of the new history may be copied from the old one
+    while (!_extendedLines.empty()) {
+        derefExtendedChars(_extendedLines.back().line);
+    }
+    if (_extendedChars) {
+        QVector<Character> cells;
+        const int lines = _history->getLines();
+        for (int line = 0; line < lines; line++) {
+            cells.resize(_history->getLineLen(line));
+            _history->getCells(line, 0, cells.size(), cells.data());
+            refExtendedChars(line, cells);
+        }
+    }
+}
+
+void ReflowedHistory::setExtendedCharTable(ExtendedCharTable *table)
+{
+    _extendedChars = table;
+}
+
+void ReflowedHistory::refExtendedChars(qint64 line, const QVector<Character> &cells)
+{
+    if (!_extendedChars) {
+        return;
+    }
+
+    ExtendedLine extendedLine;
+    for (const Character &cell : cells) {
+        if (cell.rendition & RE_EXTENDED_CHAR) {
+            _extendedChars->ref(cell.character);
+            extendedLine.ids.append(cell.character);
+        }
+    }
+    if (!extendedLine.ids.isEmpty()) {
+        extendedLine.line = line;
+        _extendedLines.push_back(extendedLine);
+    }
+}
+
+void ReflowedHistory::derefExtendedChars(qint64 line)
+{
+    // lines are only removed from the start and the end
+    ExtendedLine *extendedLine = nullptr;
+    if (!_extendedLines.empty() && _extendedLines.front().line == line) {
+        extendedLine = &_extendedLines.front();
+    } else if (!_extendedLines.empty() && _extendedLines.back().line == line) {
+        extendedLine = &_extendedLines.back();
+    } else {
+        return;
+    }
+
+    for (uint id : qAsConst(extendedLine->ids)) {
+        _extendedChars->deref(id);
+    }
+    if (extendedLine == &_extendedLines.front()) {
+        _extendedLines.pop_front();
+    } else {
+        _extendedLines.pop_back();
+    }
+}
+
+int ReflowedHistory::getLines() const
+{
+    const qint64 lines = _droppedLines + _history->getLines();
+    return static_cast<int>((_mappedLinesStart - _droppedLines) + (_mappedRowsEnd - _mappedRowsStart)
+                            + (lines - _mappedLinesEnd));
+}
+
+quint64 ReflowedHistory::revision() const
+{
+    return _revision;
+}
+
+int ReflowedHistory::rowCount(int length) const
+{
+    return qMax(1, (length + _columns - 1) / _columns);
+}
+
+ReflowedHistory::Row ReflowedHistory::lineRow(int line) const
+{
+    Row row;
+    row.mapped = false;
+    row.line = line;
+    row.lines = 1;
+    row.start = 0;
+    row.length = _history->getLineLen(line);
+    row.wrapped = _history->isWrappedLine(line);
+    row.group = nullptr;
+    return row;
+}
+
+ReflowedHistory::Row ReflowedHistory::locate(int row) const
+{
+    const int unmappedRows = static_cast<int>(_mappedLinesStart - _droppedLines);
+    if (row < unmappedRows) {
+        return lineRow(row);
+    }
+    const qint64 mappedRows = _mappedRowsEnd - _mappedRowsStart;
+    if (row >= unmappedRows + mappedRows) {
+        return lineRow(static_cast<int>(row - unmappedRows - mappedRows + _mappedLinesEnd - _droppedLines));
+    }
+
+    // rows between groups are lines which fit the width as they are
+    const qint64 id = _mappedRowsStart + (row - unmappedRows);
+    auto it = std::upper_bound(_groups.begin(), _groups.end(), id,
+                               [](qint64 id, const Group &group) { return id < group.firstRow; });
+    if (it == _groups.begin()) {
+        return lineRow(static_cast<int>(_mappedLinesStart + (id - _mappedRowsStart) - _droppedLines));
+    }
+    const Group &group = *(it - 1);
+    if (id >= group.firstRow + group.rows) {
+        return lineRow(static_cast<int>(group.firstLine + group.lines + (id - group.firstRow - group.rows)
+                                        - _droppedLines));
+    }
+
+    Row result;
+    result.mapped = true;
+    result.line = static_cast<int>(group.firstLine - _droppedLines);
+    result.lines = group.lines;
+    const int index = static_cast<int>(id - group.firstRow);
+    result.start = index * _columns;
+    result.length = qMin(_columns, group.length() - result.start);
+    result.wrapped = index < group.rows - 1
+                     || (_history->getLineProperty(result.line + result.lines - 1) & LINE_WRAPPED);
+    result.group = &group;
+    return result;
+}
+
+int ReflowedHistory::getLineLen(int row) const
+{
+    return locate(row).length;
+}
+
+void ReflowedHistory::getCells(int row, int column, int count, Character buffer[]) const
+{
+    if (count == 0) {
+        return;
+    }
+
+    const Row location = locate(row);
+    Q_ASSERT(column >= 0 && column + count <= location.length);
+    if (!location.mapped) {
+        _history->getCells(location.line, column, count, buffer);
+        return;
+    }
+
+    // the cells of a row may be spread over several lines of the group,
+    // starting with the last line which starts before its first cell
+    const Group &group = *location.group;
+    const auto first = group.offsets.constBegin() + group.skippedLines;
+    const int start = location.start + column;
+    int index = static_cast<int>(std::upper_bound(first, first + group.lines, group.offsets[group.skippedLines] + start)
+                                 - first) - 1;
+    int offset = start - group.offsetOf(index);
+    for (; count > 0; index++) {
+        Q_ASSERT(index < location.lines);
+        const int length = group.offsetOf(index + 1) - group.offsetOf(index);
+        if (offset >= length) {
+            offset -= length;
+            continue;
+        }
+        const int cells = qMin(count, length - offset);
+        _history->getCells(location.line + index, offset, cells, buffer);
+        buffer += cells;
+        count -= cells;
+        offset = 0;
+    }
+}
+
+bool ReflowedHistory::isWrappedLine(int row) const
+{
+    return locate(row).wrapped;
+}
+
+LineProperty ReflowedHistory::getLineProperty(int row) const
+{
+    const Row location = locate(row);
+    const LineProperty property = _history->getLineProperty(location.line);
+    if (!location.mapped) {
+        return property;
+    }
+    return (property & ~LINE_WRAPPED) | (location.wrapped ? LINE_WRAPPED : 0);
+}
+
+int ReflowedHistory::addLine(const QVector<Character> &cells, LineProperty property)
+{
+    const int lines = _history->getLines();
+    _history->addCellsVector(cells);
+    _history->addLine(property);
+
+    int droppedRows = 0;
+    if (_history->getLines() == lines) {
+        // a history without lines does not keep any
+        if (lines == 0) {
+            return 1;
+        }
+        droppedRows = dropFirstLine();
+    }
+    refExtendedChars(_droppedLines + _history->getLines() - 1, cells);
+    if (_index) {
+        _index->addLine();
+    }
+    return droppedRows;
+}
+
+void ReflowedHistory::appendHistoryLine(const QVector<Character> &cells, LineProperty property)
+{
+    _history->addCellsVector(cells);
+    _history->addLine(property);
+    refExtendedChars(_droppedLines + _history->getLines() - 1, cells);
+    if (_index) {
+        _index->addLine();
+    }
+}
+
+void ReflowedHistory::removeHistoryLine()
+{
+    if (_index) {
+        _index->removeLastLine();
+    }
+    derefExtendedChars(_droppedLines + _history->getLines() - 1);
+    _history->removeCells();
+}
+
+int ReflowedHistory::dropFirstLine()
+{
+    if (_index) {
+        _index->dropFirstLine();
+    }
+    derefExtendedChars(_droppedLines);
+
+    const qint64 line = _droppedLines++;
+    if (line < _mappedLinesStart) {
+        return 1;
+    }
+    if (line >= _mappedLinesEnd) {
+        _mappedLinesStart = _mappedLinesEnd = _droppedLines;
+        return 1;
+    }
+
+    _mappedLinesStart++;
+    if (_groups.empty() || _groups.front().firstLine != line) {
+        _mappedRowsStart++;
+        return 1;
+    }
+
+    // the rest of the group is split anew from its new start
+    Group &group = _groups.front();
+    const int rows = group.rows;
+    group.firstLine++;
+    group.skippedLines++;
+    group.lines--;
+    group.rows = group.lines > 0 ? rowCount(group.length()) : 0;
+    if (group.lines > 0) {
+        _revision++;
+    }
+    const int droppedRows = rows - group.rows;
+    group.firstRow += droppedRows;
+    _mappedRowsStart += droppedRows;
+    if (group.lines == 0 || (group.lines == 1 && group.rows == 1)) {
+        _groups.pop_front();
+    }
+    return droppedRows;
+}
+
+void ReflowedHistory::removeLastLine()
+{
+    const int lines = _history->getLines();
+    if (lines == 0) {
+        return;
+    }
+
+    const qint64 last = _droppedLines + lines - 1;
+    if (last >= _mappedLinesEnd) {
+        removeHistoryLine();
+        return;
+    }
+    if (last < _mappedLinesStart) {
+        removeHistoryLine();
+        _mappedLinesStart = _mappedLinesEnd = last;
+        return;
+    }
+    if (_groups.empty() || _groups.back().firstLine + _groups.back().lines <= last) {
+        removeHistoryLine();
+        _mappedLinesEnd--;
+        _mappedRowsEnd--;
+        return;
+    }
+
+    // Remove the lines of the group after the start of its last row.  The
+    // line which is cut keeps its first part, which continues in the row.
+    Group &group = _groups.back();
+    const int first = static_cast<int>(group.firstLine - _droppedLines);
+    const int cut = (group.rows - 1) * _columns;
+    while (group.lines > 0) {
+        const int line = first + group.lines - 1;
+        const int start = group.offsetOf(group.lines - 1);
+        if (start < cut) {
+            if (group.offsetOf(group.lines) > cut) {
+                QVector<Character> cells(cut - start);
+                _history->getCells(line, 0, cells.size(), cells.data());
+                const LineProperty property = _history->getLineProperty(line);
+                removeHistoryLine();
+                appendHistoryLine(cells, property | LINE_WRAPPED);
+                group.offsets[group.skippedLines + group.lines] = group.offsets[group.skippedLines] + cut;
+            }
+            break;
+        }
+        removeHistoryLine();
+        _mappedLinesEnd--;
+        group.lines--;
+    }
+    group.offsets.resize(group.skippedLines + group.lines + 1);
+
+    group.rows--;
+    _mappedRowsEnd--;
+    Q_ASSERT(group.lines > 0 || group.rows == 0);
+    if (group.rows == 0 || (group.lines == 1 && group.rows == 1)) {
+        _groups.pop_back();
+    }
+}
+
+void ReflowedHistory::reflow(int columns, int rows)
+{
+    Q_ASSERT(columns > 0);
+    _columns = columns;
+    _groups.clear();
+    _mappedLinesStart = _mappedLinesEnd = _droppedLines + _history->getLines();
+    _mappedRowsStart = _mappedRowsEnd = 0;
+
+    while (isReflowing() && _mappedRowsEnd - _mappedRowsStart < rows) {
+        mapPreviousGroup();
+    }
+}
+
+bool ReflowedHistory::isReflowing() const
+{
+    return _columns > 0 && _mappedLinesStart > _droppedLines;
+}
+
+int ReflowedHistory::mapPreviousGroup()
+{
+    // double height lines keep their width and are never joined
+    const LineProperty doubleHeight = LINE_DOUBLEHEIGHT_TOP | LINE_DOUBLEHEIGHT_BOTTOM;
+    const int end = static_cast<int>(_mappedLinesStart - _droppedLines);
+    int start = end - 1;
+    if (!(_history->getLineProperty(start) & doubleHeight)) {
+        while (start > 0) {
+            const LineProperty property = _history->getLineProperty(start - 1);
+            if (!(property & LINE_WRAPPED) || (property & doubleHeight)) {
+                break;
+            }
+            start--;
+        }
+    }
+
+    const int lines = end - start;
+    int rows = lines;
+    if (!(_history->getLineProperty(start) & doubleHeight)) {
+        QVector<int> offsets(lines + 1);
+        for (int i = 0; i < lines; i++) {
+            offsets[i + 1] = offsets[i] + _history->getLineLen(start + i);
+        }
+        const int length = offsets[lines];
+        if (lines > 1 || length > _columns) {
+            rows = rowCount(length);
+            _groups.push_front(Group{_droppedLines + start, _mappedRowsStart - rows, lines, rows, offsets, 0});
+        }
+    }
+    _mappedLinesStart -= lines;
+    _mappedRowsStart -= rows;
+    return rows;
+}
+
+void ReflowedHistory::continueReflow(int lineCount, int &firstRow, int &oldRows, int &newRows)
+{
+    const qint64 mappedLinesStart = _mappedLinesStart;
+    newRows = 0;
+    while (isReflowing() && mappedLinesStart - _mappedLinesStart < lineCount) {
+        newRows += mapPreviousGroup();
+    }
+    firstRow = static_cast<int>(_mappedLinesStart - _droppedLines);
+    oldRows = static_cast<int>(mappedLinesStart - _mappedLinesStart);
+}
+
+int ReflowedHistory::rowOfLine(int line) const
+{
+    const qint64 id = _droppedLines + line;
+    const int unmappedRows = static_cast<int>(_mappedLinesStart - _droppedLines);
+    if (id < _mappedLinesStart) {
+        return line;
+    }
+    const qint64 mappedRows = _mappedRowsEnd - _mappedRowsStart;
+    if (id >= _mappedLinesEnd) {
+        return static_cast<int>(unmappedRows + mappedRows + (id - _mappedLinesEnd));
+    }
+
+    qint64 row;
+    auto it = std::upper_bound(_groups.begin(), _groups.end(), id,
+                               [](qint64 id, const Group &group) { return id < group.firstLine; });
+    if (it == _groups.begin()) {
+        row = _mappedRowsStart + (id - _mappedLinesStart);
+    } else {
+        const Group &group = *(it - 1);
+        if (id < group.firstLine + group.lines) {
+            const int offset = group.offsetOf(static_cast<int>(id - group.firstLine));
+            row = group.firstRow + qMin(offset / _columns, group.rows - 1);
+        } else {
+            row = group.firstRow + group.rows + (id - group.firstLine - group.lines);
+        }
+    }
+    return static_cast<int>(unmappedRows + (row - _mappedRowsStart));
+}
+
+QVector<QPair<int, int>> ReflowedHistory::candidateRows(const QString &text)
+{
+    if (!_index) {
+        _index.reset(new HistoryIndex(_history, _extendedChars));
+    }
+
+    const QVector<QPair<int, int>> lines = _index->candidateLines(text);
+    QVector<QPair<int, int>> rows;
+    rows.reserve(lines.size());
+    const int lineCount = _history->getLines();
+    const int rowCount = getLines();
+    for (const QPair<int, int> &range : lines) {
+        // the last line of the range may end in the row after its first cell
+        const int first = rowOfLine(range.first);
+        const int end = range.second < lineCount ? qMin(rowOfLine(range.second) + 1, rowCount) : rowCount;
+        if (!rows.isEmpty() && rows.last().second >= first) {
+            rows.last().second = qMax(rows.last().second, end);
+        } else {
+            rows.append(qMakePair(first, end));
+        }
+    }
+    return rows;
+}
+
+qint64 ReflowedHistory::indexMemoryUsage() const
+{
+    return _index ? _index->memoryUsage() : 0;
+}
@@ -0,0 +1,176 @@
+/*
+    SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef REFLOWEDHISTORY_H
+#define REFLOWEDHISTORY_H
+
+// STD
+#include <deque>
+#include <memory>
+
+// Qt
+#include <QPair>
+#include <QVector>
+
+#include "HistoryIndex.h"
+#include "HistoryScroll.h"
+
+namespace Konsole
+{
+
+/**
+ * The lines of a HistoryScroll as Screen shows them, rewrapped to the width
+ * of the screen.
+ *
+ * The history keeps the lines as they were added, so a line which was
+ * wrapped at the old width is a group of lines joined by LINE_WRAPPED.
+ * Instead of rewriting the history when the width changes, reflow() maps
+ * such groups to rows of the new width, splitting their cells anew each
+ * time a row is read.  Only groups which do not fit the width as they are
+ * need an entry in the map.
+ *
+ * The history is mapped from its end, where the screen is, so a reflow
+ * maps just enough rows for the screen and continueReflow() maps the older
+ * lines in steps afterwards.  Until then they are shown as they were added.
+ *
+ * The rows are, from the start:
+ *   - lines which are not mapped yet, one row each
+ *   - mapped lines
+ *   - lines added after the last reflow(), one row each
+ *
+ * The lines are indexed by a HistoryIndex once the history is searched.
+ * They hold a reference to their extended characters in the ExtendedCharTable
+ * of the screen while they are in the history.
+ */
+class ReflowedHistory
+{
+public:
+    explicit ReflowedHistory(HistoryScroll *history);
+    ~ReflowedHistory();
+
+    /** Shows the lines of @p history as they are, without a reflow. */
+    void setHistory(HistoryScroll *history);
+    /** Sets the table of the extended characters of the lines. */
+    void setExtendedCharTable(ExtendedCharTable *table);
+
+    int  getLines() const;
+    int  getLineLen(int row) const;
+    void getCells(int row, int column, int count, Character buffer[]) const;
+    bool isWrappedLine(int row) const;
+    LineProperty getLineProperty(int row) const;
+
+    /**
+     * Adds a line to the end of the history and returns the number of rows
+     * which were removed from the start, because the history was full.
+     */
+    int addLine(const QVector<Character> &cells, LineProperty property);
+    /** Removes the last row. */
+    void removeLastLine();
+    /**
+     * Returns a number which changes when rows of the history show other
+     * cells without being added or removed, which happens when a line is
+     * dropped from the start of a group of wrapped lines and the rest of the
+     * group is split into rows anew.
+     */
+    quint64 revision() const;
+
+    /**
+     * Starts to reflow the history to @p columns and maps lines from the end
+     * until at least @p rows rows are mapped.
+     */
+    void reflow(int columns, int rows);
+    /** Returns true if there are lines left to be mapped by continueReflow(). */
+    bool isReflowing() const;
+    /**
+     * Maps about @p lineCount more lines.  The rows from @p firstRow to
+     * @p firstRow + @p oldRows are replaced by @p newRows rows, the rows
+     * before and after them keep their content.
+     */
+    void continueReflow(int lineCount, int &firstRow, int &oldRows, int &newRows);
+
+    /**
+     * Returns the ranges of rows, first row and row after the last one, in
+     * which @p text may start.  A range may start or end in the middle of a
+     * group of wrapped rows.
+     */
+    QVector<QPair<int, int>> candidateRows(const QString &text);
+    /** Returns the bytes of memory used by the search index. */
+    qint64 indexMemoryUsage() const;
+
+private:
+    // a group of lines which is split into rows of _columns cells
+    struct Group {
+        qint64 firstLine;
+        qint64 firstRow;
+        int lines;
+        int rows;
+        // the cell at which each line of the group starts and the length of
+        // the group, counted from the line it was mapped with.  Lines which
+        // are dropped from its start are skipped.
+        QVector<int> offsets;
+        int skippedLines;
+
+        // the cell of the group at which its line 'line' starts
+        int offsetOf(int line) const { return offsets[skippedLines + line] - offsets[skippedLines]; }
+        int length() const { return offsetOf(lines); }
+    };
+
+    struct Row {
+        bool mapped;        // false if the row is a line of the history
+        int line;           // first line of the group, or the line itself
+        int lines;          // lines in the group
+        int start;          // cell of the group at which the row starts
+        int length;
+        bool wrapped;
+        const Group *group; // the group of a mapped row
+    };
+
+    Row locate(int row) const;
+    int rowCount(int length) const;
+    Row lineRow(int line) const;
+    // the row which holds the first cell of 'line'
+    int rowOfLine(int line) const;
+    // maps the group of lines which ends before the first mapped line and
+    // returns the number of rows it takes now
+    int mapPreviousGroup();
+    // returns the number of rows removed with the first line
+    int dropFirstLine();
+    // adds and removes lines of the history, keeping the index up to date
+    void appendHistoryLine(const QVector<Character> &cells, LineProperty property);
+    void removeHistoryLine();
+    // add and remove the references of line 'line' to its extended characters
+    void refExtendedChars(qint64 line, const QVector<Character> &cells);
+    void derefExtendedChars(qint64 line);
+
+    HistoryScroll *_history;
+    int _columns;
+
+    // Lines and mapped rows are identified by numbers which do not change
+    // when lines are dropped from the start of the history, the index of a
+    // line is its number minus _droppedLines.
+    qint64 _droppedLines;
+    qint64 _mappedLinesStart;
+    qint64 _mappedLinesEnd;
+    qint64 _mappedRowsStart;
+    qint64 _mappedRowsEnd;
+    std::deque<Group> _groups;
+    quint64 _revision;
+
+    // built by the first search
+    std::unique_ptr<HistoryIndex> _index;
+
+    // the extended characters of the lines which have any
+    struct ExtendedLine {
+        qint64 line;
+        QVector<uint> ids;
+    };
+    ExtendedCharTable *_extendedChars;
+    std::deque<ExtendedLine> _extendedLines;
+};
+
+}
+
+#endif
@@ -9,18 +9,27 @@
 
 #include "CompactHistoryType.h"
 
+// STD
+#include <cstring>
+
 using namespace Konsole;
 
-struct reflowData { // data to reflow lines
-    QList<int> index;
-    QList<LineProperty> flags;
-};
+static_assert(sizeof(CharacterColor) == sizeof(quint32), "CharacterColor is used as a style key");
 
 CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount) :
     HistoryScroll(new CompactHistoryType(maxLineCount)),
-    _cells(),
-    _index(),
-    _flags(),
+    _blocks(),
+    _spareBlock(),
+    _blocksStart(0),
+    _dataStart(0),
+    _dataEnd(0),
+    _lines(),
+    _styles(),
+    _styleRefs(),
+    _freeStyles(),
+    _styleIds(),
+    _runBuffer(),
+    _textBuffer(),
     _maxLineCount(0)
 {
     setMaxNbLines(maxLineCount);
@@ -28,48 +37,211 @@ CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount) :
 
 void CompactHistoryScroll::removeFirstLine()
 {
-    _flags.pop_front();
+    releaseLine(_lines.front(), _dataStart);
+    _dataStart = _lines.front().end;
+    _lines.pop_front();
+
+    releaseUnusedBlocks();
+}
+
+void CompactHistoryScroll::releaseUnusedBlocks()
+{
+    // blocks which only hold data of removed lines
+    while (!_blocks.empty() && _blocksStart + BlockSize <= _dataStart) {
+        _spareBlock = std::move(_blocks.front());
+        _blocks.pop_front();
+        _blocksStart += BlockSize;
+    }
+    // blocks after the last byte
+    while (!_blocks.empty() && _blocksStart + qint64(_blocks.size() - 1) * BlockSize >= _dataEnd) {
+        _spareBlock = std::move(_blocks.back());
+        _blocks.pop_back();
+    }
+    if (_blocks.empty()) {
+        _blocksStart = _dataEnd - _dataEnd % BlockSize;
+    }
+
+    // no line refers to a style any more, start over with an empty table
+    if (_lines.empty()) {
+        _styles.clear();
+        _styleRefs.clear();
+        _freeStyles.clear();
+        _styleIds.clear();
+    }
+}
 
-    auto removing = _index.first();
-    _index.pop_front();
-    std::transform(_index.begin(), _index.end(), _index.begin(), [removing](int i) { return i - removing; });
+void CompactHistoryScroll::appendData(const void *data, int size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const qint64 offset = _dataEnd - _blocksStart;
+        const size_t block = static_cast<size_t>(offset / BlockSize);
+        const int position = static_cast<int>(offset % BlockSize);
+        if (block == _blocks.size()) {
+            _blocks.push_back(_spareBlock ? std::move(_spareBlock) : Block(new char[BlockSize]));
+        }
 
-    while (_cells.size() > _index.last()) {
-        _cells.pop_front();
+        const int length = qMin(size, BlockSize - position);
+        memcpy(_blocks[block].get() + position, bytes, static_cast<size_t>(length));
+        bytes += length;
+        size -= length;
+        _dataEnd += length;
     }
 }
 
-inline int CompactHistoryScroll::lineLen(int line)
+void CompactHistoryScroll::readData(qint64 offset, void *data, int size) const
 {
-    return line == 0 ? _index[0] : _index[line] - _index[line - 1];
+    char *bytes = static_cast<char *>(data);
+    offset -= _blocksStart;
+    while (size > 0) {
+        const char *block = _blocks[static_cast<size_t>(offset / BlockSize)].get();
+        const int position = static_cast<int>(offset % BlockSize);
+        const int length = qMin(size, BlockSize - position);
+        memcpy(bytes, block + position, static_cast<size_t>(length));
+        bytes += length;
+        size -= length;
+        offset += length;
+    }
 }
 
-inline int CompactHistoryScroll::startOfLine(int line)
+CompactHistoryScroll::StyleKey CompactHistoryScroll::styleKey(const Character &cell)
 {
-    return line == 0 ? 0 : _index[line - 1];
+    StyleKey key;
+    memcpy(&key.foreground, &cell.foregroundColor, sizeof(key.foreground));
+    memcpy(&key.background, &cell.backgroundColor, sizeof(key.background));
+    key.rendition = cell.rendition;
+    return key;
 }
 
-void CompactHistoryScroll::addCells(const Character a[], int count)
+int CompactHistoryScroll::styleId(const Character &cell)
+{
+    const StyleKey key = styleKey(cell);
+
+    auto it = _styleIds.constFind(key);
+    if (it != _styleIds.constEnd()) {
+        _styleRefs[it.value()]++;
+        return it.value();
+    }
+
+    Character style = cell;
+    style.character = 0;
+    quint16 id;
+    if (!_freeStyles.isEmpty()) {
+        id = _freeStyles.takeLast();
+        _styles[id] = style;
+        _styleRefs[id] = 1;
+    } else if (_styles.size() <= 0xFFFF) {
+        // ids are 16 bit
+        id = static_cast<quint16>(_styles.size());
+        _styles.append(style);
+        _styleRefs.append(1);
+    } else {
+        return -1;
+    }
+    _styleIds.insert(key, id);
+    return id;
+}
+
+void CompactHistoryScroll::releaseStyle(quint16 style)
+{
+    if (--_styleRefs[style] > 0) {
+        return;
+    }
+
+    _styleIds.remove(styleKey(_styles[style]));
+    _freeStyles.append(style);
+}
+
+void CompactHistoryScroll::releaseLine(const Line &line, qint64 start)
 {
-    std::copy(a, a + count, std::back_inserter(_cells));
+    if (line.encoding == CharacterEncoding) {
+        return;
+    }
 
-    _index.append(_cells.size());
-    _flags.append(LINE_DEFAULT);
+    _runBuffer.resize(line.runCount);
+    readData(start, _runBuffer.data(), line.runCount * static_cast<int>(sizeof(Run)));
+    for (const Run &run : qAsConst(_runBuffer)) {
+        releaseStyle(run.style);
+    }
+}
+
+void CompactHistoryScroll::appendLine(const Character cells[], int count, LineProperty flags)
+{
+    Line line;
+    line.length = count;
+    line.runCount = 0;
+    line.flags = flags;
+    line.encoding = Ucs2Encoding;
+
+    _runBuffer.clear();
+    for (int i = 0; i < count; i++) {
+        if (cells[i].character > 0xFFFF) {
+            line.encoding = Ucs4Encoding;
+        }
+        if (i > 0 && cells[i].equalsFormat(cells[i - 1]) && _runBuffer.last().length < 0xFFFF) {
+            _runBuffer.last().length++;
+            continue;
+        }
+        const int style = styleId(cells[i]);
+        if (style < 0) {
+            // the styles of the runs so far are not used either
+            for (const Run &run : qAsConst(_runBuffer)) {
+                releaseStyle(run.style);
+            }
+            line.encoding = CharacterEncoding;
+            break;
+        }
+        _runBuffer.append(Run{1, static_cast<quint16>(style)});
+    }
 
-    if (_index.size() > _maxLineCount) {
+    if (line.encoding == CharacterEncoding) {
+        appendData(cells, count * static_cast<int>(sizeof(Character)));
+    } else {
+        line.runCount = _runBuffer.size();
+        appendData(_runBuffer.constData(), line.runCount * static_cast<int>(sizeof(Run)));
+
+        if (line.encoding == Ucs4Encoding) {
+            _textBuffer.resize(count * static_cast<int>(sizeof(quint32)));
+            quint32 *text = reinterpret_cast<quint32 *>(_textBuffer.data());
+            for (int i = 0; i < count; i++) {
+                text[i] = cells[i].character;
+            }
+        } else {
+            _textBuffer.resize(count * static_cast<int>(sizeof(quint16)));
+            quint16 *text = reinterpret_cast<quint16 *>(_textBuffer.data());
+            for (int i = 0; i < count; i++) {
+                text[i] = static_cast<quint16>(cells[i].character);
+            }
+        }
+        appendData(_textBuffer.constData(), _textBuffer.size());
+    }
+
+    line.end = _dataEnd;
+    _lines.push_back(line);
+}
+
+inline qint64 CompactHistoryScroll::startOfLine(int line) const
+{
+    return line == 0 ? _dataStart : _lines[static_cast<size_t>(line - 1)].end;
+}
+
+void CompactHistoryScroll::addCells(const Character a[], int count)
+{
+    appendLine(a, count, LINE_DEFAULT);
+
+    if (getLines() > _maxLineCount) {
         removeFirstLine();
     }
 }
 
 void CompactHistoryScroll::addLine(LineProperty lineProperty)
 {
-    auto &flag = _flags.last();
-    flag = lineProperty;
+    _lines.back().flags = lineProperty;
 }
 
 int CompactHistoryScroll::getLines()
 {
-    return _index.size();
+    return static_cast<int>(_lines.size());
 }
 
 int CompactHistoryScroll::getMaxLines()
@@ -77,13 +249,20 @@ int CompactHistoryScroll::getMaxLines()
     return _maxLineCount;
 }
 
+qint64 CompactHistoryScroll::memoryUsage()
+{
+    const qint64 blocks = static_cast<qint64>(_blocks.size()) + (_spareBlock ? 1 : 0);
+    return blocks * BlockSize + static_cast<qint64>(_lines.size()) * sizeof(Line)
+           + _styles.size() * (sizeof(Character) + sizeof(int)) + _freeStyles.size() * sizeof(quint16);
+}
+
 int CompactHistoryScroll::getLineLen(int lineNumber)
 {
-    if (lineNumber < 0 || lineNumber >= _index.size()) {
+    if (lineNumber < 0 || lineNumber >= getLines()) {
         return 0;
     }
 
-    return lineLen(lineNumber);
+    return _lines[static_cast<size_t>(lineNumber)].length;
 }
 
 void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
@@ -91,14 +270,47 @@ void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count,
     if (count == 0) {
         return;
     }
-    Q_ASSERT(lineNumber < _index.size());
+    Q_ASSERT(lineNumber < getLines());
 
+    const Line &line = _lines[static_cast<size_t>(lineNumber)];
     Q_ASSERT(startColumn >= 0);
-    Q_ASSERT(startColumn <= lineLen(lineNumber) - count);
+    Q_ASSERT(startColumn <= line.length - count);
+
+    const qint64 start = startOfLine(lineNumber);
+    if (line.encoding == CharacterEncoding) {
+        readData(start + startColumn * static_cast<qint64>(sizeof(Character)), buffer,
+                 count * static_cast<int>(sizeof(Character)));
+        return;
+    }
 
-    auto startCopy = _cells.begin() + startOfLine(lineNumber);
-    auto endCopy = startCopy + count;
-    std::copy(startCopy, endCopy, buffer);
+    _runBuffer.resize(line.runCount);
+    readData(start, _runBuffer.data(), line.runCount * static_cast<int>(sizeof(Run)));
+
+    const int charSize = line.encoding == Ucs4Encoding ? sizeof(quint32) : sizeof(quint16);
+    _textBuffer.resize(count * charSize);
+    readData(start + line.runCount * static_cast<qint64>(sizeof(Run)) + startColumn * static_cast<qint64>(charSize),
+             _textBuffer.data(), _textBuffer.size());
+    const quint16 *narrowText = reinterpret_cast<const quint16 *>(_textBuffer.constData());
+    const quint32 *wideText = reinterpret_cast<const quint32 *>(_textBuffer.constData());
+
+    // expand the runs which overlap the requested columns
+    const int endColumn = startColumn + count;
+    int runStart = 0;
+    int i = 0;
+    for (const Run &run : qAsConst(_runBuffer)) {
+        const int runEnd = runStart + run.length;
+        if (runEnd > startColumn) {
+            const Character &style = _styles[run.style];
+            for (int column = qMax(runStart, startColumn); column < qMin(runEnd, endColumn); column++, i++) {
+                buffer[i] = style;
+                buffer[i].character = line.encoding == Ucs4Encoding ? wideText[i] : narrowText[i];
+            }
+            if (runEnd >= endColumn) {
+                break;
+            }
+        }
+        runStart = runEnd;
+    }
 }
 
 void CompactHistoryScroll::setMaxNbLines(int lineCount)
@@ -106,79 +318,32 @@ void CompactHistoryScroll::setMaxNbLines(int lineCount)
     Q_ASSERT(lineCount >= 0);
     _maxLineCount = lineCount;
 
-    while (_index.size() > lineCount) {
+    while (getLines() > lineCount) {
         removeFirstLine();
     }
 }
 
 void CompactHistoryScroll::removeCells()
 {
-    if (_index.size() > 1) {
-        _index.pop_back();
-        _flags.pop_back();
-
-        while (_cells.size() > _index.last()) {
-            _cells.pop_back();
-        }
-    } else {
-        _cells.clear();
-        _index.clear();
-        _flags.clear();
+    if (_lines.empty()) {
+        return;
     }
+
+    releaseLine(_lines.back(), startOfLine(getLines() - 1));
+    _lines.pop_back();
+    _dataEnd = _lines.empty() ? _dataStart : _lines.back().end;
+
+    releaseUnusedBlocks();
 }
 
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _index.size());
-    return _flags[lineNumber] & LINE_WRAPPED;
+    Q_ASSERT(lineNumber < getLines());
+    return _lines[static_cast<size_t>(lineNumber)].flags & LINE_WRAPPED;
 }
 
 LineProperty CompactHistoryScroll::getLineProperty(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _index.size());
-    return _flags[lineNumber];
-}
-
-int CompactHistoryScroll::reflowLines(int columns)
-{
-    reflowData newLine;
-
-    auto reflowLineLen = [](int start, int end) {
-        return end - start;
-    };
-    auto setNewLine = [](reflowData &change, int index, LineProperty flag) {
-        change.index.append(index);
-        change.flags.append(flag);
-    };
-
-    int currentPos = 0;
-    while (currentPos < getLines()) {
-        int startLine = startOfLine(currentPos);
-        int endLine = startOfLine(currentPos + 1);
-        LineProperty lineProperty = getLineProperty(currentPos);
-
-        // Join the lines if they are wrapped
-        while (isWrappedLine(currentPos)) {
-            currentPos++;
-            endLine = startOfLine(currentPos + 1);
-        }
-
-        // Now reflow the lines
-        while (reflowLineLen(startLine, endLine) > columns && !(lineProperty & (LINE_DOUBLEHEIGHT_BOTTOM | LINE_DOUBLEHEIGHT_TOP))) {
-            startLine += columns;
-            setNewLine(newLine, startLine, lineProperty | LINE_WRAPPED);
-        }
-        setNewLine(newLine, endLine, lineProperty & ~LINE_WRAPPED);
-        currentPos++;
-    }
-    _index = newLine.index;
-    _flags = newLine.flags;
-
-    int deletedLines = 0;
-    while (getLines() > _maxLineCount) {
-        removeFirstLine();
-        ++deletedLines;
-    }
-
-    return deletedLines;
+    Q_ASSERT(lineNumber < getLines());
+    return _lines[static_cast<size_t>(lineNumber)].flags;
 }
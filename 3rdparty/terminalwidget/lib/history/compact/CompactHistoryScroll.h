@@ -9,12 +9,34 @@
 
 // STD
 #include <deque>
+#include <memory>
+
+// Qt
+#include <QByteArray>
+#include <QHash>
 
 #include "history/HistoryScroll.h"
 
 namespace Konsole
 {
 
+/**
+ * History kept in memory in a compact line format.
+ *
+ * Log output is mostly ASCII with a few colour spans per line, so instead of
+ * a 16 byte Character per cell a line is stored as
+ *
+ *   - runs of cells with the same colours and rendition, 4 bytes each:
+ *     the length of the run and the id of its style in a style table
+ *     shared by all lines of the history
+ *   - the text, 2 bytes per cell, or 4 bytes per cell if the line has
+ *     characters outside of the BMP
+ *
+ * Lines are decoded to Character only in getCells().  The styles are counted
+ * by the runs which use them and their ids are reused once the lines which
+ * used them are removed.  If the lines of the history use more styles than
+ * ids fit in 16 bits, a line is stored as Character cells instead.
+ */
 class KONSOLEPRIVATE_EXPORT CompactHistoryScroll : public HistoryScroll
 {
     typedef QVector<Character> TextLine;
@@ -25,6 +47,7 @@ public:
 
     int  getLines() override;
     int  getMaxLines() override;
+    qint64 memoryUsage() override;
     int  getLineLen(int lineNumber) override;
     void getCells(int lineNumber, int startColumn, int count, Character buffer[]) override;
     bool isWrappedLine(int lineNumber) override;
@@ -37,18 +60,84 @@ public:
 
     void setMaxNbLines(int lineCount);
 
-    int reflowLines(int columns) override;
-
 private:
-    QList<Character> _cells;
-    QList<int> _index;
-    QList<LineProperty> _flags;
+    enum Encoding : quint8 {
+        Ucs2Encoding,
+        Ucs4Encoding,
+        CharacterEncoding
+    };
+
+    struct Line {
+        qint64 end;             // offset after the last byte of the line
+        int length;             // cells
+        int runCount;
+        LineProperty flags;
+        Encoding encoding;
+    };
+
+    struct Run {
+        quint16 length;
+        quint16 style;
+    };
+
+    struct StyleKey {
+        quint32 foreground;
+        quint32 background;
+        quint8 rendition;
+
+        bool operator==(const StyleKey &other) const
+        {
+            return foreground == other.foreground && background == other.background
+                   && rendition == other.rendition;
+        }
+        friend uint qHash(const StyleKey &key, uint seed = 0)
+        {
+            return ::qHash((quint64(key.foreground) << 32) | key.background, seed) ^ key.rendition;
+        }
+    };
+
+    // Line data is stored in blocks of BlockSize bytes and addressed by an
+    // offset which only grows, so adding a line and removing the oldest
+    // one neither moves data nor rebases the offsets of other lines.
+    static const int BlockSize = 64 * 1024;
+    typedef std::unique_ptr<char[]> Block;
+
+    std::deque<Block> _blocks;
+    Block _spareBlock;      // last freed block, reused for the next new one
+    qint64 _blocksStart;    // offset of the first byte of _blocks.front()
+    qint64 _dataStart;      // offset of the first byte of line 0
+    qint64 _dataEnd;        // offset after the last byte
+    std::deque<Line> _lines;
+
+    // styles used by the lines, a Character with the colours and rendition
+    // of a run, indexed by Run::style
+    QVector<Character> _styles;
+    // runs of the lines which use each style
+    QVector<int> _styleRefs;
+    // ids of the styles no run uses, to be reused
+    QVector<quint16> _freeStyles;
+    QHash<StyleKey, quint16> _styleIds;
+
+    // reused to encode and decode lines
+    QVector<Run> _runBuffer;
+    QByteArray _textBuffer;
 
     int _maxLineCount;
 
+    void appendLine(const Character cells[], int count, LineProperty flags);
+    static StyleKey styleKey(const Character &cell);
+    // returns the id of the style of 'cell' for one more run, or -1 if the
+    // table is full
+    int styleId(const Character &cell);
+    void releaseStyle(quint16 style);
+    // releases the styles of the runs of 'line', which starts at 'start'
+    void releaseLine(const Line &line, qint64 start);
+    void appendData(const void *data, int size);
+    void readData(qint64 offset, void *data, int size) const;
+
     void removeFirstLine();
-    inline int lineLen(const int line);
-    inline int startOfLine(int line);
+    void releaseUnusedBlocks();
+    inline qint64 startOfLine(int line) const;
 };
 
 }
@@ -112,7 +112,10 @@ bool KPtyDevicePrivate::_k_canRead()
         }
 #endif
 
-        char *ptr = readBuffer.reserve(available);
+        // the fd is non-blocking, so ask for more than FIONREAD reported and
+        // take whatever else arrived in the meantime with the same read
+        const int readSize = available > 0 ? qMax<int>(available, READCHUNKSIZE) : 0;
+        char *ptr = readBuffer.reserve(readSize);
 #ifdef Q_OS_SOLARIS
         // Even if available > 0, it is possible for read()
         // to return 0 on Solaris, due to 0-byte writes in the stream.
@@ -126,14 +129,14 @@ bool KPtyDevicePrivate::_k_canRead()
 #endif
         // Useless block braces except in Solaris
         {
-          NO_INTR(readBytes, read(q->masterFd(), ptr, available));
+          NO_INTR(readBytes, read(q->masterFd(), ptr, readSize));
         }
         if (readBytes < 0) {
-            readBuffer.unreserve(available);
+            readBuffer.unreserve(readSize);
             q->setErrorString(QLatin1String("Error reading from PTY"));
             return false;
         }
-        readBuffer.unreserve(available - readBytes); // *should* be a no-op
+        readBuffer.unreserve(readSize - readBytes);
     }
 
     if (!readBytes) {
@@ -141,6 +144,12 @@ bool KPtyDevicePrivate::_k_canRead()
         emit q->readEof();
         return false;
     } else {
+        // stop polling while the reader is behind, the kernel then blocks
+        // the writing program until resumeThrottledRead()
+        if (readBufferLimit > 0 && readBuffer.size() >= readBufferLimit) {
+            readNotifier->setEnabled(false);
+            readThrottled = true;
+        }
         if (!emittedReadyRead) {
             emittedReadyRead = true;
             emit q->readyRead();
@@ -150,6 +159,14 @@ bool KPtyDevicePrivate::_k_canRead()
     }
 }
 
+void KPtyDevicePrivate::resumeThrottledRead()
+{
+    if (readThrottled && readBuffer.size() <= readBufferLimit / 2) {
+        readThrottled = false;
+        readNotifier->setEnabled(true);
+    }
+}
+
 bool KPtyDevicePrivate::_k_canWrite()
 {
     Q_Q(KPtyDevice);
@@ -337,6 +354,7 @@ void KPtyDevice::close()
 
     delete d->readNotifier;
     delete d->writeNotifier;
+    d->readThrottled = false;
 
     QIODevice::close();
 
@@ -387,27 +405,66 @@ bool KPtyDevice::waitForBytesWritten(int msecs)
 void KPtyDevice::setSuspended(bool suspended)
 {
     Q_D(KPtyDevice);
+    d->readThrottled = false;
     d->readNotifier->setEnabled(!suspended);
 }
 
 bool KPtyDevice::isSuspended() const
 {
     Q_D(const KPtyDevice);
-    return !d->readNotifier->isEnabled();
+    return !d->readNotifier->isEnabled() && !d->readThrottled;
+}
+
+void KPtyDevice::setReadBufferLimit(int bytes)
+{
+    Q_D(KPtyDevice);
+    d->readBufferLimit = qMax(0, bytes);
+    if (d->readThrottled && (d->readBufferLimit == 0 || d->readBuffer.size() < d->readBufferLimit)) {
+        d->readThrottled = false;
+        d->readNotifier->setEnabled(true);
+    }
+}
+
+int KPtyDevice::readBufferLimit() const
+{
+    Q_D(const KPtyDevice);
+    return d->readBufferLimit;
+}
+
+int KPtyDevice::bufferedData(const char **data) const
+{
+    Q_D(const KPtyDevice);
+    if (d->readBuffer.isEmpty()) {
+        *data = nullptr;
+        return 0;
+    }
+    *data = d->readBuffer.readPointer();
+    return d->readBuffer.readSize();
+}
+
+void KPtyDevice::skipBufferedData(int bytes)
+{
+    Q_D(KPtyDevice);
+    d->readBuffer.free(qMin(bytes, d->readBuffer.size()));
+    d->resumeThrottledRead();
 }
 
 // protected
 qint64 KPtyDevice::readData(char *data, qint64 maxlen)
 {
     Q_D(KPtyDevice);
-    return d->readBuffer.read(data, (int)qMin<qint64>(maxlen, KMAXINT));
+    qint64 bytes = d->readBuffer.read(data, (int)qMin<qint64>(maxlen, KMAXINT));
+    d->resumeThrottledRead();
+    return bytes;
 }
 
 // protected
 qint64 KPtyDevice::readLineData(char *data, qint64 maxlen)
 {
     Q_D(KPtyDevice);
-    return d->readBuffer.readLine(data, (int)qMin<qint64>(maxlen, KMAXINT));
+    qint64 bytes = d->readBuffer.readLine(data, (int)qMin<qint64>(maxlen, KMAXINT));
+    d->resumeThrottledRead();
+    return bytes;
 }
 
 // protected
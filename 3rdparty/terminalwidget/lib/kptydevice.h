@@ -116,6 +116,39 @@ public:
      */
     bool isSuspended() const;
 
+    /**
+     * Sets the high-water mark of the read buffer to @p bytes.
+     *
+     * Once this many bytes are buffered the pty is no longer polled until
+     * the reader has consumed half of them, so a program flooding the
+     * terminal blocks in write() instead of the buffer growing without
+     * bound.  0, the default, means no limit.
+     */
+    void setReadBufferLimit(int bytes);
+
+    /**
+     * Returns the high-water mark of the read buffer.
+     *
+     * See setReadBufferLimit()
+     */
+    int readBufferLimit() const;
+
+    /**
+     * Gives direct access to the buffered incoming data, without the copy
+     * made by read().  Sets @p data to the start of the next contiguous
+     * block and returns its size, 0 if nothing is buffered.
+     *
+     * The block stays valid until skipBufferedData() or read() is called
+     * or the event loop runs.
+     */
+    int bufferedData(const char **data) const;
+
+    /**
+     * Discards the first @p bytes of the buffered incoming data, usually
+     * after processing them in place with bufferedData().
+     */
+    void skipBufferedData(int bytes);
+
     /**
      * @return always true
      */
@@ -171,6 +204,9 @@ private:
 #include <list>
 
 #define CHUNKSIZE 4096
+// largest single read() from the pty master, a flood is taken in few big
+// reads instead of many small ones
+#define READCHUNKSIZE 65536
 
 class KRingBuffer
 {
@@ -183,6 +219,7 @@ public:
     void clear()
     {
         buffers.clear();
+        spare.clear();
         QByteArray tmp;
         tmp.resize(CHUNKSIZE);
         buffers.push_back(tmp);
@@ -235,6 +272,9 @@ public:
                 break;
             }
 
+            // keep one drained buffer around for the next reserve()
+            if (spare.capacity() == 0 && buffers.front().capacity() <= READCHUNKSIZE)
+                spare.swap(buffers.front());
             buffers.pop_front();
             head = 0;
         }
@@ -242,20 +282,26 @@ public:
 
     char *reserve(int bytes)
     {
-        totalSize += bytes;
-
         char *ptr;
         if (tail + bytes <= buffers.back().size()) {
             ptr = buffers.back().data() + tail;
             tail += bytes;
+        } else if (totalSize == 0 && buffers.size() == 1) {
+            // empty, grow the only buffer in place to reuse its allocation
+            buffers.front().resize(qMax(CHUNKSIZE, bytes));
+            ptr = buffers.front().data();
+            head = 0;
+            tail = bytes;
         } else {
             buffers.back().resize(tail);
             QByteArray tmp;
+            tmp.swap(spare);
             tmp.resize(qMax(CHUNKSIZE, bytes));
             ptr = tmp.data();
             buffers.push_back(tmp);
             tail = bytes;
         }
+        totalSize += bytes;
         return ptr;
     }
 
@@ -328,6 +374,8 @@ public:
 
 private:
     std::list<QByteArray> buffers;
+    // a drained buffer kept for reuse
+    QByteArray spare;
     int head, tail;
     int totalSize;
 };
@@ -339,12 +387,14 @@ struct KPtyDevicePrivate : public KPtyPrivate {
     KPtyDevicePrivate(KPty* parent) :
         KPtyPrivate(parent),
         emittedReadyRead(false), emittedBytesWritten(false),
-        readNotifier(nullptr), writeNotifier(nullptr)
+        readNotifier(nullptr), writeNotifier(nullptr),
+        readBufferLimit(0), readThrottled(false)
     {
     }
 
     bool _k_canRead();
     bool _k_canWrite();
+    void resumeThrottledRead();
 
     bool doWait(int msecs, bool reading);
     void finishOpen(QIODevice::OpenMode mode);
@@ -355,6 +405,9 @@ struct KPtyDevicePrivate : public KPtyPrivate {
     QSocketNotifier *writeNotifier;
     KRingBuffer readBuffer;
     KRingBuffer writeBuffer;
+    int readBufferLimit;
+    // polling was stopped because readBuffer reached readBufferLimit
+    bool readThrottled;
 };
 
 #endif
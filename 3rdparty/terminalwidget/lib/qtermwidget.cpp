@@ -22,6 +22,7 @@
 #include <QDir>
 #include <QMessageBox>
 #include <QApplication>
+#include <QMetaMethod>
 
 #include "ColorTables.h"
 #include "Session.h"
@@ -35,7 +36,7 @@
 #include "SearchBar.h"
 #include "qtermwidget.h"
 #include "history/compact/CompactHistoryType.h"
-#include "history/HistoryTypeFile.h"
+#include "history/HistoryTypeCompressedFile.h"
 
 #ifdef Q_OS_MACOS
 // Qt does not support fontconfig on macOS, so we need to use a "real" font name.
@@ -140,6 +141,9 @@ void QTermWidget::selectionChanged(bool textSelected)
 
 void QTermWidget::search(QString txt, bool forwards, bool next)
 {
+    // bring a history moved to disk back before positions are taken from it
+    m_impl->m_session->emulation()->touchHistory();
+
     /***mod begin by ut001121 zhangmeng 20200515 修复BUG22626***/
     int startColumn, startLine;
 
@@ -165,29 +169,41 @@ void QTermWidget::search(QString txt, bool forwards, bool next)
         m_impl->m_terminalDisplay->screenWindow()->screen()->getSelectionStart(startColumn, startLine);
     }
 
-    qDebug() << "current selection starts at: " << startColumn << startLine;
-    qDebug() << "current cursor position: " << m_impl->m_terminalDisplay->screenWindow()->cursorPosition();
-    qDebug() << "current backwardsPosition" << m_lastBackwardsPosition << endl;
-
     QString searchText(txt);
-    // qDebug() << "regExp??????" << regExp.isEmpty();
-    //regExp.setPatternSyntax(QRegExp::FixedString);
-    //regExp.setCaseSensitivity(Qt::CaseSensitive);
 
-    HistorySearch *historySearch =
-        new HistorySearch(m_impl->m_session->emulation(), searchText, forwards, m_isLastForwards, startColumn, startLine, this);
-    connect(historySearch, SIGNAL(matchFound(int, int, int, int, int, int, int)), this, SLOT(matchFound(int, int, int, int, int, int, int)));
-    connect(this, SIGNAL(sig_noMatchFound()), this, SLOT(clearSelection()));
+    // the matches are counted again only after new output
+    const bool countMatches = m_matchCount < 0 || searchText != m_countedText;
+    if (!countMatches) {
+        emit sig_matchCount(m_matchCount);
+    }
 
+    stopSearch();
+    HistorySearch *historySearch =
+        new HistorySearch(m_impl->m_session->emulation(), searchText, forwards, countMatches, startColumn, startLine, this);
+    connect(historySearch, SIGNAL(matchFound(int, int, int, int, int, int)), this, SLOT(matchFound(int, int, int, int, int, int)));
     connect(historySearch, &HistorySearch::noMatchFound, this, [this]() { emit sig_noMatchFound(); });
-    // connect(historySearch, SIGNAL(noMatchFound()), m_searchBar, SLOT(noMatchFound()));
-    historySearch->search(m_lastBackwardsPosition, m_startColumn, m_startLine);
+    connect(historySearch, &HistorySearch::matchCount, this, [this, searchText](int count, bool complete) {
+        if (complete) {
+            m_matchCount = count;
+            m_countedText = searchText;
+        }
+        emit sig_matchCount(count);
+    });
+
+    m_historySearch = historySearch;
+    historySearch->search();
     /***mod end by ut001121***/
+}
 
-    m_isLastForwards = forwards;
+void QTermWidget::stopSearch()
+{
+    if (m_historySearch) {
+        m_historySearch->cancel();
+        m_historySearch = nullptr;
+    }
 }
 
-void QTermWidget::matchFound(int startColumn, int startLine, int endColumn, int endLine, int lastBackwardsPosition, int loseChinese, int matchChinese)
+void QTermWidget::matchFound(int startColumn, int startLine, int endColumn, int endLine, int loseChinese, int matchChinese)
 {
     /***mod begin by ut001121 zhangmeng 20200515 修复BUG22626***/
     m_bHasSelect = true;
@@ -195,12 +211,8 @@ void QTermWidget::matchFound(int startColumn, int startLine, int endColumn, int
     m_startLine = startLine;
     m_endColumn = endColumn;
     m_endLine = endLine;
-    if (lastBackwardsPosition != -1) {
-        m_lastBackwardsPosition = lastBackwardsPosition;
-    }
 
     ScreenWindow *sw = m_impl->m_terminalDisplay->screenWindow();
-    qDebug() << "Scroll to" << startLine;
     sw->scrollTo(startLine);
     sw->setTrackOutput(false);
     sw->setSelectionStart(startColumn + loseChinese, startLine - sw->currentLine(), false);
@@ -358,8 +370,6 @@ void QTermWidget::setNoHasSelect()
 {
     if(m_bHasSelect) {
         //清除搜索状态
-        m_lastBackwardsPosition = -1;
-        m_isLastForwards = false;
         m_startColumn = 0;
         m_startLine = 0;
         m_endColumn = 0;
@@ -436,7 +446,8 @@ void QTermWidget::init(int startnow)
     connect(m_impl->m_session, SIGNAL(activity()), this, SIGNAL(activity()));
     connect(m_impl->m_session, SIGNAL(silence()), this, SIGNAL(silence()));
     connect(m_impl->m_session, &Session::profileChangeCommandReceived, this, &QTermWidget::profileChanged);
-    connect(m_impl->m_session, &Session::receivedData, this, &QTermWidget::receivedData);
+    // receivedData is only relayed once somebody connects to it, see connectNotify()
+    connect(m_impl->m_session, &Session::outputReceived, this, &QTermWidget::outputReceived);
     connect(m_impl->m_session, &Session::started, this, &QTermWidget::processStarted);
     // 标签标题参数变化
     connect(m_impl->m_session, &Session::titleArgsChange, this, &QTermWidget::titleArgsChange);
@@ -499,6 +510,9 @@ void QTermWidget::init(int startnow)
     connect(m_impl->m_session, &Session::titleChanged, this, &QTermWidget::titleChanged);
     connect(m_impl->m_session, &Session::cursorChanged, this, &QTermWidget::cursorChanged);
     connect(m_impl->m_session, &Session::shellWarningMessage, this, &QTermWidget::shellWarningMessage);
+    // new output may change the number of matches of the search
+    connect(m_impl->m_session->emulation(), &Emulation::outputChanged, this, [this] { m_matchCount = -1; });
+    connect(this, SIGNAL(sig_noMatchFound()), this, SLOT(clearSelection()));
 
     //将终端活动状态传给SessionManager单例
     connect(this, SIGNAL(isTermIdle(bool)), SessionManager::instance(), SIGNAL(sessionIdle(bool)));
@@ -678,7 +692,7 @@ void QTermWidget::setSize(const QSize &size)
 void QTermWidget::setHistorySize(int lines)
 {
     if (lines < 0)
-        m_impl->m_session->setHistoryType(HistoryTypeFile());
+        m_impl->m_session->setHistoryType(HistoryTypeCompressedFile());
     else
         m_impl->m_session->setHistoryType(CompactHistoryType(lines));
 }
@@ -703,6 +717,17 @@ void QTermWidget::setTrackOutput(bool enable)
     m_impl->m_terminalDisplay->screenWindow()->setTrackOutput(enable);
 }
 
+int QTermWidget::addOutputTrigger(const QList<QByteArray> &patterns, Qt::CaseSensitivity caseSensitivity,
+                                  const OutputTriggerCallback &callback)
+{
+    return m_impl->m_session->addOutputTrigger(patterns, caseSensitivity, callback);
+}
+
+void QTermWidget::removeOutputTrigger(int id)
+{
+    m_impl->m_session->removeOutputTrigger(id);
+}
+
 void QTermWidget::sendText(const QString &text)
 {
     //标记当前命令是代码中通过sendText发给终端的(而不是用户手动输入的命令)
@@ -732,6 +757,15 @@ void QTermWidget::resizeEvent(QResizeEvent *)
     m_impl->m_terminalDisplay->resize(this->size());
 }
 
+void QTermWidget::connectNotify(const QMetaMethod &signal)
+{
+    // 输出转换为QString的开销较大，只有在有人连接receivedData时才转发
+    if (signal == QMetaMethod::fromSignal(&QTermWidget::receivedData) && m_impl) {
+        connect(m_impl->m_session, &Session::receivedData, this, &QTermWidget::receivedData, Qt::UniqueConnection);
+    }
+    QWidget::connectNotify(signal);
+}
+
 void QTermWidget::sessionFinished()
 {
     emit finished();
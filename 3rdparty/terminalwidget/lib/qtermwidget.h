@@ -23,6 +23,7 @@
 #include <QTranslator>
 #include <QWidget>
 #include <QPointer>
+#include <functional>
 #include "Emulation.h"
 #include "Filter.h"
 #include "HistorySearch.h"
@@ -130,7 +131,7 @@ public:
     static void addCustomColorSchemeDir(const QString &custom_dir);
 
     // History size for scrolling
-    void setHistorySize(int lines);  // infinite if lines < 0
+    void setHistorySize(int lines);  // infinite, compressed on disk, if lines < 0
 
     // Presence of scrollbar
     void setScrollBarPosition(ScrollBarPosition);
@@ -148,6 +149,16 @@ public:
     // Send key event to terminal
     void sendKeyEvent(QKeyEvent *e);
 
+    /**
+     * Calls @p callback whenever one of @p patterns appears in the output of the
+     * terminal process, see Konsole::Session::addOutputTrigger().
+     * Returns an id for removeOutputTrigger().
+     */
+    typedef std::function<void(const char *data, int length, int matchEnd)> OutputTriggerCallback;
+    int addOutputTrigger(const QList<QByteArray> &patterns, Qt::CaseSensitivity caseSensitivity,
+                         const OutputTriggerCallback &callback);
+    void removeOutputTrigger(int id);
+
     // Sets whether flow control is enabled
     void setFlowControlEnabled(bool enabled);
 
@@ -326,10 +337,17 @@ signals:
 
     /**
      * Signals that we received new data from the process running in the
-     * terminal emulator
+     * terminal emulator.
+     * The output is only converted to text while this signal is connected,
+     * use outputReceived() or an output trigger where possible.
      */
     void receivedData(const QString &text);
 
+    /**
+     * Signals that the process running in the terminal emulator wrote some output
+     */
+    void outputReceived();
+
     /**
      * Signals for dynamically determine whether current terminal is busy or idle
      */
@@ -338,6 +356,8 @@ signals:
     void sig_noMatchFound();
     // 找到的信号
     void sig_matchFound();
+    // 搜索文本在输出中的匹配个数
+    void sig_matchCount(int count);
 
     // 标签标题参数改变 dzw 2020-12-2
     void titleArgsChange(QString key, QString value);
@@ -371,6 +391,8 @@ public slots:
     /******** Modify by n014361 wangpeili 2020-02-24:              ****************/
     // 新增外部搜索接口，不用qterminal内置的搜索接口
     void search(QString txt, bool forwards, bool next);
+    // 停止正在进行的搜索，关键字改变时调用
+    void stopSearch();
     // 清除选中框
     void clearSelection();
 
@@ -380,13 +402,14 @@ public slots:
     void saveHistory(QIODevice *device);
 protected:
     void resizeEvent(QResizeEvent *) override;
+    void connectNotify(const QMetaMethod &signal) override;
 
 protected slots:
     void sessionFinished();
     void selectionChanged(bool textSelected);
 
 private slots:
-    void matchFound(int startColumn, int startLine, int endColumn, int endLine, int lastBackwardsPosition, int loseChinese, int matchChinese);
+    void matchFound(int startColumn, int startLine, int endColumn, int endLine, int loseChinese, int matchChinese);
 
     /**
      * Emulation::cursorChanged() signal propogates to here and QTermWidget
@@ -401,7 +424,7 @@ private:
     void addSnapShotTimer();
     void interactionHandler();
 
-    TermWidgetImpl *m_impl;
+    TermWidgetImpl *m_impl = nullptr;
     SearchBar *m_searchBar;
     QVBoxLayout *m_layout;
     static QTranslator *m_translator;
@@ -413,9 +436,11 @@ private:
     int m_startLine = 0;
     int m_endColumn = 0;
     int m_endLine = 0;
-    int m_lastBackwardsPosition = -1;
-    //上一次是正向搜索还是反向搜索
-    bool m_isLastForwards = false;
+    // 上次搜索的文本及其匹配个数，有新输出时置为-1
+    QString m_countedText;
+    int m_matchCount = -1;
+    // 正在进行的搜索，在后台线程中查找
+    QPointer<HistorySearch> m_historySearch;
 };
 
 // Maybe useful, maybe not
@@ -0,0 +1,45 @@
+# Shell integration of terminalwidget for bash.
+#
+# Marks the prompt and the command line with the semantic prompt sequences,
+# OSC 133, and reports the current directory with OSC 7, so the terminal
+# does not have to find them in the text of the screen.  Source it at the
+# end of ~/.bashrc:
+#
+#   . /usr/share/terminalwidget5/shell-integration/integration.bash
+
+if [[ $- == *i* ]] && [[ -z "$__terminalwidget_integration" ]]; then
+    __terminalwidget_integration=1
+
+    # sets __terminalwidget_url_path to $1 with the bytes other than
+    # unreserved characters and / percent-encoded, for the file URL
+    __terminalwidget_url_encode() {
+        local LC_ALL=C dir=$1 c i
+        __terminalwidget_url_path=
+        for ((i = 0; i < ${#dir}; i++)); do
+            c=${dir:i:1}
+            case $c in
+            [a-zA-Z0-9/._~-]) __terminalwidget_url_path+=$c ;;
+            *) printf -v c '%%%02X' "'$c"
+               __terminalwidget_url_path+=$c ;;
+            esac
+        done
+    }
+
+    __terminalwidget_prompt_command() {
+        local status=$?
+        # the output of the last command ends
+        printf '\033]133;D;%s\007' "$status"
+        __terminalwidget_url_encode "$PWD"
+        printf '\033]7;file://%s%s\007' "$HOSTNAME" "$__terminalwidget_url_path"
+        # PS1 may be set again after this file was sourced
+        if [[ $PS1 != *'133;B'* ]]; then
+            PS1="\[\033]133;A\007\]$PS1\[\033]133;B\007\]"
+        fi
+        # for the rest of PROMPT_COMMAND and PS1
+        return $status
+    }
+    PROMPT_COMMAND="__terminalwidget_prompt_command${PROMPT_COMMAND:+;$PROMPT_COMMAND}"
+
+    # the command line was entered, PS0 is printed before it runs
+    PS0=$'\e]133;C\a'"$PS0"
+fi
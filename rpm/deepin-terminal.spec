@@ -119,6 +119,7 @@ ldconfig
 %{_datadir}/terminalwidget5/color-schemes/historic/*.schema
 %{_datadir}/terminalwidget5/kb-layouts/*.keytab
 %{_datadir}/terminalwidget5/kb-layouts/historic/*.keytab
+%{_datadir}/terminalwidget5/shell-integration/integration.*
 %{_datadir}/terminalwidget5/translations/*.qm
 
 %changelog
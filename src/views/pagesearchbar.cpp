@@ -47,11 +47,18 @@ PageSearchBar::PageSearchBar(QWidget *parent) : DFloatingWidget(parent)
     initFindNextButton();
     initFindPrevButton();
 
+    // 匹配个数
+    m_matchCountLabel = new DLabel(this);
+    m_matchCountLabel->setObjectName("PageSearchBarMatchCountLabel");
+    m_matchCountLabel->setAlignment(Qt::AlignCenter);
+    m_matchCountLabel->hide();
+
     // Init layout and widgets.
     QHBoxLayout *m_layout = new QHBoxLayout();
     m_layout->setSpacing(widgetSpace);
     m_layout->setContentsMargins(layoutMargins, layoutMargins, layoutMargins, layoutMargins);
     m_layout->addWidget(m_searchEdit);
+    m_layout->addWidget(m_matchCountLabel);
     m_layout->addWidget(m_findPrevButton);
     m_layout->addWidget(m_findNextButton);
     setLayout(m_layout);
@@ -208,3 +215,15 @@ void PageSearchBar::setNoMatchAlert(bool isAlert)
 {
     m_searchEdit->setAlert(isAlert);
 }
+
+void PageSearchBar::setMatchCount(int count)
+{
+    if (count < 0) {
+        m_matchCountLabel->clear();
+        m_matchCountLabel->hide();
+        return;
+    }
+
+    m_matchCountLabel->setText(QString::number(count));
+    m_matchCountLabel->show();
+}
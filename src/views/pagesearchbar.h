@@ -26,6 +26,7 @@
 #include <DIconButton>
 #include <DApplicationHelper>
 #include <DFloatingWidget>
+#include <DLabel>
 #include <DPalette>
 #include <DSearchEdit>
 #include <DPushButton>
@@ -66,6 +67,11 @@ public:
      * @param isAlert 是否警报
      */
     void setNoMatchAlert(bool isAlert);
+    /**
+     * @brief 显示搜索文本的匹配个数
+     * @param count 匹配个数，小于0时清空
+     */
+    void setMatchCount(int count);
     /**
      * @brief 获取搜索框内信息
      * @author ut000439 wangpeili
@@ -123,6 +129,7 @@ private:
     DIconButton *m_findNextButton = nullptr;
     DIconButton *m_findPrevButton = nullptr;
     DSearchEdit *m_searchEdit = nullptr;
+    DLabel *m_matchCountLabel = nullptr;
 
     const int barHight = 50;
     const int barWidth = 382;
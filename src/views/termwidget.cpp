@@ -176,10 +176,10 @@ TermWidget::TermWidget(const TermProperties &properties, QWidget *parent) : QTer
 void TermWidget::initConnections()
 {
     // 输出滚动，会在每个输出判断是否设置了滚动，即时设置
-    connect(this, &QTermWidget::receivedData, this, &TermWidget::onQTermWidgetReceivedData);
+    connect(this, &QTermWidget::outputReceived, this, &TermWidget::onOutputReceived);
 
-    // 接收到输出
-    connect(this, &TermWidget::receivedData, this, &TermWidget::onTermWidgetReceivedData);
+    // 接收到输出中的关键字
+    initOutputTriggers();
 
     // 接收到拖拽文件的Urls数据
     connect(this, &QTermWidget::sendUrlsToTerm, this, &TermWidget::onDropInUrls);
@@ -195,6 +195,8 @@ void TermWidget::initConnections()
 
     // 未找到搜索的匹配结果
     connect(this, &QTermWidget::sig_noMatchFound, this, &TermWidget::onSig_noMatchFound);
+    // 搜索的匹配个数
+    connect(this, &QTermWidget::sig_matchCount, this, &TermWidget::onSig_matchCount);
     /********************* Modify by n014361 wangpeili End ************************/
 
     connect(this, &QTermWidget::isTermIdle, this, &TermWidget::onTermIsIdle);
@@ -231,9 +233,51 @@ inline void TermWidget::onSig_noMatchFound()
     parentPage()->setMismatchAlert(true);
 }
 
-inline void TermWidget::onQTermWidgetReceivedData(QString value)
+inline void TermWidget::onSig_matchCount(int count)
 {
-    Q_UNUSED(value)
+    parentPage()->setMatchCount(count);
+}
+
+void TermWidget::initOutputTriggers()
+{
+    // 输出只在匹配到关键字时才回调，避免每次输出都转换为QString并逐个查找
+    addOutputTrigger(QList<QByteArray>() << "password:" << "enter passphrase for key", Qt::CaseInsensitive,
+    [this](const char *, int, int) {
+        onRemotePasswordPrompt();
+    });
+    addOutputTrigger(QList<QByteArray>() << "yes/no", Qt::CaseInsensitive, [this](const char *, int, int) {
+        onRemoteHostKeyPrompt();
+    });
+    /******** Modify by ut000610 daizhengwen 2020-05-25: quit download****************/
+    addOutputTrigger(QList<QByteArray>() << "Transfer incomplete", Qt::CaseSensitive, [this](const char *, int, int) {
+        QKeyEvent keyPress(QEvent::KeyPress, Qt::Key_C, Qt::ControlModifier);
+        QApplication::sendEvent(focusWidget(), &keyPress);
+    });
+    addOutputTrigger(QList<QByteArray>() << "\b \b #", Qt::CaseSensitive, [this](const char *, int length, int matchEnd) {
+        // 结束的时候有乱码的话，将它清除
+        if (matchEnd == length) {
+            QKeyEvent keyPress(QEvent::KeyPress, Qt::Key_U, Qt::ControlModifier);
+            QApplication::sendEvent(focusWidget(), &keyPress);
+        }
+    });
+    /********************* Modify by ut000610 daizhengwen End ************************/
+    // 退出远程后，设置成false
+    addOutputTrigger(QList<QByteArray>() << " closed.", Qt::CaseSensitive, [this](const char *data, int length, int) {
+        if (QByteArray::fromRawData(data, length).contains("Connection to"))
+            onRemoteConnectionClosed();
+    });
+    addOutputTrigger(QList<QByteArray>() << "Permission denied", Qt::CaseSensitive, [this](const char *, int, int) {
+        onRemoteConnectionClosed();
+    });
+}
+
+inline void TermWidget::onOutputReceived()
+{
+    //若ForegroundPid等于A，则代表远程结束，如开始连接时立刻ctrl+c
+    if (m_remotePasswordIsReady && getForegroundProcessId() == m_remoteMainPid) {
+        m_remotePasswordIsReady = false;
+    }
+
     // 完善终端输出滚动相关功能，默认设置为"智能滚动"(即滚动条滑到最底下时自动滚动)
     if (!Settings::instance()->OutputtingScroll()) {
         setIsAllowScroll(true);
@@ -251,48 +295,38 @@ inline void TermWidget::onQTermWidgetReceivedData(QString value)
     }
 }
 
-inline void TermWidget::onTermWidgetReceivedData(QString value)
+//前提：
+//启动终端ForegroundPid:A
+//远程开始、输入信息中、远程中：ForegroundPid:B
+//远程结束ForegroundPid:A
+//远程开始时，快速ctrl+c，也会有ForegroundPid：A-》B-》A的过程
+inline bool TermWidget::isRemotePromptExpected()
 {
-    //前提：
-    //启动终端ForegroundPid:A
-    //远程开始、输入信息中、远程中：ForegroundPid:B
-    //远程结束ForegroundPid:A
-    //远程开始时，快速ctrl+c，也会有ForegroundPid：A-》B-》A的过程
-
     //准备输入密码，且 ForegroundPid 不等于A时，为有效准备
-    if(m_remotePasswordIsReady && getForegroundProcessId() != m_remoteMainPid) {
-        //匹配关键字
-        if(value.toLower().contains("password:")
-                || value.toLower().contains("enter passphrase for key")) {
-        //输入密码,密码不为空，则发送
-            if(!m_remotePassword.isEmpty())
-                sendText(m_remotePassword + "\r");
-            emit remotePasswordHasInputed();
-        }
-        //第一次远程时，需要授权
-        if(value.toLower().contains("yes/no")) {
-            sendText("yes\r");
-        }
+    return m_remotePasswordIsReady && getForegroundProcessId() != m_remoteMainPid;
+}
 
-    }
-    //若ForegroundPid等于A，则代表远程结束，如开始连接时立刻ctrl+c
-    if(m_remotePasswordIsReady && getForegroundProcessId() == m_remoteMainPid) {
-        m_remotePasswordIsReady = false;
-    }
+inline void TermWidget::onRemotePasswordPrompt()
+{
+    if (!isRemotePromptExpected())
+        return;
 
-    /******** Modify by ut000610 daizhengwen 2020-05-25: quit download****************/
-    if (value.contains("Transfer incomplete")) {
-        QKeyEvent keyPress(QEvent::KeyPress, Qt::Key_C, Qt::ControlModifier);
-        QApplication::sendEvent(focusWidget(), &keyPress);
-    }
-    if (value.endsWith("\b \b #")) {                     // 结束的时候有乱码的话，将它清除
-        QKeyEvent keyPress(QEvent::KeyPress, Qt::Key_U, Qt::ControlModifier);
-        QApplication::sendEvent(focusWidget(), &keyPress);
-    }
-    /********************* Modify by ut000610 daizhengwen End ************************/
-    // 退出远程后，设置成false
-    if ((value.contains("Connection to") && value.contains(" closed.")) || value.contains("Permission denied"))
-        QTimer::singleShot(100, this, &TermWidget::onExitRemoteServer);
+    //输入密码,密码不为空，则发送
+    if (!m_remotePassword.isEmpty())
+        sendText(m_remotePassword + "\r");
+    emit remotePasswordHasInputed();
+}
+
+inline void TermWidget::onRemoteHostKeyPrompt()
+{
+    //第一次远程时，需要授权
+    if (isRemotePromptExpected())
+        sendText("yes\r");
+}
+
+inline void TermWidget::onRemoteConnectionClosed()
+{
+    QTimer::singleShot(100, this, &TermWidget::onExitRemoteServer);
 }
 
 inline void TermWidget::onExitRemoteServer()
@@ -346,8 +346,10 @@ private slots:
      */
     void onHostnameChanged();
 
-    void onQTermWidgetReceivedData(QString value);
-    void onTermWidgetReceivedData(QString value);
+    void onOutputReceived();
+    void onRemotePasswordPrompt();
+    void onRemoteHostKeyPrompt();
+    void onRemoteConnectionClosed();
     void onExitRemoteServer();
     void onUrlActivated(const QUrl &url, bool fromContextMenu);
     void onThemeTypeChanged(DGuiApplicationHelper::ColorType builtInTheme);
@@ -357,6 +359,7 @@ private slots:
     void onCopyAvailable(bool enable);
     void onSetTerminalFont();
     void onSig_noMatchFound();
+    void onSig_matchCount(int count);
 
     void onCopy();
     void onPaste();
@@ -391,6 +394,14 @@ private:
      * @author ut000438 王亮
      */
     void initConnections();
+    /**
+     * @brief 注册需要在输出中匹配的关键字(密码提示、传输中断、远程断开等)
+     */
+    void initOutputTriggers();
+    /**
+     * @brief 是否处于等待远程密码/授权提示的状态
+     */
+    bool isRemotePromptExpected();
     /*** 修复 bug 28162 鼠标左右键一起按终端会退出 ***/
     /**
      * @brief 添加菜单操作
@@ -629,7 +629,6 @@ void TermWidgetPage::onTermClosed()
 
 void TermWidgetPage::handleFindNext()
 {
-    qInfo() << m_findBar->searchKeytxt();
     setMismatchAlert(false);
     m_currentTerm->search(m_findBar->searchKeytxt(), true, true);
 }
@@ -669,6 +668,9 @@ void TermWidgetPage::handleFindPrev()
 void TermWidgetPage::handleUpdateSearchKeyword(const QString &keyword)
 {
     setMismatchAlert(false);
+    // 个数属于上一个关键字，上一个关键字的搜索也不再需要
+    setMatchCount(-1);
+    m_currentTerm->stopSearch();
     if (keyword.isEmpty()) {
         m_currentTerm->clearSelection();
     } else {
@@ -767,6 +769,11 @@ void TermWidgetPage::setMismatchAlert(bool alert)
     m_findBar->setNoMatchAlert(alert);
 }
 
+void TermWidgetPage::setMatchCount(int count)
+{
+    m_findBar->setMatchCount(count);
+}
+
 void TermWidgetPage::resizeEvent(QResizeEvent *event)
 {
     Q_UNUSED(event)
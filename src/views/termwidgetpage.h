@@ -276,6 +276,11 @@ public:
      * @param alert 警告
      */
     void setMismatchAlert(bool alert);
+    /**
+     * @brief 在搜索框中显示匹配个数
+     * @param count 匹配个数，-1表示不显示
+     */
+    void setMatchCount(int count);
 
     /**
      * @brief 显示重命名弹窗，判断是否有重命名弹窗，有则显示，没有则创建
@@ -144,4 +144,21 @@ TEST_F(UT_PageSearchBar_Test, keyPressEvent)
 
     EXPECT_TRUE(UT_STUB_QWIDGET_HASFOCUS_RESULT);
 }
+
+TEST_F(UT_PageSearchBar_Test, setMatchCount)
+{
+    TermWidgetPage *termPage = m_normalWindow->currentPage();
+    ASSERT_TRUE(termPage);
+    PageSearchBar *searchBar = termPage->m_findBar;
+    ASSERT_TRUE(searchBar);
+
+    searchBar->setMatchCount(12);
+    EXPECT_EQ(searchBar->m_matchCountLabel->text(), QString("12"));
+    EXPECT_FALSE(searchBar->m_matchCountLabel->isHidden());
+
+    //关键字改变时清空
+    termPage->handleUpdateSearchKeyword("a");
+    EXPECT_TRUE(searchBar->m_matchCountLabel->text().isEmpty());
+    EXPECT_TRUE(searchBar->m_matchCountLabel->isHidden());
+}
 #endif
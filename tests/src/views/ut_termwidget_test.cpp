@@ -277,7 +277,7 @@ TEST_F(UT_TermWidget_Test, search)
     termWidget->search("~", false, true);
 }
 
-TEST_F(UT_TermWidget_Test, onTermWidgetReceivedData)
+TEST_F(UT_TermWidget_Test, stopSearch)
 {
     m_normalWindow->resize(800, 600);
     m_normalWindow->show();
@@ -286,8 +286,24 @@ TEST_F(UT_TermWidget_Test, onTermWidgetReceivedData)
     TermWidgetPage *currTermPage = m_normalWindow->currentPage();
     EXPECT_EQ(currTermPage->isVisible(), true);
 
+    // 搜索在后台进行，关键字改变时停止
     TermWidget *termWidget = currTermPage->m_currentTerm;
-    termWidget->onTermWidgetReceivedData("Permission denied");
+    termWidget->search("~", true, false);
+    currTermPage->handleUpdateSearchKeyword("~~");
+    EXPECT_TRUE(termWidget->m_historySearch.isNull());
+}
+
+TEST_F(UT_TermWidget_Test, onRemoteConnectionClosed)
+{
+    m_normalWindow->resize(800, 600);
+    m_normalWindow->show();
+    EXPECT_EQ(m_normalWindow->isVisible(), true);
+
+    TermWidgetPage *currTermPage = m_normalWindow->currentPage();
+    EXPECT_EQ(currTermPage->isVisible(), true);
+
+    TermWidget *termWidget = currTermPage->m_currentTerm;
+    termWidget->onRemoteConnectionClosed();
     termWidget->onExitRemoteServer();
     termWidget->onUrlActivated(QUrl(""),true);
     termWidget->onWindowEffectEnabled(true);